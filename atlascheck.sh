@@ -0,0 +1,20 @@
+#!/bin/bash
+
+BUILD_DIR=./build/release
+
+if [ ! -d $BUILD_DIR ]; then
+    echo "Creating $BUILD_DIR"
+    mkdir -p $BUILD_DIR
+fi
+
+# atlas.h pulls in the renderer headers, atlas_pack itself does not call vulkan
+gcc src/atlascheck.c -O2 -Wall -Wextra -Wno-unused-function -Wno-missing-braces \
+    -I "/home/pate/Downloads/vulkan/1.1.126.0/x86_64/include/" \
+    -lm -lglfw -lvulkan -lpthread -o $BUILD_DIR/atlascheck
+
+if [ $? -ne 0 ]; then
+    echo "Build failed"
+    exit 1
+fi
+
+$BUILD_DIR/atlascheck "$@"
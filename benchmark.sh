@@ -0,0 +1,22 @@
+#!/bin/bash
+
+BUILD_DIR=./build/release
+
+if [ ! -d $BUILD_DIR ]; then
+    echo "Creating $BUILD_DIR"
+    mkdir -p $BUILD_DIR
+fi
+
+# native build picks avx/sse/neon kernels, scalar build is the baseline
+gcc src/benchmark.c -O2 -march=native -Wall -Wextra -Wno-unused-function -Wno-missing-braces \
+    -lm -o $BUILD_DIR/benchmark && \
+gcc src/benchmark.c -O2 -DCMATH_NO_SIMD -Wall -Wextra -Wno-unused-function -Wno-missing-braces \
+    -lm -o $BUILD_DIR/benchmark_scalar
+
+if [ $? -ne 0 ]; then
+    echo "Build failed"
+    exit 1
+fi
+
+$BUILD_DIR/benchmark
+$BUILD_DIR/benchmark_scalar
@@ -44,6 +44,8 @@ IF /I "%1"=="build_run" (
 IF /I "%1"=="build_shaders" (
 		C:/VulkanSDK/1.1.114.0/Bin32/glslc.exe shaders/basic_shader.vert -o shaders/basic_shader_vert.spv
 		C:/VulkanSDK/1.1.114.0/Bin32/glslc.exe shaders/basic_shader.frag -o shaders/basic_shader_frag.spv
+		C:/VulkanSDK/1.1.114.0/Bin32/glslc.exe shaders/hiz_reduce.comp -o shaders/hiz_reduce_comp.spv
+		C:/VulkanSDK/1.1.114.0/Bin32/glslc.exe shaders/occlusion_cull.comp -o shaders/occlusion_cull_comp.spv
 		)
 
 ENDLOCAL
@@ -15,7 +15,7 @@ src/main.c \
 -O0 -fstrict-aliasing -fexceptions \
 -g -Wall -Wextra -Wstrict-aliasing \
 -Wno-unused-function  -Wno-missing-braces \
--lm -lglfw -lvulkan \
+-lm -lglfw -lvulkan -lpthread \
 -o $BUILD_DIR/motor
 
 if [ $? -eq 0 ]; then
@@ -3,3 +3,5 @@
 
 glslc shaders/basic_shader.vert -o shaders/basic_shader_vert.spv
 glslc shaders/basic_shader.frag -o shaders/basic_shader_frag.spv
+glslc shaders/hiz_reduce.comp -o shaders/hiz_reduce_comp.spv
+glslc shaders/occlusion_cull.comp -o shaders/occlusion_cull_comp.spv
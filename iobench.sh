@@ -0,0 +1,19 @@
+#!/bin/bash
+
+BUILD_DIR=./build/release
+
+if [ ! -d $BUILD_DIR ]; then
+    echo "Creating $BUILD_DIR"
+    mkdir -p $BUILD_DIR
+fi
+
+# test files go to build/release/iofiles unless a directory is given
+gcc src/iobench.c -O2 -Wall -Wextra -Wno-unused-function -Wno-missing-braces \
+    -lm -lpthread -o $BUILD_DIR/iobench
+
+if [ $? -ne 0 ]; then
+    echo "Build failed"
+    exit 1
+fi
+
+$BUILD_DIR/iobench "$@"
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+BUILD_DIR=./build/release
+
+if [ ! -d $BUILD_DIR ]; then
+    echo "Creating $BUILD_DIR"
+    mkdir -p $BUILD_DIR
+fi
+
+gcc src/jobbench.c -O2 -Wall -Wextra -Wno-unused-function -Wno-missing-braces \
+    -lm -lpthread -o $BUILD_DIR/jobbench
+
+if [ $? -ne 0 ]; then
+    echo "Build failed"
+    exit 1
+fi
+
+$BUILD_DIR/jobbench "$@"
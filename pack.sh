@@ -0,0 +1,19 @@
+#!/bin/bash
+
+BUILD_DIR=./build/release
+
+if [ ! -d $BUILD_DIR ]; then
+    echo "Creating $BUILD_DIR"
+    mkdir -p $BUILD_DIR
+fi
+
+# packs models, textures and shaders to data.pack when no paths are given
+gcc src/pack.c -O2 -Wall -Wextra -Wno-unused-function -Wno-missing-braces \
+    -lm -lpthread -o $BUILD_DIR/pack
+
+if [ $? -ne 0 ]; then
+    echo "Build failed"
+    exit 1
+fi
+
+$BUILD_DIR/pack "$@"
@@ -4,14 +4,17 @@
 
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(binding = 1) uniform sampler2D texSampler;
+// All material textures, only the used part of the array is written
+layout(binding = 1) uniform sampler2D textures[];
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterial;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
+    outColor = texture(textures[nonuniformEXT(fragMaterial)], fragTexCoord);
 }
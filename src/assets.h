@@ -0,0 +1,133 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Assets are requested without waiting for them. Meshes are parsed and built in the thread
+// pool and draw nothing until assets_update uploads them between frames. Textures show the
+// placeholder from the loader until the streamer has their first levels up.
+
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "utils.h"
+#include "thread.h"
+#include "threadpool.h"
+#include "timer.h"
+#include "vertex.h"
+#include "texture.h"
+#include "profiler.h"
+#include "startup.h"
+
+#define ASSETS_MAX_MESHES 64
+
+typedef struct MeshRequest {
+    char                path[256];
+    VertexData*         target;     // filled when uploaded
+    MeshLoadData        data;
+    u8                  loaded;     // worker is done, guarded by lock of loader
+    u8                  uploaded;
+    u64                 requestNs;
+    u64                 loadNs;
+    struct AssetLoader* loader;
+} MeshRequest;
+
+typedef struct AssetLoader {
+    MeshRequest     meshes[ASSETS_MAX_MESHES];
+    u32             numMeshes;
+    u32             numPending;
+    Mutex           lock;
+    ThreadPool*     threads;
+    Texture         placeholder;    // 1x1 grey, sampled by textures that are not loaded yet
+} AssetLoader;
+
+static void
+assets_init(AssetLoader* loader, ThreadPool* threads, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue) {
+
+    PROFILE_FUNCTION();
+    memset(loader, 0, sizeof *loader);
+    loader->threads = threads;
+    mutex_init(&loader->lock);
+    const u8 grey[4] = {128, 128, 128, 255};
+    loader->placeholder = texture_create_from_pixels(grey, 1, 1, physicalDevice, device, pool,
+            graphicsQue, TextureSample);
+}
+
+static void
+_assets_mesh_job(void* data) {
+
+    PROFILE_FUNCTION();
+    MeshRequest* request = (MeshRequest*)data;
+    u64 start = timer_now_ns();
+    vertexdata_load(&request->data, request->path);
+    request->loadNs = timer_now_ns() - start;
+    char name[64];
+    snprintf(name, sizeof name, "load mesh %.40s", request->path);
+    startup_task(&g_startup, name, start, request->loadNs);
+
+    mutex_lock(&request->loader->lock);
+    request->loaded = 1;
+    mutex_unlock(&request->loader->lock);
+}
+
+// Target stays empty and draws nothing until the mesh is uploaded by assets_update
+static void
+assets_request_mesh(AssetLoader* loader, const char* path, VertexData* target) {
+
+    ASSERT_MESSAGE(loader->numMeshes < ASSETS_MAX_MESHES, "Too many mesh requests");
+    ASSERT_MESSAGE(!vertexdata_ready(target), "Mesh is already loaded");
+    MeshRequest* request = &loader->meshes[loader->numMeshes++];
+    memset(request, 0, sizeof *request);
+    snprintf(request->path, sizeof request->path, "%s", path);
+    request->target = target;
+    request->loader = loader;
+    request->requestNs = timer_now_ns();
+    loader->numPending++;
+    threadpool_push(loader->threads, _assets_mesh_job, request);
+}
+
+// Call between frames, uploads meshes that are done. Frames before this drew nothing
+// for them so there is nothing in flight to wait. Returns meshes still loading
+static u32
+assets_update(AssetLoader* loader, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue) {
+
+    PROFILE_FUNCTION();
+    if(!loader->numPending) return 0;
+    for(u32 i = 0; i < loader->numMeshes; i++) {
+        MeshRequest* request = &loader->meshes[i];
+        if(request->uploaded) continue;
+        mutex_lock(&loader->lock);
+        u8 loaded = request->loaded;
+        mutex_unlock(&loader->lock);
+        if(!loaded) continue;
+
+        u64 start = timer_now_ns();
+        vertexdata_upload(request->target, &request->data, device, physicalDevice, pool, graphicsQue);
+        request->uploaded = 1;
+        loader->numPending--;
+        LOG("Mesh %s ready %.1f ms after request, built in %.1f ms, uploaded in %.1f ms", request->path,
+                (double)(timer_now_ns() - request->requestNs) / 1e6, (double)request->loadNs / 1e6,
+                (double)(timer_now_ns() - start) / 1e6);
+    }
+    return loader->numPending;
+}
+
+static void
+assets_dispose(AssetLoader* loader, VkDevice device) {
+
+    // workers may still be writing to requests
+    if(loader->numPending) {
+        threadpool_wait(loader->threads);
+    }
+    for(u32 i = 0; i < loader->numMeshes; i++) {
+        if(!loader->meshes[i].uploaded) {
+            vertexdata_load_dispose(&loader->meshes[i].data);
+        }
+    }
+    texture_dispose(&loader->placeholder, device);
+    mutex_dispose(&loader->lock);
+    memset(loader, 0, sizeof *loader);
+}
+
+#endif /* ASSETS_H */
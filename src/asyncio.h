@@ -0,0 +1,399 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Asynchronous file reads. Loaders queue reads with a callback and asyncio_update calls
+// the callbacks of finished ones, both from the thread that owns the service.
+// On Linux reads go to io_uring so many small reads are in flight with few syscalls.
+// Without io_uring, or on other platforms, each read is a pread in the thread pool and
+// queue depth is limited to what the pool runs at once.
+
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include "utils.h"
+#include "thread.h"
+#include "threadpool.h"
+#include "fileutils.h"
+#include "profiler.h"
+
+#if defined(LINUX_PLATFORM)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#define ASYNCIO_URING 1
+#else
+#define ASYNCIO_URING 0
+#endif
+
+#define ASYNCIO_QUEUE_DEPTH 64      // reads in flight at once
+#define ASYNCIO_MAX_REQUESTS 1024   // queued and in flight
+#define ASYNCIO_MAX_CHUNK (1u << 30)
+
+typedef void (*AsyncReadFunc)(void* user, u8* dst, size_t size, u8 ok);
+
+typedef enum AsyncBackend {
+    AsyncBackendAuto,       // io_uring when kernel has it
+    AsyncBackendThreads,
+} AsyncBackend;
+
+typedef struct AsyncRequest {
+    char                path[256];
+    u64                 offset;
+    size_t              size;
+    size_t              done;
+    u8*                 dst;
+    AsyncReadFunc       func;
+    void*               user;
+    i32                 error;
+    i32                 fd;
+#if ASYNCIO_URING
+    struct iovec        iov;
+#endif
+    struct AsyncIO*     io;
+} AsyncRequest;
+
+#if ASYNCIO_URING
+typedef struct AsyncRing {
+    i32                     fd;
+    void*                   sqMap;
+    size_t                  sqMapSize;
+    void*                   cqMap;
+    size_t                  cqMapSize;
+    struct io_uring_sqe*    sqes;
+    size_t                  sqesSize;
+    u32*                    sqTail;
+    u32*                    sqArray;
+    u32                     sqMask;
+    u32*                    cqHead;
+    u32*                    cqTail;
+    u32                     cqMask;
+    struct io_uring_cqe*    cqes;
+    u32                     unsubmitted;    // in ring but not taken by kernel yet
+} AsyncRing;
+#endif
+
+typedef struct AsyncIO {
+    AsyncRequest    requests[ASYNCIO_MAX_REQUESTS];
+    u32             freeSlots[ASYNCIO_MAX_REQUESTS];
+    u32             numFree;
+    u32             queued[ASYNCIO_MAX_REQUESTS];   // waiting for room in queue, fifo
+    u32             queuedFirst;
+    u32             numQueued;
+    u32             inFlight;
+    u32             depth;
+    u8              uring;
+#if ASYNCIO_URING
+    AsyncRing       ring;
+#endif
+    // finished reads, pool workers add here too
+    Mutex               lock;
+    ConditionVariable   finished;
+    u32                 done[ASYNCIO_MAX_REQUESTS];
+    u32                 numDone;
+    ThreadPool*         threads;
+
+    u64             bytesRead;
+    u32             numReads;
+    u32             numFailed;
+    u32             numSubmits;     // syscalls or pool pushes
+} AsyncIO;
+
+static AsyncIO g_asyncIO;
+
+#if ASYNCIO_URING
+static u8
+_asyncio_ring_init(AsyncRing* ring, u32 entries) {
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof params);
+    ring->fd = (i32)syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->fd < 0) return 0;
+
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQ_RING);
+    ring->cqMap = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQES);
+    if(ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || sqes == MAP_FAILED) {
+        if(ring->sqMap != MAP_FAILED) munmap(ring->sqMap, ring->sqMapSize);
+        if(ring->cqMap != MAP_FAILED) munmap(ring->cqMap, ring->cqMapSize);
+        if(sqes != MAP_FAILED) munmap(sqes, ring->sqesSize);
+        close(ring->fd);
+        return 0;
+    }
+    u8* sq = (u8*)ring->sqMap;
+    u8* cq = (u8*)ring->cqMap;
+    ring->sqes = (struct io_uring_sqe*)sqes;
+    ring->sqTail = (u32*)(sq + params.sq_off.tail);
+    ring->sqArray = (u32*)(sq + params.sq_off.array);
+    ring->sqMask = *(u32*)(sq + params.sq_off.ring_mask);
+    ring->cqHead = (u32*)(cq + params.cq_off.head);
+    ring->cqTail = (u32*)(cq + params.cq_off.tail);
+    ring->cqMask = *(u32*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->unsubmitted = 0;
+    return 1;
+}
+
+static void
+_asyncio_ring_dispose(AsyncRing* ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    munmap(ring->cqMap, ring->cqMapSize);
+    munmap(ring->sqMap, ring->sqMapSize);
+    close(ring->fd);
+}
+
+static void
+_asyncio_ring_push(AsyncIO* io, u32 index) {
+
+    AsyncRing* ring = &io->ring;
+    AsyncRequest* request = &io->requests[index];
+    size_t left = request->size - request->done;
+    request->iov.iov_base = request->dst + request->done;
+    request->iov.iov_len = left > ASYNCIO_MAX_CHUNK ? ASYNCIO_MAX_CHUNK : left;
+
+    // only this thread writes the tail
+    u32 tail = *ring->sqTail;
+    u32 slot = tail & ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[slot];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = request->fd;
+    sqe->off = request->offset + request->done;
+    sqe->addr = (u64)(uintptr_t)&request->iov;
+    sqe->len = 1;
+    sqe->user_data = index;
+    ring->sqArray[slot] = slot;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+}
+
+static void
+_asyncio_ring_enter(AsyncIO* io, u32 minComplete) {
+
+    AsyncRing* ring = &io->ring;
+    if(!ring->unsubmitted && !minComplete) return;
+    i32 ret = (i32)syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, minComplete,
+            minComplete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    io->numSubmits++;
+    if(ret > 0) {
+        ring->unsubmitted -= (u32)ret;
+    } else if(ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        ABORT("io_uring_enter failed with %d", errno);
+    }
+}
+
+// Short reads go back to the queue for the rest
+static void
+_asyncio_ring_reap(AsyncIO* io) {
+
+    AsyncRing* ring = &io->ring;
+    u32 head = *ring->cqHead;
+    u32 tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    while(head != tail) {
+        const struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+        u32 index = (u32)cqe->user_data;
+        i32 res = cqe->res;
+        head++;
+
+        AsyncRequest* request = &io->requests[index];
+        io->inFlight--;
+        if(res == -EINTR || res == -EAGAIN) {
+            io->queued[(io->queuedFirst + io->numQueued++) % ASYNCIO_MAX_REQUESTS] = index;
+            continue;
+        }
+        if(res <= 0) {
+            request->error = res < 0 ? -res : EIO;   // zero is end of file before size
+        } else {
+            request->done += (size_t)res;
+            if(request->done < request->size) {
+                io->queued[(io->queuedFirst + io->numQueued++) % ASYNCIO_MAX_REQUESTS] = index;
+                continue;
+            }
+        }
+        close(request->fd);
+        mutex_lock(&io->lock);
+        io->done[io->numDone++] = index;
+        mutex_unlock(&io->lock);
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+}
+#endif
+
+static void
+_asyncio_read_job(void* data) {
+
+    PROFILE_FUNCTION();
+    AsyncRequest* request = (AsyncRequest*)data;
+    AsyncIO* io = request->io;
+    request->done = file_read_range(request->path, request->offset, request->size, request->dst) ?
+        request->size : 0;
+    request->error = request->done == request->size ? 0 : EIO;
+
+    mutex_lock(&io->lock);
+    io->done[io->numDone++] = (u32)(request - io->requests);
+    condition_signal(&io->finished);
+    mutex_unlock(&io->lock);
+}
+
+// Starts queued reads while there is room in queue
+static void
+_asyncio_flush(AsyncIO* io) {
+
+    while(io->numQueued && io->inFlight < io->depth) {
+        u32 index = io->queued[io->queuedFirst];
+        io->queuedFirst = (io->queuedFirst + 1) % ASYNCIO_MAX_REQUESTS;
+        io->numQueued--;
+        io->inFlight++;
+#if ASYNCIO_URING
+        if(io->uring) {
+            _asyncio_ring_push(io, index);
+            continue;
+        }
+#endif
+        io->numSubmits++;
+        threadpool_push(io->threads, _asyncio_read_job, &io->requests[index]);
+    }
+#if ASYNCIO_URING
+    if(io->uring) _asyncio_ring_enter(io, 0);
+#endif
+}
+
+static void
+asyncio_init(AsyncIO* io, ThreadPool* threads, AsyncBackend backend) {
+
+    memset(io, 0, sizeof *io);
+    io->threads = threads;
+    io->depth = ASYNCIO_QUEUE_DEPTH;
+    for(u32 i = 0; i < ASYNCIO_MAX_REQUESTS; i++) {
+        io->freeSlots[i] = ASYNCIO_MAX_REQUESTS - 1 - i;
+        io->requests[i].io = io;
+    }
+    io->numFree = ASYNCIO_MAX_REQUESTS;
+    mutex_init(&io->lock);
+    condition_init(&io->finished);
+
+#if ASYNCIO_URING
+    if(backend == AsyncBackendAuto) {
+        io->uring = _asyncio_ring_init(&io->ring, ASYNCIO_QUEUE_DEPTH);
+    }
+#endif
+    if(!io->uring) {
+        // pool runs only this many at once anyway
+        io->depth = threads->numThreads;
+    }
+    LOG("Async reads with %s, queue depth %u", io->uring ? "io_uring" : "thread pool", io->depth);
+}
+
+// dst has to stay until func is called from asyncio_update. Returns 0 when too many reads
+// are queued already, try again after an update
+static u8
+asyncio_read(AsyncIO* io, const char* path, u64 offset, size_t size, u8* dst,
+        AsyncReadFunc func, void* user) {
+
+    if(!io->numFree) return 0;
+    u32 index = io->freeSlots[--io->numFree];
+    AsyncRequest* request = &io->requests[index];
+    snprintf(request->path, sizeof request->path, "%s", path);
+    request->offset = offset;
+    request->size = size;
+    request->done = 0;
+    request->dst = dst;
+    request->func = func;
+    request->user = user;
+    request->error = 0;
+    request->fd = -1;
+
+#if ASYNCIO_URING
+    if(io->uring) {
+        request->fd = open(path, O_RDONLY | O_CLOEXEC);
+        if(request->fd < 0 || !size) {
+            // nothing to read, finishes on next update
+            request->error = request->fd < 0 ? errno : 0;
+            if(request->fd >= 0) close(request->fd);
+            mutex_lock(&io->lock);
+            io->done[io->numDone++] = index;
+            mutex_unlock(&io->lock);
+            return 1;
+        }
+    }
+#endif
+    io->queued[(io->queuedFirst + io->numQueued++) % ASYNCIO_MAX_REQUESTS] = index;
+    _asyncio_flush(io);
+    return 1;
+}
+
+// Calls callbacks of finished reads and starts queued ones, returns reads not finished yet
+static u32
+asyncio_update(AsyncIO* io) {
+
+#if ASYNCIO_URING
+    if(io->uring) _asyncio_ring_reap(io);
+#endif
+    u32 done[ASYNCIO_MAX_REQUESTS];
+    mutex_lock(&io->lock);
+    u32 numDone = io->numDone;
+    memcpy(done, io->done, sizeof *done * numDone);
+    io->numDone = 0;
+    mutex_unlock(&io->lock);
+
+    for(u32 i = 0; i < numDone; i++) {
+        AsyncRequest* request = &io->requests[done[i]];
+        // ring counted these when reaping, and reads that failed to open were never in flight
+        if(!io->uring) io->inFlight--;
+        u8 ok = request->error == 0;
+        io->bytesRead += request->done;
+        io->numReads++;
+        io->numFailed += !ok;
+        io->freeSlots[io->numFree++] = done[i];
+        request->func(request->user, request->dst, request->done, ok);
+    }
+    _asyncio_flush(io);
+    return ASYNCIO_MAX_REQUESTS - io->numFree;
+}
+
+// Blocks until every read is finished and called back
+static void
+asyncio_wait(AsyncIO* io) {
+
+    while(asyncio_update(io)) {
+#if ASYNCIO_URING
+        if(io->uring) {
+            mutex_lock(&io->lock);
+            u8 ready = io->numDone > 0;
+            mutex_unlock(&io->lock);
+            if(!ready && io->inFlight) _asyncio_ring_enter(io, 1);
+            continue;
+        }
+#endif
+        mutex_lock(&io->lock);
+        while(!io->numDone) {
+            condition_wait(&io->finished, &io->lock);
+        }
+        mutex_unlock(&io->lock);
+    }
+}
+
+static void
+asyncio_dispose(AsyncIO* io) {
+
+    asyncio_wait(io);
+    LOG("Async reads: %u (%u failed), %.1f MB, %u submits", io->numReads, io->numFailed,
+            (double)io->bytesRead / (1024.0 * 1024.0), io->numSubmits);
+#if ASYNCIO_URING
+    if(io->uring) _asyncio_ring_dispose(&io->ring);
+#endif
+    condition_dispose(&io->finished);
+    mutex_dispose(&io->lock);
+}
+
+#endif /* ASYNCIO_H */
@@ -0,0 +1,254 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Small textures packed to one atlas when assets are imported, so they share one image,
+// allocation, view and bindless slot. Meshes using a packed texture get their uvs moved
+// to its rectangle with atlas_remap_uvs.
+// Every image gets a border copied from its edges and starts at multiple of ATLAS_ALIGN,
+// so the few mips atlas has never mix neighbours. Uvs have to stay in 0-1 since repeat
+// would wrap to the whole atlas, meshes tiling their texture should keep it separate.
+// atlas_pack does the cpu side without touching vulkan, src/atlascheck.c tests it.
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "utils.h"
+#include "cmath.h"
+#include "objload.h"
+#include "texture.h"
+
+#define ATLAS_MAX_SIZE 4096
+#define ATLAS_MAX_ENTRY_SIZE 256    // bigger ones are not worth packing
+#define ATLAS_PADDING 4             // border on each side
+#define ATLAS_ALIGN 4               // 2 ^ (ATLAS_MIP_LEVELS - 1)
+#define ATLAS_MIP_LEVELS 3          // padding still one texel at last mip
+
+// Where the image landed, uv in atlas is offset + uv * scale
+typedef struct AtlasRect {
+    vec2    offset;
+    vec2    scale;
+    u32     x, y;
+    u32     width, height;
+    u8      packed;
+} AtlasRect;
+
+typedef struct TextureAtlas {
+    Texture     texture;
+    u32         width, height;
+    AtlasRect*  rects;          // one for each path given to atlas_pack
+    u32         numRects;
+    u32         numPacked;
+} TextureAtlas;
+
+// Decodes of one atlas_build, pool may be running other work too
+typedef struct AtlasBatch {
+    Mutex               lock;
+    ConditionVariable   decoded;
+    u32                 numDecoded;
+} AtlasBatch;
+
+typedef struct AtlasDecodeJob {
+    const char*     path;
+    u8*             pixels;
+    u32             width, height;
+    AtlasBatch*     batch;
+} AtlasDecodeJob;
+
+static void
+_atlas_decode_job(void* data) {
+    AtlasDecodeJob* job = (AtlasDecodeJob*)data;
+    job->pixels = _load_texture_data(job->path, &job->width, &job->height);
+
+    mutex_lock(&job->batch->lock);
+    job->batch->numDecoded++;
+    condition_signal(&job->batch->decoded);
+    mutex_unlock(&job->batch->lock);
+}
+
+static inline u32
+_atlas_align(u32 value) {
+    return (value + ATLAS_ALIGN - 1) & ~(ATLAS_ALIGN - 1);
+}
+
+// Shelves from tallest to shortest, returns used height or 0 when something did not fit
+static u32
+_atlas_shelf_pack(AtlasRect* rects, const u32* order, u32 count, u32 width) {
+
+    u32 x = 0, y = 0, shelfHeight = 0;
+    for(u32 i = 0; i < count; i++) {
+        AtlasRect* rect = &rects[order[i]];
+        u32 w = _atlas_align(rect->width + 2 * ATLAS_PADDING);
+        u32 h = _atlas_align(rect->height + 2 * ATLAS_PADDING);
+        if(x + w > width) {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        if(y + h > ATLAS_MAX_SIZE) return 0;
+        rect->x = x + ATLAS_PADDING;
+        rect->y = y + ATLAS_PADDING;
+        x += w;
+        if(h > shelfHeight) shelfHeight = h;
+    }
+    return y + shelfHeight;
+}
+
+// Image with its edge texels repeated to the padding
+static void
+_atlas_blit(u8* dst, u32 dstWidth, const AtlasRect* rect, const u8* src) {
+
+    for(i32 y = -ATLAS_PADDING; y < (i32)rect->height + ATLAS_PADDING; y++) {
+        u32 srcY = y < 0 ? 0 : y >= (i32)rect->height ? rect->height - 1 : (u32)y;
+        u8* row = dst + ((size_t)(rect->y + y) * dstWidth + rect->x) * 4;
+        const u8* srcRow = src + (size_t)srcY * rect->width * 4;
+        for(i32 x = -ATLAS_PADDING; x < 0; x++) memcpy(row + x * 4, srcRow, 4);
+        memcpy(row, srcRow, (size_t)rect->width * 4);
+        for(u32 x = rect->width; x < rect->width + ATLAS_PADDING; x++) {
+            memcpy(row + x * 4, srcRow + (rect->width - 1) * 4, 4);
+        }
+    }
+}
+
+// Decode images in pool and pack the small ones to levels of chain, rects tell which made it in.
+// Images that were too big or did not fit are left for caller to load alone. Returns 0 and
+// leaves chain empty if nothing was packed.
+// Blocks until pool workers have decoded every image, so it must not run in a pool job:
+// with workers waiting here nobody would be left to decode
+static u8
+atlas_pack(TextureAtlas* atlas, const char** paths, u32 count, ThreadPool* threads, MipChain* chain) {
+
+    memset(atlas, 0, sizeof *atlas);
+    memset(chain, 0, sizeof *chain);
+    atlas->rects = (AtlasRect*)calloc(count, sizeof *atlas->rects);
+    atlas->numRects = count;
+
+    AtlasBatch batch = {};
+    mutex_init(&batch.lock);
+    condition_init(&batch.decoded);
+    AtlasDecodeJob* jobs = (AtlasDecodeJob*)calloc(count, sizeof *jobs);
+    for(u32 i = 0; i < count; i++) {
+        jobs[i].path = paths[i];
+        jobs[i].batch = &batch;
+        threadpool_push(threads, _atlas_decode_job, &jobs[i]);
+    }
+    mutex_lock(&batch.lock);
+    while(batch.numDecoded < count) {
+        condition_wait(&batch.decoded, &batch.lock);
+    }
+    mutex_unlock(&batch.lock);
+    condition_dispose(&batch.decoded);
+    mutex_dispose(&batch.lock);
+
+    // tallest first keeps shelves tight
+    u32* order = (u32*)malloc(sizeof *order * count);
+    u32 numCandidates = 0;
+    size_t area = 0;        // of candidates, only picks the starting width
+    for(u32 i = 0; i < count; i++) {
+        AtlasRect* rect = &atlas->rects[i];
+        rect->width = jobs[i].width;
+        rect->height = jobs[i].height;
+        if(rect->width > ATLAS_MAX_ENTRY_SIZE || rect->height > ATLAS_MAX_ENTRY_SIZE) continue;
+        u32 slot = numCandidates++;
+        while(slot && atlas->rects[order[slot - 1]].height < rect->height) {
+            order[slot] = order[slot - 1];
+            slot--;
+        }
+        order[slot] = i;
+        area += (size_t)_atlas_align(rect->width + 2 * ATLAS_PADDING) * _atlas_align(rect->height + 2 * ATLAS_PADDING);
+    }
+
+    // narrowest power of two width that packs everything, drop the shortest ones if none does
+    u32 height = 0, width = ATLAS_MAX_ENTRY_SIZE * 2;
+    while(width * width < area && width < ATLAS_MAX_SIZE) width *= 2;
+    while(numCandidates) {
+        height = _atlas_shelf_pack(atlas->rects, order, numCandidates, width);
+        if(height) break;
+        if(width < ATLAS_MAX_SIZE) {
+            width *= 2;
+        } else {
+            numCandidates--;
+        }
+    }
+
+    if(numCandidates) {
+        height = _atlas_align(height);
+        u8* pixels = (u8*)calloc((size_t)width * height, 4);
+        for(u32 i = 0; i < numCandidates; i++) {
+            AtlasRect* rect = &atlas->rects[order[i]];
+            _atlas_blit(pixels, width, rect, jobs[order[i]].pixels);
+            rect->offset = (vec2){(float)rect->x / width, (float)rect->y / height};
+            rect->scale = (vec2){(float)rect->width / width, (float)rect->height / height};
+            rect->packed = 1;
+        }
+
+        // only the mips padding keeps apart
+        mipchain_build_levels(chain, pixels, width, height, ATLAS_MIP_LEVELS, threads);
+        free(pixels);
+        atlas->width = width;
+        atlas->height = height;
+        atlas->numPacked = numCandidates;
+    }
+
+    for(u32 i = 0; i < count; i++) {
+        stbi_image_free(jobs[i].pixels);
+    }
+    free(order);
+    free(jobs);
+    return atlas->numPacked > 0;
+}
+
+// atlas_pack and upload, same rule of not calling from a pool job applies
+static void
+atlas_build(TextureAtlas* atlas, const char** paths, u32 count, ThreadPool* threads,
+        VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool pool, VkQueue graphicsQue) {
+
+    u64 start = timer_now_ns();
+    MipChain chain;
+    if(atlas_pack(atlas, paths, count, threads, &chain)) {
+        atlas->texture = texture_create_from_mipchain(&chain, physicalDevice, device, pool, graphicsQue,
+                TextureSample | TextureMipmap);
+        mipchain_dispose(&chain);
+    }
+
+    size_t packedArea = 0;
+    for(u32 i = 0; i < count; i++) {
+        const AtlasRect* rect = &atlas->rects[i];
+        if(!rect->packed) continue;
+        packedArea += (size_t)_atlas_align(rect->width + 2 * ATLAS_PADDING) *
+            _atlas_align(rect->height + 2 * ATLAS_PADDING);
+    }
+    size_t packedTexels = (size_t)atlas->width * atlas->height;
+    LOG("Atlas %ux%u packed %u of %u textures, %.1f%% used, in %.1f ms", atlas->width, atlas->height,
+            atlas->numPacked, count, packedTexels ? 100.0 * packedArea / packedTexels : 0.0,
+            (double)(timer_now_ns() - start) / 1e6);
+}
+
+// Move uvs of mesh to the rectangle of its texture, returns 0 and leaves mesh alone if uvs
+// go outside 0-1 since those would sample neighbours
+static u8
+atlas_remap_uvs(VertexLoadData* mesh, const AtlasRect* rect) {
+
+    ASSERT_MESSAGE(rect->packed, "Texture of mesh is not in atlas");
+    for(i32 i = 0; i < mesh->numVertexes; i++) {
+        vec2 uv = mesh->vertexes[i].uv;
+        if(uv.x < 0.f || uv.x > 1.f || uv.y < 0.f || uv.y > 1.f) return 0;
+    }
+    for(i32 i = 0; i < mesh->numVertexes; i++) {
+        vec2* uv = &mesh->vertexes[i].uv;
+        uv->x = rect->offset.x + uv->x * rect->scale.x;
+        uv->y = rect->offset.y + uv->y * rect->scale.y;
+    }
+    return 1;
+}
+
+static void
+atlas_dispose(TextureAtlas* atlas, VkDevice device) {
+    if(atlas->numPacked) {
+        texture_dispose(&atlas->texture, device);
+    }
+    free(atlas->rects);
+    memset(atlas, 0, sizeof *atlas);
+}
+
+#endif /* ATLAS_H */
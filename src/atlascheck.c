@@ -0,0 +1,194 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Packs generated images with atlas_pack and checks the result: rects with their borders
+// stay apart, borders repeat the image edges and remapped uvs sample the texel they did before.
+// Build and run with atlascheck.sh, usage: atlascheck [workers]. Exits with 1 if a check fails
+
+#include "utils.h"
+#include "timer.h"
+#include "threadpool.h"
+#include "physicalDevice.h"
+#include "vertex.h"
+#include "atlas.h"
+
+#define CHECK_IMAGES 7
+#define CHECK_UVS 5
+
+static u32 g_failures;
+
+static void
+_check(u8 ok, const char* what) {
+    if(!ok) {
+        g_failures++;
+        LOG_ERR(CONSOLE_COLOR_RED, "Check failed: %s", what);
+    }
+}
+
+// Every texel tells which image and where it came from
+static void
+_texel(u32 image, u32 x, u32 y, u8* rgb) {
+    rgb[0] = (u8)(x * 7 + image * 31);
+    rgb[1] = (u8)(y * 13 + image * 17);
+    rgb[2] = (u8)(image * 37 + 5);
+}
+
+static u8
+_write_image(const char* path, u32 image, u32 width, u32 height) {
+
+    FILE* file = fopen(path, "wb");
+    if(!file) return 0;
+    fprintf(file, "P6 %u %u 255\n", width, height);
+    for(u32 y = 0; y < height; y++) {
+        for(u32 x = 0; x < width; x++) {
+            u8 rgb[3];
+            _texel(image, x, y, rgb);
+            fwrite(rgb, 1, 3, file);
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+static u8
+_texel_matches(const u8* atlasTexel, u32 image, u32 x, u32 y) {
+    u8 rgb[3];
+    _texel(image, x, y, rgb);
+    return memcmp(atlasTexel, rgb, 3) == 0 && atlasTexel[3] == 255;
+}
+
+static void
+_check_rects(const TextureAtlas* atlas) {
+
+    for(u32 i = 0; i < atlas->numRects; i++) {
+        const AtlasRect* a = &atlas->rects[i];
+        if(!a->packed) continue;
+        _check(a->x >= ATLAS_PADDING && a->y >= ATLAS_PADDING &&
+                a->x + a->width + ATLAS_PADDING <= atlas->width &&
+                a->y + a->height + ATLAS_PADDING <= atlas->height, "rect and border inside atlas");
+        _check(a->x % ATLAS_ALIGN == ATLAS_PADDING % ATLAS_ALIGN &&
+                a->y % ATLAS_ALIGN == ATLAS_PADDING % ATLAS_ALIGN, "rect starts aligned");
+
+        for(u32 j = i + 1; j < atlas->numRects; j++) {
+            const AtlasRect* b = &atlas->rects[j];
+            if(!b->packed) continue;
+            // borders included, neighbours may touch but not overlap
+            u8 apart = a->x + a->width + ATLAS_PADDING <= b->x - ATLAS_PADDING ||
+                b->x + b->width + ATLAS_PADDING <= a->x - ATLAS_PADDING ||
+                a->y + a->height + ATLAS_PADDING <= b->y - ATLAS_PADDING ||
+                b->y + b->height + ATLAS_PADDING <= a->y - ATLAS_PADDING;
+            _check(apart, "rects do not overlap");
+        }
+    }
+}
+
+// Inside is the image and border repeats the nearest edge texel
+static void
+_check_texels(const TextureAtlas* atlas, const MipChain* chain) {
+
+    for(u32 i = 0; i < atlas->numRects; i++) {
+        const AtlasRect* rect = &atlas->rects[i];
+        if(!rect->packed) continue;
+        u32 bad = 0;
+        for(i32 y = -ATLAS_PADDING; y < (i32)rect->height + ATLAS_PADDING; y++) {
+            for(i32 x = -ATLAS_PADDING; x < (i32)rect->width + ATLAS_PADDING; x++) {
+                u32 srcX = (u32)min_i32(max_i32(x, 0), (i32)rect->width - 1);
+                u32 srcY = (u32)min_i32(max_i32(y, 0), (i32)rect->height - 1);
+                const u8* texel = chain->data + ((size_t)(rect->y + y) * atlas->width + rect->x + x) * 4;
+                bad += !_texel_matches(texel, i, srcX, srcY);
+            }
+        }
+        if(bad) LOG("Image %u has %u wrong texels", i, bad);
+        _check(!bad, "image and border texels");
+    }
+}
+
+// Texel centers and corners of the image still hit the same texel after remap
+static void
+_check_uvs(const TextureAtlas* atlas, const MipChain* chain) {
+
+    for(u32 i = 0; i < atlas->numRects; i++) {
+        const AtlasRect* rect = &atlas->rects[i];
+        if(!rect->packed) continue;
+
+        Vertex vertexes[CHECK_UVS] = {};
+        u32 texels[CHECK_UVS][2] = {
+            {0, 0}, {rect->width - 1, 0}, {0, rect->height - 1},
+            {rect->width - 1, rect->height - 1}, {rect->width / 2, rect->height / 3},
+        };
+        for(u32 v = 0; v < CHECK_UVS; v++) {
+            vertexes[v].uv.x = ((float)texels[v][0] + 0.5f) / rect->width;
+            vertexes[v].uv.y = ((float)texels[v][1] + 0.5f) / rect->height;
+        }
+        VertexLoadData mesh = {.vertexes = vertexes, .numVertexes = CHECK_UVS};
+        _check(atlas_remap_uvs(&mesh, rect), "uvs in 0-1 are remapped");
+
+        for(u32 v = 0; v < CHECK_UVS; v++) {
+            // nearest sampling of the top level
+            u32 x = (u32)(vertexes[v].uv.x * atlas->width);
+            u32 y = (u32)(vertexes[v].uv.y * atlas->height);
+            const u8* texel = chain->data + ((size_t)y * atlas->width + x) * 4;
+            _check(_texel_matches(texel, i, texels[v][0], texels[v][1]), "remapped uv samples same texel");
+        }
+
+        // repeat would wrap to whole atlas, mesh is left alone
+        Vertex outside = {.uv = {1.5f, 0.5f}};
+        VertexLoadData tiled = {.vertexes = &outside, .numVertexes = 1};
+        _check(!atlas_remap_uvs(&tiled, rect) && outside.uv.x == 1.5f, "uvs outside 0-1 are not remapped");
+    }
+}
+
+int
+main(int argc, char** argv) {
+
+    u32 workers = argc > 1 ? (u32)atoi(argv[1]) : 0;
+    mipgen_init();
+    ThreadPool pool;
+    threadpool_init(&pool, workers);
+
+    // odd sizes, one too big to pack
+    const u32 sizes[CHECK_IMAGES][2] = {
+        {64, 64}, {13, 29}, {100, 7}, {1, 1}, {256, 40}, {300, 20}, {31, 31},
+    };
+    char names[CHECK_IMAGES][64];
+    const char* paths[CHECK_IMAGES];
+    for(u32 i = 0; i < CHECK_IMAGES; i++) {
+        snprintf(names[i], sizeof names[i], "atlascheck_%u.ppm", i);
+        paths[i] = names[i];
+        if(!_write_image(paths[i], i, sizes[i][0], sizes[i][1])) {
+            ABORT("Could not write %s", paths[i]);
+        }
+    }
+
+    u64 start = timer_now_ns();
+    TextureAtlas atlas;
+    MipChain chain;
+    u8 packed = atlas_pack(&atlas, paths, CHECK_IMAGES, &pool, &chain);
+    LOG("Packed %u of %u images to %ux%u in %.1f ms", atlas.numPacked, CHECK_IMAGES,
+            atlas.width, atlas.height, (double)(timer_now_ns() - start) / 1e6);
+
+    _check(packed && atlas.numPacked == CHECK_IMAGES - 1, "every small image is packed");
+    _check(!atlas.rects[5].packed, "image over ATLAS_MAX_ENTRY_SIZE is left out");
+    _check(chain.width == atlas.width && chain.height == atlas.height, "chain is size of atlas");
+    _check(chain.mipLevels == ATLAS_MIP_LEVELS, "atlas has ATLAS_MIP_LEVELS levels");
+    if(packed) {
+        _check_rects(&atlas);
+        _check_texels(&atlas, &chain);
+        _check_uvs(&atlas, &chain);
+    }
+
+    mipchain_dispose(&chain);
+    free(atlas.rects);
+    for(u32 i = 0; i < CHECK_IMAGES; i++) {
+        remove(paths[i]);
+    }
+    threadpool_dispose(&pool);
+
+    if(g_failures) {
+        LOG_ERR(CONSOLE_COLOR_RED, "%u checks failed", g_failures);
+        return 1;
+    }
+    LOG("All atlas checks passed");
+    return 0;
+}
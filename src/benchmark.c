@@ -0,0 +1,249 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Standalone math and transform benchmark, does not need vulkan or a window
+// Build with benchmark.sh, compare against -DCMATH_NO_SIMD build for the scalar baseline
+
+#include "utils.h"
+#include "cmath.h"
+#include "timer.h"
+#include "transform.h"
+
+#define BENCH_MATRIXES 4096
+#define BENCH_POINTS (1 << 16)
+#define BENCH_ROUNDS 200
+// small enough for all seven arrays to stay in L1, 4096 points already measure L2 bandwidth
+#define BENCH_SOA_POINTS 1024
+#define BENCH_SOA_ROUNDS (BENCH_ROUNDS * BENCH_POINTS / BENCH_SOA_POINTS)
+#define BENCH_NODES 100000
+#define BENCH_NODE_CHILDREN 9
+#define BENCH_FRAMES 100
+
+static float g_sink = 0.f;
+
+static float
+_random_float() {
+    return (float)rand() / (float)RAND_MAX * 2.f - 1.f;
+}
+
+// Random rotation, scale and translation so that inverse exists
+static void
+_random_transform(mat4* m) {
+    identify_mat4(m);
+    rotate_mat4_X(m, _random_float() * pi);
+    rotate_mat4_Y(m, _random_float() * pi);
+    rotate_mat4_Z(m, _random_float() * pi);
+    scale_mat4(m, 0.5f + (_random_float() + 1.f));
+    translate_mat4(m, (vec3){_random_float() * 10.f, _random_float() * 10.f, _random_float() * 10.f});
+}
+
+static float
+_max_diff(const float* l, const float* r, u32 count) {
+    float ret = 0.f;
+    for(u32 i = 0; i < count; i++) {
+        float scale = maxf(1.f, fabsf(l[i]));
+        ret = maxf(ret, fabsf(l[i] - r[i]) / scale);
+    }
+    return ret;
+}
+
+static void
+_report(const char* name, u64 ns, u64 count) {
+    double seconds = timer_seconds(ns);
+    printf("%-28s %10.2f M/s %8.2f ns/op\n", name, (double)count / seconds / 1e6, (double)ns / (double)count);
+}
+
+i32
+main(const int argc, char** argv) {
+    (void)argc; (void)argv;
+    srand(1234);
+
+    mat4* lhv = (mat4*)malloc(sizeof *lhv * BENCH_MATRIXES);
+    mat4* rhv = (mat4*)malloc(sizeof *rhv * BENCH_MATRIXES);
+    mat4* res = (mat4*)malloc(sizeof *res * BENCH_MATRIXES);
+    mat4* ref = (mat4*)malloc(sizeof *ref * BENCH_MATRIXES);
+    vec4* points = (vec4*)malloc(sizeof *points * BENCH_POINTS);
+    vec4* transformed = (vec4*)malloc(sizeof *transformed * BENCH_POINTS);
+    vec4* transformedRef = (vec4*)malloc(sizeof *transformedRef * BENCH_POINTS);
+
+    for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+        _random_transform(&lhv[i]);
+        _random_transform(&rhv[i]);
+    }
+    for(u32 i = 0; i < BENCH_POINTS; i++) {
+        points[i] = (vec4){_random_float() * 100.f, _random_float() * 100.f, _random_float() * 100.f, 1.f};
+    }
+
+    printf("cmath kernels: %s\n", CMATH_SIMD_NAME);
+
+    { // matrix multiply
+        for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+            mat4_mult_mat4_scalar(&ref[i], &lhv[i], &rhv[i]);
+            mat4_mult_mat4(&res[i], &lhv[i], &rhv[i]);
+        }
+        float diff = _max_diff(&res[0].mat[0][0], &ref[0].mat[0][0], BENCH_MATRIXES * 16);
+
+        u64 start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_ROUNDS; r++) {
+            for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+                mat4_mult_mat4_scalar(&res[i], &lhv[i], &rhv[i]);
+            }
+            g_sink += res[r % BENCH_MATRIXES].mat[3][3];
+        }
+        _report("mat4 mult (scalar)", timer_now_ns() - start, (u64)BENCH_ROUNDS * BENCH_MATRIXES);
+
+        start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_ROUNDS; r++) {
+            for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+                mat4_mult_mat4(&res[i], &lhv[i], &rhv[i]);
+            }
+            g_sink += res[r % BENCH_MATRIXES].mat[3][3];
+        }
+        _report("mat4 mult", timer_now_ns() - start, (u64)BENCH_ROUNDS * BENCH_MATRIXES);
+        printf("%-28s %g\n", "  max relative diff", diff);
+    }
+
+    { // inverse
+        for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+            inverse_mat4_scalar(&ref[i], &lhv[i]);
+            inverse_mat4(&res[i], &lhv[i]);
+        }
+        float diff = _max_diff(&res[0].mat[0][0], &ref[0].mat[0][0], BENCH_MATRIXES * 16);
+
+        u64 start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_ROUNDS; r++) {
+            for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+                inverse_mat4_scalar(&res[i], &lhv[i]);
+            }
+            g_sink += res[r % BENCH_MATRIXES].mat[3][3];
+        }
+        _report("mat4 inverse (scalar)", timer_now_ns() - start, (u64)BENCH_ROUNDS * BENCH_MATRIXES);
+
+        start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_ROUNDS; r++) {
+            for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+                inverse_mat4(&res[i], &lhv[i]);
+            }
+            g_sink += res[r % BENCH_MATRIXES].mat[3][3];
+        }
+        _report("mat4 inverse", timer_now_ns() - start, (u64)BENCH_ROUNDS * BENCH_MATRIXES);
+        printf("%-28s %g\n", "  max relative diff", diff);
+    }
+
+    { // points through one matrix
+        const mat4* m = &lhv[0];
+        u64 start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_ROUNDS; r++) {
+            for(u32 i = 0; i < BENCH_POINTS; i++) {
+                transformed[i] = mat4_mult_vec4(m, points[i]);
+            }
+            g_sink += transformed[r].w;
+        }
+        _report("point transform", timer_now_ns() - start, (u64)BENCH_ROUNDS * BENCH_POINTS);
+    }
+
+    { // batched soa points
+        const mat4* m = &lhv[0];
+        float* soa = (float*)malloc(sizeof *soa * BENCH_SOA_POINTS * 7);
+        float *x = soa, *y = x + BENCH_SOA_POINTS, *z = y + BENCH_SOA_POINTS;
+        float *ox = z + BENCH_SOA_POINTS, *oy = ox + BENCH_SOA_POINTS, *oz = oy + BENCH_SOA_POINTS, *ow = oz + BENCH_SOA_POINTS;
+        for(u32 i = 0; i < BENCH_SOA_POINTS; i++) {
+            x[i] = points[i].x;
+            y[i] = points[i].y;
+            z[i] = points[i].z;
+            transformedRef[i] = mat4_mult_vec4_scalar(m, points[i]);
+        }
+        mat4_transform_points_soa(m, x, y, z, ox, oy, oz, ow, BENCH_SOA_POINTS);
+        float diff = 0.f;
+        for(u32 i = 0; i < BENCH_SOA_POINTS; i++) {
+            vec4 p = {ox[i], oy[i], oz[i], ow[i]};
+            diff = maxf(diff, _max_diff(&p.x, &transformedRef[i].x, 4));
+        }
+
+        // same points one at a time for comparison
+        u64 start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_SOA_ROUNDS; r++) {
+            for(u32 i = 0; i < BENCH_SOA_POINTS; i++) {
+                transformed[i] = mat4_mult_vec4(m, points[i]);
+            }
+            g_sink += transformed[r % BENCH_SOA_POINTS].w;
+        }
+        _report("point transform aos batch", timer_now_ns() - start, (u64)BENCH_SOA_ROUNDS * BENCH_SOA_POINTS);
+
+        start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_SOA_ROUNDS; r++) {
+            mat4_transform_points_soa(m, x, y, z, ox, oy, oz, ow, BENCH_SOA_POINTS);
+            g_sink += ow[r % BENCH_SOA_POINTS];
+        }
+        _report("point transform soa batch", timer_now_ns() - start, (u64)BENCH_SOA_ROUNDS * BENCH_SOA_POINTS);
+        printf("%-28s %g\n", "  max relative diff", diff);
+        free(soa);
+    }
+
+    { // one matrix times many
+        for(u32 i = 0; i < BENCH_MATRIXES; i++) {
+            mat4_mult_mat4_scalar(&ref[i], &lhv[0], &rhv[i]);
+        }
+        mat4_mult_mat4_batch(res, &lhv[0], rhv, BENCH_MATRIXES);
+        float diff = _max_diff(&res[0].mat[0][0], &ref[0].mat[0][0], BENCH_MATRIXES * 16);
+
+        u64 start = timer_now_ns();
+        for(u32 r = 0; r < BENCH_ROUNDS; r++) {
+            mat4_mult_mat4_batch(res, &lhv[0], rhv, BENCH_MATRIXES);
+            g_sink += res[r].mat[3][3];
+        }
+        _report("mat4 mult batch", timer_now_ns() - start, (u64)BENCH_ROUNDS * BENCH_MATRIXES);
+        printf("%-28s %g\n", "  max relative diff", diff);
+    }
+
+    { // transform hierarchy, roots with two levels of children
+        TransformHierarchy scene;
+        transform_init(&scene, BENCH_NODES);
+        while(scene.count < BENCH_NODES) {
+            u32 root = transform_add(&scene, TRANSFORM_NONE, (vec3){_random_float(), 0.f, 0.f},
+                    (quat){0.f, 0.f, 0.f, 1.f}, (vec3){1.f, 1.f, 1.f});
+            for(u32 c = 0; c < BENCH_NODE_CHILDREN && scene.count < BENCH_NODES; c++) {
+                u32 child = transform_add(&scene, root, (vec3){0.f, _random_float(), 0.f},
+                        (quat){0.f, 0.f, 0.f, 1.f}, (vec3){1.f, 1.f, 1.f});
+                for(u32 l = 0; l < BENCH_NODE_CHILDREN && scene.count < BENCH_NODES; l++) {
+                    transform_add(&scene, child, (vec3){0.f, 0.f, _random_float()},
+                            (quat){0.f, 0.f, 0.f, 1.f}, (vec3){1.f, 1.f, 1.f});
+                }
+            }
+        }
+        transform_update(&scene);
+
+        // cost should follow the dirty count, not the node count
+        const u32 percents[] = {1, 10, 100};
+        for(u32 p = 0; p < SIZEOF_ARRAY(percents); p++) {
+            u32 numDirty = BENCH_NODES / 100 * percents[p];
+            u64 updated = 0;
+            u64 ns = 0;
+            for(u32 f = 0; f < BENCH_FRAMES; f++) {
+                for(u32 i = 0; i < numDirty; i++) {
+                    u32 node = percents[p] == 100 ? i : (u32)rand() % BENCH_NODES;
+                    transform_set_rotation(&scene, node, quat_from_axis(world_up, _random_float()));
+                }
+                u64 start = timer_now_ns();
+                updated += transform_update(&scene);
+                ns += timer_now_ns() - start;
+            }
+            printf("transform update %3u%% dirty %10.3f ms/frame %8llu nodes/frame\n", percents[p],
+                    (double)ns / BENCH_FRAMES / 1e6, (unsigned long long)(updated / BENCH_FRAMES));
+        }
+        g_sink += transform_world(&scene, BENCH_NODES - 1)->mat[3][2];
+        transform_dispose(&scene);
+    }
+
+    printf("sink %f\n", g_sink);
+
+    free(lhv);
+    free(rhv);
+    free(res);
+    free(ref);
+    free(points);
+    free(transformed);
+    free(transformedRef);
+    return 0;
+}
@@ -0,0 +1,106 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// One big texture array shared by all materials, material id is the index to the array.
+// Descriptors are update after bind and partially bound so textures can be added
+// without touching sets that are in use and unused slots never need to be valid.
+// Unregistered slots point to a placeholder until they are given to the next texture.
+
+#ifndef BINDLESS_H
+#define BINDLESS_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+#include "texture.h"
+
+#define BINDLESS_MAX_TEXTURES 4096
+// binding of the texture array in the descriptor set
+#define BINDLESS_BINDING 1
+
+typedef struct BindlessTextures {
+    VkDescriptorImageInfo*  images;
+    u32                     count;
+    u32*                    freeSlots;  // unregistered slots below count
+    u32                     numFree;
+} BindlessTextures;
+
+static void
+bindless_init(BindlessTextures* table) {
+    table->images = (VkDescriptorImageInfo*)malloc(sizeof *table->images * BINDLESS_MAX_TEXTURES);
+    table->count = 0;
+    table->freeSlots = (u32*)malloc(sizeof *table->freeSlots * BINDLESS_MAX_TEXTURES);
+    table->numFree = 0;
+}
+
+static void
+bindless_dispose(BindlessTextures* table) {
+    free(table->images);
+    free(table->freeSlots);
+    table->count = 0;
+    table->numFree = 0;
+}
+
+// Returns the material id of the texture, written to sets with bindless_write
+static u32
+bindless_register(BindlessTextures* table, const Texture* tex) {
+
+    u32 index;
+    if(table->numFree) {
+        index = table->freeSlots[--table->numFree];
+    } else {
+        ASSERT_MESSAGE(table->count < BINDLESS_MAX_TEXTURES, "Too many bindless textures");
+        index = table->count++;
+    }
+    table->images[index] = (VkDescriptorImageInfo){
+        .sampler = tex->sampler,
+        .imageView = tex->view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+    return index;
+}
+
+// Point existing material id to another texture, sets see it after next bindless_write
+static void
+bindless_set(BindlessTextures* table, u32 index, const Texture* tex) {
+
+    ASSERT_MESSAGE(index < table->count, "Bindless texture index out of range");
+    table->images[index] = (VkDescriptorImageInfo){
+        .sampler = tex->sampler,
+        .imageView = tex->view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+}
+
+// Slot can be given to another texture, it samples the placeholder until then so sets
+// never hold a destroyed view. Sets see it after next bindless_write
+static void
+bindless_unregister(BindlessTextures* table, u32 index, const Texture* placeholder) {
+
+    bindless_set(table, index, placeholder);
+    ASSERT_MESSAGE(table->numFree < BINDLESS_MAX_TEXTURES, "Bindless slot unregistered twice");
+    table->freeSlots[table->numFree++] = index;
+}
+
+// Write textures [first, count) to every set, rest of the array is left unbound
+static void
+bindless_write(const BindlessTextures* table, const VkDescriptorSet* sets, u32 numSets,
+        u32 first, VkDevice device) {
+
+    if(first >= table->count) return;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.dstBinding = BINDLESS_BINDING;
+    write.dstArrayElement = first;
+    write.descriptorCount = table->count - first;
+    write.pImageInfo = &table->images[first];
+
+    for(u32 i = 0; i < numSets; i++) {
+        write.dstSet = sets[i];
+        vkUpdateDescriptorSets(device, 1, &write, 0 /*copy count*/, NULL /*copies*/);
+    }
+}
+
+#endif /* BINDLESS_H */
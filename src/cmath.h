@@ -8,9 +8,32 @@
 #include <math.h>
 #include <stdlib.h>
 #include <inttypes.h>
-#include <immintrin.h>
 #include "utils.h"
 
+// Vector kernels are picked at compile time, define CMATH_NO_SIMD to force scalar code
+#if !defined(CMATH_NO_SIMD)
+#if defined(__AVX__)
+#define CMATH_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CMATH_SSE
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CMATH_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(CMATH_AVX)
+#define CMATH_SIMD_NAME "avx"
+#elif defined(CMATH_SSE)
+#define CMATH_SIMD_NAME "sse"
+#elif defined(CMATH_NEON)
+#define CMATH_SIMD_NAME "neon"
+#else
+#define CMATH_SIMD_NAME "scalar"
+#endif
+
 static const float pi = 3.141592653f;
 static const float deg2rad = pi / 180.f;
 static const float rad2deg = 180.f / pi;
@@ -271,7 +294,7 @@ mat4_from_quat(mat4* res,const quat q) {
 }
 
 static inline vec4
-mat4_mult_vec4(const mat4* lhv,const vec4 rhv) {
+mat4_mult_vec4_scalar(const mat4* lhv,const vec4 rhv) {
     return (vec4) {
         .x = lhv->mat[0][0] * rhv.x + lhv->mat[1][0] * rhv.y + lhv->mat[2][0] * rhv.z + lhv->mat[3][0] * rhv.w,
             .y = lhv->mat[0][1] * rhv.x + lhv->mat[1][1] * rhv.y + lhv->mat[2][1] * rhv.z + lhv->mat[3][1] * rhv.w,
@@ -281,7 +304,7 @@ mat4_mult_vec4(const mat4* lhv,const vec4 rhv) {
 }
 
 static inline void
-mat4_mult_mat4 (mat4* restrict res,const mat4* restrict lhv,const mat4* restrict rhv) {
+mat4_mult_mat4_scalar(mat4* restrict res,const mat4* restrict lhv,const mat4* restrict rhv) {
     for (int y = 0; y < 4; y++) {
         for (int x = 0; x < 4; x++) {
             res->mat[x][y] = 0;
@@ -292,17 +315,152 @@ mat4_mult_mat4 (mat4* restrict res,const mat4* restrict lhv,const mat4* restrict
     }
 }
 
+// Scalar on purpose, the sse version loses to this once the compiler inlines it
+// and keeps the matrix in registers, see the point transform in benchmark.c
+static inline vec4
+mat4_mult_vec4(const mat4* lhv,const vec4 rhv) {
+    return mat4_mult_vec4_scalar(lhv, rhv);
+}
+
+static inline void
+mat4_mult_mat4 (mat4* restrict res,const mat4* restrict lhv,const mat4* restrict rhv) {
+#if defined(CMATH_AVX)
+    // two result columns per register, lanes do not mix so shuffles broadcast inside each half
+    __m256 l0 = _mm256_broadcast_ps((const __m128*)lhv->mat[0]);
+    __m256 l1 = _mm256_broadcast_ps((const __m128*)lhv->mat[1]);
+    __m256 l2 = _mm256_broadcast_ps((const __m128*)lhv->mat[2]);
+    __m256 l3 = _mm256_broadcast_ps((const __m128*)lhv->mat[3]);
+    for (int x = 0; x < 4; x += 2) {
+        __m256 r = _mm256_loadu_ps(rhv->mat[x]);
+        __m256 col = _mm256_mul_ps(l0, _mm256_shuffle_ps(r, r, 0x00));
+        col = _mm256_add_ps(col, _mm256_mul_ps(l1, _mm256_shuffle_ps(r, r, 0x55)));
+        col = _mm256_add_ps(col, _mm256_mul_ps(l2, _mm256_shuffle_ps(r, r, 0xAA)));
+        col = _mm256_add_ps(col, _mm256_mul_ps(l3, _mm256_shuffle_ps(r, r, 0xFF)));
+        _mm256_storeu_ps(res->mat[x], col);
+    }
+#elif defined(CMATH_SSE)
+    __m128 l0 = _mm_loadu_ps(lhv->mat[0]);
+    __m128 l1 = _mm_loadu_ps(lhv->mat[1]);
+    __m128 l2 = _mm_loadu_ps(lhv->mat[2]);
+    __m128 l3 = _mm_loadu_ps(lhv->mat[3]);
+    for (int x = 0; x < 4; x++) {
+        __m128 col = _mm_mul_ps(l0, _mm_set1_ps(rhv->mat[x][0]));
+        col = _mm_add_ps(col, _mm_mul_ps(l1, _mm_set1_ps(rhv->mat[x][1])));
+        col = _mm_add_ps(col, _mm_mul_ps(l2, _mm_set1_ps(rhv->mat[x][2])));
+        col = _mm_add_ps(col, _mm_mul_ps(l3, _mm_set1_ps(rhv->mat[x][3])));
+        _mm_storeu_ps(res->mat[x], col);
+    }
+#elif defined(CMATH_NEON)
+    float32x4_t l0 = vld1q_f32(lhv->mat[0]);
+    float32x4_t l1 = vld1q_f32(lhv->mat[1]);
+    float32x4_t l2 = vld1q_f32(lhv->mat[2]);
+    float32x4_t l3 = vld1q_f32(lhv->mat[3]);
+    for (int x = 0; x < 4; x++) {
+        float32x4_t col = vmulq_n_f32(l0, rhv->mat[x][0]);
+        col = vmlaq_n_f32(col, l1, rhv->mat[x][1]);
+        col = vmlaq_n_f32(col, l2, rhv->mat[x][2]);
+        col = vmlaq_n_f32(col, l3, rhv->mat[x][3]);
+        vst1q_f32(res->mat[x], col);
+    }
+#else
+    mat4_mult_mat4_scalar(res, lhv, rhv);
+#endif
+}
+
 static inline void
 mat4_mult_mat4_inside(mat4* restrict lhv,const mat4* restrict rhv) {
     mat4 temp = *lhv;
-    for (int y = 0; y < 4; y++) {
-        for (int x = 0; x < 4; x++) {
-            lhv->mat[x][y] = 0;
-            for (int n = 0; n < 4; n++) {
-                lhv->mat[x][y] += temp.mat[n][y] * rhv->mat[x][n];
-            }
+    mat4_mult_mat4(lhv, &temp, rhv);
+}
+
+// Batched versions, one call for whole arrays so loops stay in registers
+
+// res[i] = lhv * rhv[i], e.g. view projection with every model matrix
+static void
+mat4_mult_mat4_batch(mat4* restrict res, const mat4* restrict lhv, const mat4* restrict rhv, u32 count) {
+#if defined(CMATH_AVX)
+    __m256 l0 = _mm256_broadcast_ps((const __m128*)lhv->mat[0]);
+    __m256 l1 = _mm256_broadcast_ps((const __m128*)lhv->mat[1]);
+    __m256 l2 = _mm256_broadcast_ps((const __m128*)lhv->mat[2]);
+    __m256 l3 = _mm256_broadcast_ps((const __m128*)lhv->mat[3]);
+    for (u32 i = 0; i < count; i++) {
+        for (int x = 0; x < 4; x += 2) {
+            __m256 r = _mm256_loadu_ps(rhv[i].mat[x]);
+            __m256 col = _mm256_mul_ps(l0, _mm256_shuffle_ps(r, r, 0x00));
+            col = _mm256_add_ps(col, _mm256_mul_ps(l1, _mm256_shuffle_ps(r, r, 0x55)));
+            col = _mm256_add_ps(col, _mm256_mul_ps(l2, _mm256_shuffle_ps(r, r, 0xAA)));
+            col = _mm256_add_ps(col, _mm256_mul_ps(l3, _mm256_shuffle_ps(r, r, 0xFF)));
+            _mm256_storeu_ps(res[i].mat[x], col);
         }
     }
+#else
+    for (u32 i = 0; i < count; i++) {
+        mat4_mult_mat4(&res[i], lhv, &rhv[i]);
+    }
+#endif
+}
+
+// Points (w = 1) in separate x, y, z arrays, outW may be NULL for affine matrixes
+// Every lane is its own point so there is nothing to shuffle, matrix elements are broadcast
+// once. Written out since -O2 only vectorizes loops with a known count and debug builds
+// not at all. Arrays do not need to be aligned
+static void
+mat4_transform_points_soa(const mat4* m, const float* restrict x, const float* restrict y,
+        const float* restrict z, float* restrict outX, float* restrict outY, float* restrict outZ,
+        float* restrict outW, u32 count) {
+
+    // copy so that stores to outputs can not alias the matrix
+    const mat4 t = *m;
+    u32 i = 0;
+#if defined(CMATH_AVX)
+#define _SOA_ROW(ROW) _mm256_add_ps(_mm256_add_ps(_mm256_add_ps( \
+        _mm256_mul_ps(_mm256_set1_ps(t.mat[0][ROW]), px), _mm256_mul_ps(_mm256_set1_ps(t.mat[1][ROW]), py)), \
+        _mm256_mul_ps(_mm256_set1_ps(t.mat[2][ROW]), pz)), _mm256_set1_ps(t.mat[3][ROW]))
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+        _mm256_storeu_ps(outX + i, _SOA_ROW(0));
+        _mm256_storeu_ps(outY + i, _SOA_ROW(1));
+        _mm256_storeu_ps(outZ + i, _SOA_ROW(2));
+        if (outW) _mm256_storeu_ps(outW + i, _SOA_ROW(3));
+    }
+#undef _SOA_ROW
+#elif defined(CMATH_SSE)
+#define _SOA_ROW(ROW) _mm_add_ps(_mm_add_ps(_mm_add_ps( \
+        _mm_mul_ps(_mm_set1_ps(t.mat[0][ROW]), px), _mm_mul_ps(_mm_set1_ps(t.mat[1][ROW]), py)), \
+        _mm_mul_ps(_mm_set1_ps(t.mat[2][ROW]), pz)), _mm_set1_ps(t.mat[3][ROW]))
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        _mm_storeu_ps(outX + i, _SOA_ROW(0));
+        _mm_storeu_ps(outY + i, _SOA_ROW(1));
+        _mm_storeu_ps(outZ + i, _SOA_ROW(2));
+        if (outW) _mm_storeu_ps(outW + i, _SOA_ROW(3));
+    }
+#undef _SOA_ROW
+#elif defined(CMATH_NEON)
+#define _SOA_ROW(ROW) vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(t.mat[3][ROW]), \
+        px, t.mat[0][ROW]), py, t.mat[1][ROW]), pz, t.mat[2][ROW])
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t px = vld1q_f32(x + i);
+        float32x4_t py = vld1q_f32(y + i);
+        float32x4_t pz = vld1q_f32(z + i);
+        vst1q_f32(outX + i, _SOA_ROW(0));
+        vst1q_f32(outY + i, _SOA_ROW(1));
+        vst1q_f32(outZ + i, _SOA_ROW(2));
+        if (outW) vst1q_f32(outW + i, _SOA_ROW(3));
+    }
+#undef _SOA_ROW
+#endif
+    for (; i < count; i++) {
+        float px = x[i], py = y[i], pz = z[i];
+        outX[i] = t.mat[0][0] * px + t.mat[1][0] * py + t.mat[2][0] * pz + t.mat[3][0];
+        outY[i] = t.mat[0][1] * px + t.mat[1][1] * py + t.mat[2][1] * pz + t.mat[3][1];
+        outZ[i] = t.mat[0][2] * px + t.mat[1][2] * py + t.mat[2][2] * pz + t.mat[3][2];
+        if (outW) outW[i] = t.mat[0][3] * px + t.mat[1][3] * py + t.mat[2][3] * pz + t.mat[3][3];
+    }
 }
 
 static inline void
@@ -480,7 +638,7 @@ create_lookat_mat4(mat4* Result, const vec3 eye, const vec3 target, const vec3 u
     mat4_mult_mat4_inside(Result,&trans);
 }
 
-static inline void inverse_mat4(mat4* res, mat4* m) {
+static inline void inverse_mat4_scalar(mat4* res, const mat4* m) {
     // assumes that matrix is invertable
     // implementation similar to linmath and glu
 
@@ -524,4 +682,79 @@ static inline void inverse_mat4(mat4* res, mat4* m) {
     res->mat[3][3] = (m->mat[2][0] * s[3] - m->mat[2][1] * s[1] + m->mat[2][2] * s[0]) * idet;
 }
 
+#if defined(CMATH_SSE)
+#define _CMATH_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE((w), (z), (y), (x)))
+#define _CMATH_SWIZZLE(v, x, y, z, w) _CMATH_SHUFFLE((v), (v), (x), (y), (z), (w))
+
+// 2x2 matrixes packed as (m00 m01 m10 m11)
+static inline __m128 _mat2_mul(__m128 l, __m128 r) {
+    return _mm_add_ps(_mm_mul_ps(l, _CMATH_SWIZZLE(r, 0, 3, 0, 3)),
+            _mm_mul_ps(_CMATH_SWIZZLE(l, 1, 0, 3, 2), _CMATH_SWIZZLE(r, 2, 1, 2, 1)));
+}
+// adjugate(l) * r
+static inline __m128 _mat2_adj_mul(__m128 l, __m128 r) {
+    return _mm_sub_ps(_mm_mul_ps(_CMATH_SWIZZLE(l, 3, 3, 0, 0), r),
+            _mm_mul_ps(_CMATH_SWIZZLE(l, 1, 1, 2, 2), _CMATH_SWIZZLE(r, 2, 3, 0, 1)));
+}
+// l * adjugate(r)
+static inline __m128 _mat2_mul_adj(__m128 l, __m128 r) {
+    return _mm_sub_ps(_mm_mul_ps(l, _CMATH_SWIZZLE(r, 3, 0, 3, 0)),
+            _mm_mul_ps(_CMATH_SWIZZLE(l, 1, 0, 3, 2), _CMATH_SWIZZLE(r, 2, 1, 2, 1)));
+}
+#endif
+
+static inline void inverse_mat4(mat4* res, const mat4* m) {
+    // assumes that matrix is invertable
+#if defined(CMATH_SSE)
+    // Block wise inverse over 2x2 sub matrixes, inverse of transpose is transpose of inverse
+    // so columns can be handled as rows
+    __m128 c0 = _mm_loadu_ps(m->mat[0]);
+    __m128 c1 = _mm_loadu_ps(m->mat[1]);
+    __m128 c2 = _mm_loadu_ps(m->mat[2]);
+    __m128 c3 = _mm_loadu_ps(m->mat[3]);
+
+    __m128 a = _mm_movelh_ps(c0, c1);
+    __m128 b = _mm_movehl_ps(c1, c0);
+    __m128 c = _mm_movelh_ps(c2, c3);
+    __m128 d = _mm_movehl_ps(c3, c2);
+
+    // determinants of a b c d
+    __m128 detSub = _mm_sub_ps(
+            _mm_mul_ps(_CMATH_SHUFFLE(c0, c2, 0, 2, 0, 2), _CMATH_SHUFFLE(c1, c3, 1, 3, 1, 3)),
+            _mm_mul_ps(_CMATH_SHUFFLE(c0, c2, 1, 3, 1, 3), _CMATH_SHUFFLE(c1, c3, 0, 2, 0, 2)));
+    __m128 detA = _CMATH_SWIZZLE(detSub, 0, 0, 0, 0);
+    __m128 detB = _CMATH_SWIZZLE(detSub, 1, 1, 1, 1);
+    __m128 detC = _CMATH_SWIZZLE(detSub, 2, 2, 2, 2);
+    __m128 detD = _CMATH_SWIZZLE(detSub, 3, 3, 3, 3);
+
+    __m128 dc = _mat2_adj_mul(d, c);
+    __m128 ab = _mat2_adj_mul(a, b);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), _mat2_mul(b, dc));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), _mat2_mul(c, ab));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), _mat2_mul_adj(d, ab));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), _mat2_mul_adj(a, dc));
+
+    // trace of ab * dc, summed to every lane
+    __m128 tr = _mm_mul_ps(ab, _CMATH_SWIZZLE(dc, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, _CMATH_SWIZZLE(tr, 2, 3, 0, 1));
+    tr = _mm_add_ps(tr, _CMATH_SWIZZLE(tr, 1, 0, 3, 2));
+
+    __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+    __m128 rdet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+
+    x = _mm_mul_ps(x, rdet);
+    y = _mm_mul_ps(y, rdet);
+    z = _mm_mul_ps(z, rdet);
+    w = _mm_mul_ps(w, rdet);
+
+    _mm_storeu_ps(res->mat[0], _CMATH_SHUFFLE(x, y, 3, 1, 3, 1));
+    _mm_storeu_ps(res->mat[1], _CMATH_SHUFFLE(x, y, 2, 0, 2, 0));
+    _mm_storeu_ps(res->mat[2], _CMATH_SHUFFLE(z, w, 3, 1, 3, 1));
+    _mm_storeu_ps(res->mat[3], _CMATH_SHUFFLE(z, w, 2, 0, 2, 0));
+#else
+    // neon has no cheap shuffles for this, scalar cofactors vectorize well enough
+    inverse_mat4_scalar(res, m);
+#endif
+}
+
 #endif /* CMATH_H */
@@ -12,6 +12,8 @@
 #include "frameBuffer.h"
 #include "vertex.h"
 #include "pipeline.h"
+#include "drawList.h"
+#include "profiler.h"
 
 typedef struct CommandBuffers {
     VkCommandBuffer*    buffers;
@@ -22,12 +24,14 @@ typedef struct CommandBuffers {
 static inline VkCommandPool
 commandpool_create(u32 graphicsFamily, const VkDevice device) {
 
+    PROFILE_FUNCTION();
     VkCommandPool ret = 0;
 
     VkCommandPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.queueFamilyIndex = graphicsFamily;
-    poolInfo.flags = 0; // Optional
+    // buffers of each swapchain image are rerecorded every frame
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     //VK_COMMAND_POOL_CREATE_TRANSIENT_BIT:
     //  Hint that command buffers are rerecorded with new commands very often
@@ -42,15 +46,12 @@ commandpool_create(u32 graphicsFamily, const VkDevice device) {
 }
 
 static void
-commandbuffers_init(CommandBuffers* buffer, const FrameBuffer* framebuffer,
-        const VkDevice device, const VkRenderPass renderpass, VkExtent2D swapExtent,
-        Pipeline* pipeline, VkCommandPool pool, VertexData* vertexData, VkDescriptorSet* descSets) {
+commandbuffers_init(CommandBuffers* buffer, u32 numBuffers, const VkDevice device, VkCommandPool pool) {
 
-    // Create pool where buffers will be created
-    //buffer->pool = _commandpool_create(physicalDevice, device);
+    PROFILE_FUNCTION();
     // Create buffer for each framebuffer
-    buffer->buffers = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * framebuffer->numBuffers);
-    buffer->numBuffers = framebuffer->numBuffers;
+    buffer->buffers = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * numBuffers);
+    buffer->numBuffers = numBuffers;
 
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -61,57 +62,58 @@ commandbuffers_init(CommandBuffers* buffer, const FrameBuffer* framebuffer,
     if (vkAllocateCommandBuffers(device, &allocInfo, buffer->buffers) != VK_SUCCESS) {
         ABORT("failed to allocate command buffers!");
     }
+}
 
-    // start recording command buffers
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+// Record the renderpass, whole drawlist is drawn from the indirect buffer of the image
+static void
+commandbuffer_record_scene(VkCommandBuffer cmd, u32 imageIndex, const FrameBuffer* framebuffer,
+        const VkRenderPass renderpass, VkExtent2D swapExtent, const Pipeline* pipeline,
+        const VertexData* vertexData, const VkDescriptorSet* descSets, const DrawList* drawList,
+        const PushConstants* push) {
+
+    // Begin renderpass
+    renderpass_start(renderpass, cmd, framebuffer->buffers[imageIndex], swapExtent);
+    // Bind graphics pipeline
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->graphicsPipeline);
+    vkCmdPushConstants(cmd, pipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+            0 /*offset*/, sizeof *push, push);
+
+    // mesh still loading, pass only clears
+    if(!vertexdata_ready(vertexData)) {
+        vkCmdEndRenderPass(cmd);
+        return;
+    }
 
-    for(u32 i = 0; i < buffer->numBuffers; i++) {
-        if (vkBeginCommandBuffer(buffer->buffers[i], &beginInfo) != VK_SUCCESS) {
-            ABORT("failed to begin recording command buffer!");
-        }
-        // Begin renderpass
-        renderpass_start(renderpass, buffer->buffers[i], framebuffer->buffers[i], swapExtent);
-        // Bind graphics pipeline
-        vkCmdBindPipeline(buffer->buffers[i],
-                VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->graphicsPipeline);
-
-        // Bind vertex buffer
-        VkBuffer vertBuffers[] = {vertexData->vertex.bufferId};
-        VkDeviceSize offsets[] = {0}; // byte offset where start to read vertex data from
-
-        vkCmdBindVertexBuffers(buffer->buffers[i],
-                0, // firstbinding
-                1, // bindingcount
-                vertBuffers, offsets);
-
-        vkCmdBindIndexBuffer(buffer->buffers[i], vertexData->index.bufferId,
-                0,
-                VK_INDEX_TYPE_UINT32);
-
-
-        //vkCmdDraw(buffer->buffers[i], SIZEOF_ARRAY(Triangle), 1, 0, 0); no indexes
-
-        // Bind descriptors
-        vkCmdBindDescriptorSets( buffer->buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                pipeline->pipelineLayout,
-                0 /*first set*/,
-                1/*desc count*/,
-                &descSets[i],
-                0/*dynamic offset*/,
-                NULL /*dynamic offsets*/);
-
-        vkCmdDrawIndexed(buffer->buffers[i], vertexData->numIndexes,
-                1,  // instance count
-                0, // first index
-                0, // vertexoffset
-                0); // first instance
-        vkCmdEndRenderPass(buffer->buffers[i]);
-
-        if (vkEndCommandBuffer(buffer->buffers[i]) != VK_SUCCESS) {
-            ABORT("failed to record command buffer!");
-        }
+    // Bind vertex buffer
+    VkBuffer vertBuffers[] = {vertexData->vertex.bufferId};
+    VkDeviceSize offsets[] = {0}; // byte offset where start to read vertex data from
+
+    vkCmdBindVertexBuffers(cmd,
+            0, // firstbinding
+            1, // bindingcount
+            vertBuffers, offsets);
+
+    vkCmdBindIndexBuffer(cmd, vertexData->index.bufferId,
+            0,
+            VK_INDEX_TYPE_UINT32);
+
+    // Bind descriptors
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipeline->pipelineLayout,
+            0 /*first set*/,
+            1/*desc count*/,
+            &descSets[imageIndex],
+            0/*dynamic offset*/,
+            NULL /*dynamic offsets*/);
+
+    // one command per object of this frame, culled ones have zero instances
+    if(drawList->header.numObjects) {
+        vkCmdDrawIndexedIndirect(cmd, drawList->indirectBuffers[imageIndex].bufferId,
+                0, // offset
+                drawList->header.numObjects, // draw count
+                sizeof(VkDrawIndexedIndirectCommand)); // stride
     }
+    vkCmdEndRenderPass(cmd);
 }
 
 static void
@@ -0,0 +1,194 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// DDS container with block compressed mip chain, made with texconvert or any tool writing
+// DX10 headers. Only 2D textures with one layer are supported.
+
+#ifndef DDS_H
+#define DDS_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_MAX_MIPS 16
+
+#define DDS_FOURCC(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+// header flags
+#define DDSD_CAPS           0x1
+#define DDSD_HEIGHT         0x2
+#define DDSD_WIDTH          0x4
+#define DDSD_PIXELFORMAT    0x1000
+#define DDSD_MIPMAPCOUNT    0x20000
+#define DDSD_LINEARSIZE     0x80000
+#define DDPF_FOURCC         0x4
+#define DDSCAPS_COMPLEX     0x8
+#define DDSCAPS_TEXTURE     0x1000
+#define DDSCAPS_MIPMAP      0x400000
+
+// dxgi formats we know
+#define DXGI_FORMAT_BC1_UNORM       71
+#define DXGI_FORMAT_BC1_UNORM_SRGB  72
+#define DXGI_FORMAT_BC3_UNORM       77
+#define DXGI_FORMAT_BC3_UNORM_SRGB  78
+#define DXGI_FORMAT_BC7_UNORM       98
+#define DXGI_FORMAT_BC7_UNORM_SRGB  99
+#define DDS_DIMENSION_TEXTURE2D     3
+
+typedef struct DdsPixelFormat {
+    u32     size;
+    u32     flags;
+    u32     fourCC;
+    u32     rgbBitCount;
+    u32     rMask, gMask, bMask, aMask;
+} DdsPixelFormat;
+
+typedef struct DdsHeader {
+    u32             size;
+    u32             flags;
+    u32             height;
+    u32             width;
+    u32             pitchOrLinearSize;
+    u32             depth;
+    u32             mipMapCount;
+    u32             reserved1[11];
+    DdsPixelFormat  pixelFormat;
+    u32             caps, caps2, caps3, caps4;
+    u32             reserved2;
+} DdsHeader;
+
+typedef struct DdsHeaderDx10 {
+    u32     dxgiFormat;
+    u32     resourceDimension;
+    u32     miscFlag;
+    u32     arraySize;
+    u32     miscFlags2;
+} DdsHeaderDx10;
+
+// Points inside the file data, file has to outlive this
+typedef struct DdsImage {
+    VkFormat    format;
+    const char* formatName;
+    u32         width, height;
+    u32         mipLevels;
+    u32         blockBytes;     // bytes of one 4x4 block
+    const u8*   data;
+    size_t      mipOffsets[DDS_MAX_MIPS];
+    size_t      mipSizes[DDS_MAX_MIPS];
+    size_t      dataSize;
+} DdsImage;
+
+static inline size_t
+dds_mip_size(u32 blockBytes, u32 width, u32 height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+static u8
+_dds_dxgi_format(u32 dxgi, DdsImage* image) {
+    switch(dxgi) {
+        case DXGI_FORMAT_BC1_UNORM:
+            image->format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK; image->blockBytes = 8; image->formatName = "BC1";
+            return 1;
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+            image->format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK; image->blockBytes = 8; image->formatName = "BC1";
+            return 1;
+        case DXGI_FORMAT_BC3_UNORM:
+            image->format = VK_FORMAT_BC3_UNORM_BLOCK; image->blockBytes = 16; image->formatName = "BC3";
+            return 1;
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+            image->format = VK_FORMAT_BC3_SRGB_BLOCK; image->blockBytes = 16; image->formatName = "BC3";
+            return 1;
+        case DXGI_FORMAT_BC7_UNORM:
+            image->format = VK_FORMAT_BC7_UNORM_BLOCK; image->blockBytes = 16; image->formatName = "BC7";
+            return 1;
+        case DXGI_FORMAT_BC7_UNORM_SRGB:
+            image->format = VK_FORMAT_BC7_SRGB_BLOCK; image->blockBytes = 16; image->formatName = "BC7";
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Fills image from file in memory, returns 0 if file is not a dds we can upload as is
+static u8
+dds_parse(const u8* file, size_t fileSize, DdsImage* image) {
+
+    memset(image, 0, sizeof *image);
+    if(fileSize < 4 + sizeof(DdsHeader)) return 0;
+
+    u32 magic;
+    memcpy(&magic, file, sizeof magic);
+    if(magic != DDS_MAGIC) return 0;
+
+    DdsHeader header;
+    memcpy(&header, file + 4, sizeof header);
+    if(header.size != sizeof header || !(header.pixelFormat.flags & DDPF_FOURCC)) return 0;
+
+    size_t offset = 4 + sizeof header;
+    u32 fourCC = header.pixelFormat.fourCC;
+    if(fourCC == DDS_FOURCC('D', 'X', '1', '0')) {
+        if(fileSize < offset + sizeof(DdsHeaderDx10)) return 0;
+        DdsHeaderDx10 dx10;
+        memcpy(&dx10, file + offset, sizeof dx10);
+        offset += sizeof dx10;
+        if(dx10.resourceDimension != DDS_DIMENSION_TEXTURE2D || dx10.arraySize > 1) return 0;
+        if(!_dds_dxgi_format(dx10.dxgiFormat, image)) return 0;
+    } else if(fourCC == DDS_FOURCC('D', 'X', 'T', '1')) {
+        // legacy headers do not tell colorspace, all our textures are colors
+        _dds_dxgi_format(DXGI_FORMAT_BC1_UNORM_SRGB, image);
+    } else if(fourCC == DDS_FOURCC('D', 'X', 'T', '5')) {
+        _dds_dxgi_format(DXGI_FORMAT_BC3_UNORM_SRGB, image);
+    } else {
+        return 0;
+    }
+
+    image->width = header.width;
+    image->height = header.height;
+    image->mipLevels = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount ? header.mipMapCount : 1;
+    if(image->mipLevels > DDS_MAX_MIPS || !image->width || !image->height) return 0;
+
+    image->data = file + offset;
+    u32 width = image->width, height = image->height;
+    size_t size = 0;
+    for(u32 i = 0; i < image->mipLevels; i++) {
+        image->mipOffsets[i] = size;
+        image->mipSizes[i] = dds_mip_size(image->blockBytes, width, height);
+        size += image->mipSizes[i];
+        if(width > 1) width /= 2;
+        if(height > 1) height /= 2;
+    }
+    image->dataSize = size;
+    // truncated file
+    return offset + size <= fileSize;
+}
+
+// Header of a 2D block compressed texture, mip data follows largest first
+static void
+dds_write_header(FILE* fp, u32 dxgiFormat, u32 blockBytes, u32 width, u32 height, u32 mipLevels) {
+
+    DdsHeader header = {};
+    header.size = sizeof header;
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = height;
+    header.width = width;
+    header.pitchOrLinearSize = (u32)dds_mip_size(blockBytes, width, height);
+    header.mipMapCount = mipLevels;
+    header.pixelFormat.size = sizeof header.pixelFormat;
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = DDS_FOURCC('D', 'X', '1', '0');
+    header.caps = DDSCAPS_TEXTURE | (mipLevels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    DdsHeaderDx10 dx10 = {};
+    dx10.dxgiFormat = dxgiFormat;
+    dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+    dx10.arraySize = 1;
+
+    u32 magic = DDS_MAGIC;
+    fwrite(&magic, sizeof magic, 1, fp);
+    fwrite(&header, sizeof header, 1, fp);
+    fwrite(&dx10, sizeof dx10, 1, fp);
+}
+
+#endif /* DDS_H */
@@ -4,6 +4,10 @@
 
 #ifndef UTILSDEFS
 #define UTILSDEFS
+// 64 bit file offsets on 32 bit systems too, has to come before any system header
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
 #include <inttypes.h>
 #include <memory.h>
 #include <stdlib.h>
@@ -56,6 +60,13 @@ static const u64 numeric_max_u64 = 0xFFFFFFFFFFFFFFFF;
 #define VK_USE_PLATFORM_WIN32_KHR
 #endif // WINDOWS_PLATWORM
 
+// _Thread_local is C11, build is C99
+#if defined(WINDOWS_PLATFORM)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 const u32 MAX_FRAMES_IN_FLIGHT = 2;
 
 #endif // UTILSDEFS
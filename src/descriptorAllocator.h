@@ -0,0 +1,259 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Descriptor sets from a growing list of pools.
+// Persistent sets are cached by layout and the resources written to them, so asking for the same
+// set again (like after resize) does not call the driver at all. Handles of destroyed
+// resources can be given to new ones, so the cache is flushed when resources are recreated.
+// Transient sets come from per frame pools that are reset when the frame comes around again.
+
+#ifndef DESCRIPTORALLOCATOR_H
+#define DESCRIPTORALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+#include "hash_table.h"
+
+#define DESCRIPTOR_MAX_POOL_SIZES 8
+#define DESCRIPTOR_MAX_WRITES 8
+
+typedef struct DescriptorSetKeyData {
+    VkDescriptorSetLayout   layout;
+    u64                     resources;  // hash of the written buffers and images
+} DescriptorSetKeyData;
+
+DECLARE_HASHTABLEKEY(DescriptorSetKeyData, DescriptorSet);
+DECLARE_HASHTABLE(DescriptorSetKey, DescriptorSet, descriptorset);
+
+typedef struct DescriptorPools {
+    VkDescriptorPool*   pools;
+    u32                 numPools;
+    u32                 current;        // pool where next set is taken from
+    u32                 numAllocated;   // sets taken from current pool
+} DescriptorPools;
+
+typedef struct DescriptorAllocator {
+    VkDevice                    device;
+    // Descriptors of one set, pool holds setsPerPool times these
+    VkDescriptorPoolSize        sizes[DESCRIPTOR_MAX_POOL_SIZES];
+    u32                         numSizes;
+    u32                         setsPerPool;
+    VkDescriptorPoolCreateFlags flags;
+
+    DescriptorPools             persistent;
+    DescriptorPools*            frames;     // one per frame in flight
+    u32                         numFrames;
+    u32                         frame;
+
+    DescriptorSetHashTable      cache;
+    u32                         numDriverAllocations;
+} DescriptorAllocator;
+
+static void
+descriptorallocator_init(DescriptorAllocator* alloc, VkDevice device, const VkDescriptorPoolSize* sizes,
+        u32 numSizes, u32 setsPerPool, VkDescriptorPoolCreateFlags flags, u32 numFrames) {
+
+    ASSERT_MESSAGE(numSizes <= DESCRIPTOR_MAX_POOL_SIZES, "Too many descriptor types for allocator");
+    memset(alloc, 0, sizeof *alloc);
+    alloc->device = device;
+    memcpy(alloc->sizes, sizes, sizeof *sizes * numSizes);
+    alloc->numSizes = numSizes;
+    alloc->setsPerPool = setsPerPool;
+    alloc->flags = flags;
+    alloc->numFrames = numFrames;
+    alloc->frames = numFrames ? (DescriptorPools*)calloc(numFrames, sizeof *alloc->frames) : NULL;
+    descriptorset_hashtable_init(&alloc->cache, sizeof(VkDescriptorSet), 0);
+}
+
+static VkDescriptorPool
+_descriptorallocator_pool_create(const DescriptorAllocator* alloc) {
+
+    VkDescriptorPoolSize sizes[DESCRIPTOR_MAX_POOL_SIZES];
+    for(u32 i = 0; i < alloc->numSizes; i++) {
+        sizes[i].type = alloc->sizes[i].type;
+        sizes[i].descriptorCount = alloc->sizes[i].descriptorCount * alloc->setsPerPool;
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = alloc->flags;
+    poolInfo.poolSizeCount = alloc->numSizes;
+    poolInfo.pPoolSizes = sizes;
+    poolInfo.maxSets = alloc->setsPerPool;
+
+    VkDescriptorPool ret;
+    if(vkCreateDescriptorPool(alloc->device, &poolInfo, NULL /*allocator*/, &ret) != VK_SUCCESS) {
+        ABORT("Failed to create descriptor pool");
+    }
+    return ret;
+}
+
+static VkDescriptorSet
+_descriptorallocator_allocate(DescriptorAllocator* alloc, DescriptorPools* pools,
+        VkDescriptorSetLayout layout) {
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    // Current pool first, when it is full move to next one and create it if needed
+    for(;;) {
+        if(pools->current == pools->numPools) {
+            pools->pools = (VkDescriptorPool*)realloc(pools->pools, sizeof *pools->pools * (pools->numPools + 1));
+            pools->pools[pools->numPools++] = _descriptorallocator_pool_create(alloc);
+        }
+
+        allocInfo.descriptorPool = pools->pools[pools->current];
+        VkDescriptorSet ret;
+        VkResult res = vkAllocateDescriptorSets(alloc->device, &allocInfo, &ret);
+        alloc->numDriverAllocations++;
+        if(res == VK_SUCCESS) {
+            pools->numAllocated++;
+            return ret;
+        }
+        if(res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL) {
+            ABORT("Failed to allocate descriptor set");
+        }
+        // empty pool could not fit a single set, more pools would not help
+        if(!pools->numAllocated) {
+            ABORT("Descriptor set does not fit to an empty pool");
+        }
+        pools->current++;
+        pools->numAllocated = 0;
+    }
+}
+
+// Set that lives until allocator is disposed
+static VkDescriptorSet
+descriptorallocator_allocate(DescriptorAllocator* alloc, VkDescriptorSetLayout layout) {
+    return _descriptorallocator_allocate(alloc, &alloc->persistent, layout);
+}
+
+// Set that is valid until the same frame index begins again
+static VkDescriptorSet
+descriptorallocator_allocate_transient(DescriptorAllocator* alloc, VkDescriptorSetLayout layout) {
+    ASSERT_MESSAGE(alloc->numFrames, "Descriptor allocator has no frame pools");
+    return _descriptorallocator_allocate(alloc, &alloc->frames[alloc->frame], layout);
+}
+
+static void
+_descriptorpools_reset(DescriptorPools* pools, VkDevice device) {
+    // untouched pools need no reset
+    u32 numUsed = pools->numAllocated ? pools->current + 1 : pools->current;
+    for(u32 i = 0; i < numUsed; i++) {
+        vkResetDescriptorPool(device, pools->pools[i], 0 /*flags*/);
+    }
+    pools->current = 0;
+    pools->numAllocated = 0;
+}
+
+// Call when fence of the frame has been waited, transient sets of that frame are recycled
+static void
+descriptorallocator_begin_frame(DescriptorAllocator* alloc, u32 frame) {
+    ASSERT_MESSAGE(frame < alloc->numFrames, "Frame out of descriptor frame pools");
+    alloc->frame = frame;
+    _descriptorpools_reset(&alloc->frames[frame], alloc->device);
+}
+
+// Frees every persistent set and empties the cache, pools are kept for the sets allocated next.
+// Call when resources written to sets are destroyed, sets can not be in use
+static void
+descriptorallocator_flush(DescriptorAllocator* alloc) {
+
+    _descriptorpools_reset(&alloc->persistent, alloc->device);
+    descriptorset_hashtable_dispose(&alloc->cache);
+    descriptorset_hashtable_init(&alloc->cache, sizeof(VkDescriptorSet), 0);
+}
+
+static inline u64
+_descriptor_hash(u64 hash, const void* data, size_t size) {
+    // fnv-1a
+    const u8* bytes = (const u8*)data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Hash every field separately so that struct padding does not matter
+static u64
+_descriptor_hash_writes(const VkWriteDescriptorSet* writes, u32 numWrites) {
+
+    u64 hash = 0xCBF29CE484222325ULL;
+    for(u32 w = 0; w < numWrites; w++) {
+        const VkWriteDescriptorSet* write = &writes[w];
+        hash = _descriptor_hash(hash, &write->dstBinding, sizeof write->dstBinding);
+        hash = _descriptor_hash(hash, &write->dstArrayElement, sizeof write->dstArrayElement);
+        hash = _descriptor_hash(hash, &write->descriptorType, sizeof write->descriptorType);
+        hash = _descriptor_hash(hash, &write->descriptorCount, sizeof write->descriptorCount);
+        for(u32 i = 0; i < write->descriptorCount; i++) {
+            if(write->pBufferInfo) {
+                const VkDescriptorBufferInfo* info = &write->pBufferInfo[i];
+                hash = _descriptor_hash(hash, &info->buffer, sizeof info->buffer);
+                hash = _descriptor_hash(hash, &info->offset, sizeof info->offset);
+                hash = _descriptor_hash(hash, &info->range, sizeof info->range);
+            }
+            if(write->pImageInfo) {
+                const VkDescriptorImageInfo* info = &write->pImageInfo[i];
+                hash = _descriptor_hash(hash, &info->sampler, sizeof info->sampler);
+                hash = _descriptor_hash(hash, &info->imageView, sizeof info->imageView);
+                hash = _descriptor_hash(hash, &info->imageLayout, sizeof info->imageLayout);
+            }
+        }
+    }
+    return hash;
+}
+
+// Persistent set with these writes, created and written only when not in cache.
+// dstSet of writes is ignored, created is set when the set is new
+static VkDescriptorSet
+descriptorallocator_cached(DescriptorAllocator* alloc, VkDescriptorSetLayout layout,
+        const VkWriteDescriptorSet* writes, u32 numWrites, u8* created) {
+
+    ASSERT_MESSAGE(numWrites <= DESCRIPTOR_MAX_WRITES, "Too many descriptor writes");
+
+    DescriptorSetKeyData key;
+    memset(&key, 0, sizeof key);
+    key.layout = layout;
+    key.resources = _descriptor_hash_writes(writes, numWrites);
+
+    VkDescriptorSet* cached = (VkDescriptorSet*)descriptorset_hashtable_access(&alloc->cache, key);
+    if(created) *created = cached == NULL;
+    if(cached) return *cached;
+
+    VkDescriptorSet ret = descriptorallocator_allocate(alloc, layout);
+    VkWriteDescriptorSet local[DESCRIPTOR_MAX_WRITES];
+    for(u32 i = 0; i < numWrites; i++) {
+        local[i] = writes[i];
+        local[i].dstSet = ret;
+    }
+    vkUpdateDescriptorSets(alloc->device, numWrites, local, 0 /*copy count*/, NULL /*copies*/);
+    descriptorset_hashtable_insert(&alloc->cache, key, (u8*)&ret);
+    return ret;
+}
+
+static void
+_descriptorpools_dispose(DescriptorPools* pools, VkDevice device) {
+    for(u32 i = 0; i < pools->numPools; i++) {
+        vkDestroyDescriptorPool(device, pools->pools[i], NULL /*allocator*/);
+    }
+    free(pools->pools);
+    memset(pools, 0, sizeof *pools);
+}
+
+static void
+descriptorallocator_dispose(DescriptorAllocator* alloc) {
+
+    _descriptorpools_dispose(&alloc->persistent, alloc->device);
+    for(u32 i = 0; i < alloc->numFrames; i++) {
+        _descriptorpools_dispose(&alloc->frames[i], alloc->device);
+    }
+    if(alloc->frames) free(alloc->frames);
+    descriptorset_hashtable_dispose(&alloc->cache);
+    memset(alloc, 0, sizeof *alloc);
+}
+
+#endif /* DESCRIPTORALLOCATOR_H */
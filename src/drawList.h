@@ -0,0 +1,124 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+#include "cmath.h"
+#include "buffer.h"
+#include "profiler.h"
+
+// One drawable object, layout matches shaders/occlusion_cull.comp (std430)
+typedef struct DrawObject {
+    vec4    sphere;         // world space bounding sphere, radius in w
+    u32     indexCount;
+    u32     firstIndex;
+    i32     vertexOffset;
+    u32     materialId;     // index to the bindless texture array
+} DrawObject;
+
+// Start of the object buffer, objects follow right after
+typedef struct DrawListHeader {
+    mat4    viewProjection;
+    u32     numObjects;
+    u32     maxObjects;
+    u32     padding[2];
+} DrawListHeader;
+
+// Objects are written by cpu every frame and turned to indirect draw commands
+// either by the occlusion culling compute shader or directly by cpu
+typedef struct DrawList {
+    DrawListHeader  header;
+    DrawObject*     objects;
+    Buffer*         objectBuffers;      // one per swapchain image
+    Buffer*         indirectBuffers;    // one per swapchain image
+    u32             numBuffers;
+} DrawList;
+
+static void
+drawlist_init(DrawList* list, u32 maxObjects, u32 numImages, VkDevice device,
+        VkPhysicalDevice physicalDevice) {
+
+    PROFILE_FUNCTION();
+    list->header = (DrawListHeader){};
+    list->header.maxObjects = maxObjects;
+    list->objects = (DrawObject*)malloc(sizeof *list->objects * maxObjects);
+    list->numBuffers = numImages;
+    list->objectBuffers = (Buffer*)malloc(sizeof *list->objectBuffers * numImages);
+    list->indirectBuffers = (Buffer*)malloc(sizeof *list->indirectBuffers * numImages);
+
+    VkDeviceSize objectSize = sizeof(DrawListHeader) + sizeof(DrawObject) * maxObjects;
+    VkDeviceSize indirectSize = sizeof(VkDrawIndexedIndirectCommand) * maxObjects;
+
+    for(u32 i = 0; i < numImages; i++) {
+        list->objectBuffers[i] = buffer_create(physicalDevice, device, objectSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, // usage
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT); // properties
+
+        // Host visible so that cpu can fill commands when culling is disabled
+        list->indirectBuffers[i] = buffer_create(physicalDevice, device, indirectSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, // usage
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT); // properties
+    }
+}
+
+static inline void
+drawlist_clear(DrawList* list) {
+    list->header.numObjects = 0;
+}
+
+static inline u32
+drawlist_push(DrawList* list, const DrawObject* object) {
+    ASSERT_MESSAGE(list->header.numObjects < list->header.maxObjects, "Drawlist is full");
+    u32 index = list->header.numObjects++;
+    list->objects[index] = *object;
+    return index;
+}
+
+// Copy objects to gpu, if writeCommands is set also the indirect commands are written by cpu
+static void
+drawlist_upload(DrawList* list, u32 imageIndex, const mat4* viewProjection, u8 writeCommands, VkDevice device) {
+
+    PROFILE_FUNCTION();
+    list->header.viewProjection = *viewProjection;
+
+    Buffer* objectBuffer = &list->objectBuffers[imageIndex];
+    u8* data;
+    vkMapMemory(device, objectBuffer->bufferMemory, 0, objectBuffer->size, 0, (void**)&data);
+    memcpy(data, &list->header, sizeof list->header);
+    memcpy(data + sizeof list->header, list->objects, sizeof *list->objects * list->header.numObjects);
+    vkUnmapMemory(device, objectBuffer->bufferMemory);
+
+    if(!writeCommands) return;
+
+    Buffer* indirectBuffer = &list->indirectBuffers[imageIndex];
+    VkDrawIndexedIndirectCommand* commands;
+    vkMapMemory(device, indirectBuffer->bufferMemory, 0, indirectBuffer->size, 0, (void**)&commands);
+    // draw reads only the commands of this frame's objects
+    for(u32 i = 0; i < list->header.numObjects; i++) {
+        commands[i].indexCount = list->objects[i].indexCount;
+        commands[i].instanceCount = 1;
+        commands[i].firstIndex = list->objects[i].firstIndex;
+        commands[i].vertexOffset = list->objects[i].vertexOffset;
+        commands[i].firstInstance = list->objects[i].materialId;
+    }
+    vkUnmapMemory(device, indirectBuffer->bufferMemory);
+}
+
+static void
+drawlist_dispose(DrawList* list, VkDevice device) {
+
+    for(u32 i = 0; i < list->numBuffers; i++) {
+        buffer_dispose(&list->objectBuffers[i], device);
+        buffer_dispose(&list->indirectBuffers[i], device);
+    }
+    free(list->objectBuffers);
+    free(list->indirectBuffers);
+    free(list->objects);
+    memset(list, 0, sizeof *list);
+}
+
+#endif /* DRAWLIST_H */
@@ -2,24 +2,69 @@
  * Check license.txt in project root for license information *
  *********************************************************** */
 
+// Whole files for loaders. file_map gives a read only view that is mapped to memory
+// when the file is big enough for that to pay off and read to heap otherwise, so
+// loaders use the contents in place either way. Release it with file_unmap.
+
 #ifndef FILEUTILS_H
 #define FILEUTILS_H
 
 #include "utils.h"
 
+#if defined(WINDOWS_PLATFORM)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define FILE_MAP_MIN_SIZE (64 * 1024)   // page faults and unmapping cost more than reading small files
+
+#if defined(WINDOWS_PLATFORM)
+typedef __int64 FileOffset;
+#define file_seek _fseeki64
+#define file_tell _ftelli64
+#else
+typedef off_t FileOffset;
+#define file_seek fseeko
+#define file_tell ftello
+#endif
+
+typedef struct FileView {
+    u8*         data;
+    size_t      size;
+    u8          mapped;     // 0 when data is a heap copy
+} FileView;
 
 static void* _load_file(char* const path, char* const filetype, size_t* fileSize)
 {
     *fileSize = 0;
     FILE* fp = fopen(path,filetype);
     if(fp == NULL ) return NULL;
-    fseek(fp, 0, SEEK_END);
-    size_t len = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    void* ptrToMem = 0;
-    ptrToMem = malloc(len);
-    fread(ptrToMem,len,1,fp);
-    if(fileSize) *fileSize = len;
+    FileOffset len = -1;
+    if(file_seek(fp, 0, SEEK_END) == 0) len = file_tell(fp);
+    if(len < 0 || (u64)len > (u64)SIZE_MAX || file_seek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    u8* ptrToMem = (u8*)malloc(len ? (size_t)len : 1);
+    // text mode may give less than the size on disk
+    size_t read = 0;
+    while(ptrToMem && read < (size_t)len) {
+        size_t got = fread(ptrToMem + read, 1, (size_t)len - read, fp);
+        if(!got) break;
+        read += got;
+    }
+    u8 failed = !ptrToMem || ferror(fp);
+    fclose(fp);
+    if(failed) {
+        if(ptrToMem) free(ptrToMem);
+        return NULL;
+    }
+    *fileSize = read;
     return ptrToMem;
 }
 
@@ -33,4 +78,143 @@ static inline char* load_file(char* const path, size_t* fileSize)
     return _load_file(path,"r", fileSize);
 }
 
+#if defined(WINDOWS_PLATFORM)
+static u8
+_file_read_handle(HANDLE file, u64 offset, void* dst, size_t size) {
+    size_t done = 0;
+    while(done < size) {
+        OVERLAPPED at = {};
+        at.Offset = (DWORD)((offset + done) & 0xFFFFFFFF);
+        at.OffsetHigh = (DWORD)((offset + done) >> 32);
+        DWORD chunk = size - done > 0x40000000 ? 0x40000000 : (DWORD)(size - done);
+        DWORD got = 0;
+        if(!ReadFile(file, (u8*)dst + done, chunk, &got, &at) || !got) return 0;
+        done += got;
+    }
+    return 1;
+}
+
+static u8
+file_map(const char* path, FileView* view) {
+
+    memset(view, 0, sizeof *view);
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || (u64)size.QuadPart > (u64)SIZE_MAX) {
+        CloseHandle(file);
+        return 0;
+    }
+    view->size = (size_t)size.QuadPart;
+    if(view->size >= FILE_MAP_MIN_SIZE) {
+        // view keeps the mapping and file alive after handles are closed
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping) {
+            view->data = (u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        if(view->data) {
+            view->mapped = 1;
+            CloseHandle(file);
+            return 1;
+        }
+    }
+    view->data = (u8*)malloc(view->size ? view->size : 1);
+    u8 ok = view->data && _file_read_handle(file, 0, view->data, view->size);
+    CloseHandle(file);
+    if(!ok) {
+        if(view->data) free(view->data);
+        memset(view, 0, sizeof *view);
+    }
+    return ok;
+}
+
+static void
+file_unmap(FileView* view) {
+    if(view->mapped) {
+        UnmapViewOfFile(view->data);
+    } else if(view->data) {
+        free(view->data);
+    }
+    memset(view, 0, sizeof *view);
+}
+
+// Part of a file without reading the rest, offsets past 4 GB are fine
+static u8
+file_read_range(const char* path, u64 offset, size_t size, void* dst) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return 0;
+    u8 ok = _file_read_handle(file, offset, dst, size);
+    CloseHandle(file);
+    return ok;
+}
+#else
+static u8
+_file_read_fd(int fd, u64 offset, void* dst, size_t size) {
+    size_t done = 0;
+    while(done < size) {
+        ssize_t got = pread(fd, (u8*)dst + done, size - done, (off_t)(offset + done));
+        if(got < 0 && errno == EINTR) continue;
+        if(got <= 0) return 0;
+        done += (size_t)got;
+    }
+    return 1;
+}
+
+// Returns 0 if file could not be opened or read, view is then empty
+static u8
+file_map(const char* path, FileView* view) {
+
+    memset(view, 0, sizeof *view);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return 0;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (u64)info.st_size > (u64)SIZE_MAX) {
+        close(fd);
+        return 0;
+    }
+    view->size = (size_t)info.st_size;
+    if(view->size >= FILE_MAP_MIN_SIZE) {
+        // mapping keeps the file open
+        void* data = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED) {
+            view->data = (u8*)data;
+            view->mapped = 1;
+            close(fd);
+            return 1;
+        }
+    }
+    view->data = (u8*)malloc(view->size ? view->size : 1);
+    u8 ok = view->data && _file_read_fd(fd, 0, view->data, view->size);
+    close(fd);
+    if(!ok) {
+        if(view->data) free(view->data);
+        memset(view, 0, sizeof *view);
+    }
+    return ok;
+}
+
+static void
+file_unmap(FileView* view) {
+    if(view->mapped) {
+        munmap(view->data, view->size);
+    } else if(view->data) {
+        free(view->data);
+    }
+    memset(view, 0, sizeof *view);
+}
+
+// Part of a file without reading the rest, offsets past 4 GB are fine
+static u8
+file_read_range(const char* path, u64 offset, size_t size, void* dst) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return 0;
+    u8 ok = _file_read_fd(fd, offset, dst, size);
+    close(fd);
+    return ok;
+}
+#endif
+
 #endif /* FILEUTILS_H */
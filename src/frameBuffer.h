@@ -9,6 +9,7 @@
 #include "utils.h"
 #include "swapchain.h"
 #include "texture.h"
+#include "profiler.h"
 
 typedef struct FrameBuffer {
     VkFramebuffer*  buffers;
@@ -19,6 +20,7 @@ static void
 framebuffer_init(FrameBuffer* buffer, const VkDevice device,
         const SwapChain* swapChain, VkRenderPass renderPass, VkImageView depthView) {
 
+    PROFILE_FUNCTION();
     buffer->buffers = (VkFramebuffer*)malloc(sizeof *buffer->buffers * swapChain->numImages);
     buffer->numBuffers = swapChain->numImages;
 
@@ -0,0 +1,150 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Per frame cpu times over the last FRAMESTATS_WINDOW frames. Frame time is from start of
+// one frame to start of next, fence, acquire and present are time blocked in those calls
+// and work is the rest. framestats_report logs percentiles and hitches, frames taking
+// more than twice the median, and can write the frames as csv for plotting across builds.
+
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include "utils.h"
+#include "timer.h"
+
+#define FRAMESTATS_WINDOW (1 << 16)
+#define FRAMESTATS_HITCH_FACTOR 2
+
+typedef enum FrameStat {
+    FrameStatFrame = 0,
+    FrameStatWork,
+    FrameStatFence,
+    FrameStatAcquire,
+    FrameStatPresent,
+    FrameStatCount,
+} FrameStat;
+
+static const char* g_frameStatNames[FrameStatCount] = {"frame", "work", "fence", "acquire", "present"};
+
+typedef struct FrameRecord {
+    u64     ns[FrameStatCount];
+} FrameRecord;
+
+typedef struct FrameStats {
+    FrameRecord*    frames;     // ring of finished frames
+    u32             count;
+    u32             next;
+    u64             total;      // frames ever finished
+    FrameRecord     current;
+    u64             frameStart;
+    TimeWindow      recent;     // frame times for rolling logs
+} FrameStats;
+
+static FrameStats g_frameStats;
+
+static void
+framestats_init(FrameStats* stats) {
+    memset(stats, 0, sizeof *stats);
+    stats->frames = (FrameRecord*)malloc(sizeof *stats->frames * FRAMESTATS_WINDOW);
+}
+
+// Finishes the frame started by the last call
+static void
+framestats_begin_frame(FrameStats* stats) {
+
+    u64 now = timer_now_ns();
+    if(stats->frameStart) {
+        FrameRecord* frame = &stats->current;
+        frame->ns[FrameStatFrame] = now - stats->frameStart;
+        u64 blocked = frame->ns[FrameStatFence] + frame->ns[FrameStatAcquire] + frame->ns[FrameStatPresent];
+        frame->ns[FrameStatWork] = frame->ns[FrameStatFrame] > blocked ? frame->ns[FrameStatFrame] - blocked : 0;
+
+        stats->frames[stats->next] = *frame;
+        stats->next = (stats->next + 1) % FRAMESTATS_WINDOW;
+        if(stats->count < FRAMESTATS_WINDOW) stats->count++;
+        stats->total++;
+        timewindow_push(&stats->recent, frame->ns[FrameStatFrame]);
+    }
+    memset(&stats->current, 0, sizeof stats->current);
+    stats->frameStart = now;
+}
+
+// Blocked time of this frame, adds up when called many times
+static inline void
+framestats_add(FrameStats* stats, FrameStat stat, u64 ns) {
+    stats->current.ns[stat] += ns;
+}
+
+static int
+_framestats_compare(const void* a, const void* b) {
+    u64 lhs = *(const u64*)a, rhs = *(const u64*)b;
+    return lhs < rhs ? -1 : lhs > rhs;
+}
+
+// Nearest rank of sorted values
+static double
+_framestats_percentile(const u64* sorted, u32 count, u32 percent) {
+    u32 rank = (u32)(((u64)count * percent + 99) / 100);
+    return (double)sorted[rank ? rank - 1 : 0] / 1e6;
+}
+
+// Logs the window, csvPath can be NULL
+static u8
+framestats_report(const FrameStats* stats, const char* csvPath) {
+
+    if(!stats->count) return 1;
+    u64* sorted = (u64*)malloc(sizeof *sorted * stats->count);
+    LOG("Frame stats of last %u frames of %" PRIu64 ", ms p50/p95/p99/max:", stats->count, stats->total);
+    u32 hitches = 0;
+    double hitchMs = 0.0;
+    for(u32 stat = 0; stat < FrameStatCount; stat++) {
+        for(u32 i = 0; i < stats->count; i++) sorted[i] = stats->frames[i].ns[stat];
+        qsort(sorted, stats->count, sizeof *sorted, _framestats_compare);
+        LOG("    %-8s %.2f/%.2f/%.2f/%.2f", g_frameStatNames[stat],
+                _framestats_percentile(sorted, stats->count, 50), _framestats_percentile(sorted, stats->count, 95),
+                _framestats_percentile(sorted, stats->count, 99), (double)sorted[stats->count - 1] / 1e6);
+        if(stat == FrameStatFrame) {
+            u64 limit = sorted[(stats->count - 1) / 2] * FRAMESTATS_HITCH_FACTOR;
+            for(u32 i = 0; i < stats->count; i++) {
+                if(sorted[i] > limit) {
+                    hitches++;
+                    hitchMs += (double)sorted[i] / 1e6;
+                }
+            }
+        }
+    }
+    free(sorted);
+    LOG("%u hitches taking %.1f ms, %u per thousand frames", hitches, hitchMs,
+            (u32)((u64)hitches * 1000 / stats->count));
+    if(!csvPath) return 1;
+
+    FILE* fp = fopen(csvPath, "w");
+    if(!fp) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Could not write frame stats %s", csvPath);
+        return 0;
+    }
+    fprintf(fp, "index");
+    for(u32 stat = 0; stat < FrameStatCount; stat++) fprintf(fp, ",%s_ms", g_frameStatNames[stat]);
+    fprintf(fp, "\n");
+    // oldest first
+    u32 first = stats->count < FRAMESTATS_WINDOW ? 0 : stats->next;
+    for(u32 i = 0; i < stats->count; i++) {
+        const FrameRecord* frame = &stats->frames[(first + i) % FRAMESTATS_WINDOW];
+        fprintf(fp, "%" PRIu64, stats->total - stats->count + i);
+        for(u32 stat = 0; stat < FrameStatCount; stat++) fprintf(fp, ",%.4f", (double)frame->ns[stat] / 1e6);
+        fprintf(fp, "\n");
+    }
+    u8 ok = !ferror(fp);
+    fclose(fp);
+    LOG("Wrote frame stats to %s", csvPath);
+    return ok;
+}
+
+static void
+framestats_dispose(FrameStats* stats) {
+    free(stats->frames);
+    memset(stats, 0, sizeof *stats);
+}
+
+#endif /* FRAMESTATS_H */
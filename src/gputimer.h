@@ -0,0 +1,152 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Gpu time of passes from timestamp queries. Every swapchain image has its own queries,
+// they are read back when the image is recorded again. Its fence has been waited by then
+// so reading never stalls, times are a few frames old. Passes are timed in command buffer
+// order, frame time is from start of the first timed pass to end of the last one.
+
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+#include "timer.h"
+#include "physicalDevice.h"
+#include "profiler.h"
+
+typedef enum GpuPass {
+    GpuPassCull = 0,
+    GpuPassScene,
+    GpuPassPyramid,
+    GpuPassCount,
+} GpuPass;
+
+static const char* g_gpuPassNames[GpuPassCount] = {"cull", "scene", "pyramid"};
+
+#define GPU_TIMER_QUERIES (GpuPassCount * 2)   // per image, start and end of each pass
+
+typedef struct GpuTimers {
+    VkQueryPool pool;
+    u32         numImages;
+    u8*         recorded;       // queries of image have been reset and used
+    u8          supported;
+    double      period;         // ns per tick
+    u64         validMask;
+    TimeWindow  passes[GpuPassCount];
+    TimeWindow  frame;
+} GpuTimers;
+
+static void
+gputimer_init(GpuTimers* timers, u32 numImages, const PhysicalDevice* physicalDevice, VkDevice device) {
+
+    PROFILE_FUNCTION();
+    memset(timers, 0, sizeof *timers);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice->physicalDevice, &properties);
+
+    u32 numFamilies = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice->physicalDevice, &numFamilies, NULL);
+    VkQueueFamilyProperties* families = (VkQueueFamilyProperties*)malloc(sizeof *families * numFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice->physicalDevice, &numFamilies, families);
+    u32 validBits = families[physicalDevice->queues.graphicsFamily].timestampValidBits;
+    free(families);
+    if(!validBits || properties.limits.timestampPeriod <= 0.f) {
+        LOG("Graphics queue has no timestamps, gpu times are not measured");
+        return;
+    }
+    timers->validMask = validBits >= 64 ? numeric_max_u64 : (1ull << validBits) - 1;
+    timers->period = (double)properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = numImages * GPU_TIMER_QUERIES;
+    if(vkCreateQueryPool(device, &poolInfo, NULL, &timers->pool) != VK_SUCCESS) {
+        ABORT("failed to create timestamp query pool!");
+    }
+    timers->numImages = numImages;
+    timers->recorded = (u8*)calloc(numImages, sizeof *timers->recorded);
+    timers->supported = 1;
+}
+
+// Takes in what the last frame of this image measured and clears its queries for this frame.
+// Recorded before any pass, outside of render passes
+static void
+gputimer_begin_frame(GpuTimers* timers, VkCommandBuffer cmd, u32 imageIndex, VkDevice device) {
+
+    if(!timers->supported) return;
+    u32 base = imageIndex * GPU_TIMER_QUERIES;
+    if(timers->recorded[imageIndex]) {
+        // value and availability of each query, passes left out of a frame are unavailable
+        u64 results[GPU_TIMER_QUERIES][2];
+        VkResult res = vkGetQueryPoolResults(device, timers->pool, base, GPU_TIMER_QUERIES,
+                sizeof results, results, sizeof *results,
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if(res == VK_SUCCESS || res == VK_NOT_READY) {
+            u64 first = 0, last = 0;
+            u8 any = 0;
+            for(u32 pass = 0; pass < GpuPassCount; pass++) {
+                const u64* start = results[pass * 2];
+                const u64* end = results[pass * 2 + 1];
+                if(!start[1] || !end[1]) continue;
+                u64 ticks = (end[0] - start[0]) & timers->validMask;
+                timewindow_push(&timers->passes[pass], (u64)((double)ticks * timers->period));
+                if(!any) first = start[0];
+                last = end[0];
+                any = 1;
+            }
+            if(any) {
+                u64 ticks = (last - first) & timers->validMask;
+                timewindow_push(&timers->frame, (u64)((double)ticks * timers->period));
+            }
+        }
+    }
+    vkCmdResetQueryPool(cmd, timers->pool, base, GPU_TIMER_QUERIES);
+    timers->recorded[imageIndex] = 1;
+}
+
+static inline void
+gputimer_begin(const GpuTimers* timers, VkCommandBuffer cmd, u32 imageIndex, GpuPass pass) {
+    if(!timers->supported) return;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timers->pool,
+            imageIndex * GPU_TIMER_QUERIES + pass * 2);
+}
+
+static inline void
+gputimer_end(const GpuTimers* timers, VkCommandBuffer cmd, u32 imageIndex, GpuPass pass) {
+    if(!timers->supported) return;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timers->pool,
+            imageIndex * GPU_TIMER_QUERIES + pass * 2 + 1);
+}
+
+// One line of rolling min/avg/max, cpu frame times given by caller
+static void
+gputimer_log(const GpuTimers* timers, const TimeWindow* cpuFrames) {
+
+    char line[512];
+    double low, avg, high;
+    timewindow_stats(cpuFrames, &low, &avg, &high);
+    int len = snprintf(line, sizeof line, "Frame ms min/avg/max: cpu %.2f/%.2f/%.2f", low, avg, high);
+    if(timers->supported) {
+        timewindow_stats(&timers->frame, &low, &avg, &high);
+        len += snprintf(line + len, sizeof line - len, ", gpu %.2f/%.2f/%.2f", low, avg, high);
+        for(u32 pass = 0; pass < GpuPassCount; pass++) {
+            if(!timers->passes[pass].count) continue;
+            timewindow_stats(&timers->passes[pass], &low, &avg, &high);
+            len += snprintf(line + len, sizeof line - len, ", %s %.2f/%.2f/%.2f",
+                    g_gpuPassNames[pass], low, avg, high);
+        }
+    }
+    LOG("%s", line);
+}
+
+static void
+gputimer_dispose(GpuTimers* timers, VkDevice device) {
+    if(timers->pool) vkDestroyQueryPool(device, timers->pool, NULL);
+    if(timers->recorded) free(timers->recorded);
+    memset(timers, 0, sizeof *timers);
+}
+
+#endif /* GPUTIMER_H */
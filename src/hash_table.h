@@ -118,7 +118,7 @@ hashmap_find_primeindex(u32 mustSize) {
         u32 insertLocation = key->hash % table->size;\
         /* Search for available slot*/\
         while(table->keys[insertLocation].hash != 0) {\
-            insertLocation += 1;\
+            insertLocation = (insertLocation + 1) % table->size;\
         }\
         table->keys[insertLocation].key = key->key;\
         table->keys[insertLocation].hash = key->hash;\
@@ -161,7 +161,7 @@ hashmap_find_primeindex(u32 mustSize) {
         \
         KEYTYPE _key = {\
             .key = key,\
-            .hash = PREFUNC##_hashtable_hash((u8*)&key, table->sizeOfValue)\
+            .hash = PREFUNC##_hashtable_hash((u8*)&key, sizeof key)\
         };\
         \
         _##PREFUNC##_hashtable_insert(table,&_key,value );\
@@ -169,7 +169,7 @@ hashmap_find_primeindex(u32 mustSize) {
     \
     static void* PREFUNC##_hashtable_access(PRETYPE##HashTable* table, KEYTYPE##Type key) {\
         \
-        u32 hash = PREFUNC##_hashtable_hash((u8*)&key, table->sizeOfValue);\
+        u32 hash = PREFUNC##_hashtable_hash((u8*)&key, sizeof key);\
         u32 location = hash % table->size;\
         \
         while(table->keys[location].hash != 0) {\
@@ -0,0 +1,193 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Read throughput of asyncio.h against plain blocking reads, for many small files and a few
+// big ones, with page cache dropped before the run (cold) and after reading once (warm).
+// Build and run with iobench.sh, usage: iobench [directory for test files]
+// Dropping cache uses posix_fadvise, on tmpfs cold and warm are the same.
+
+#include "utils.h"
+#include "timer.h"
+#include "threadpool.h"
+#include "fileutils.h"
+#include "asyncio.h"
+
+#define SMALL_FILES 2048
+#define SMALL_SIZE (16 * 1024)
+#define BIG_FILES 16
+#define BIG_SIZE (4 * 1024 * 1024)
+#define NUM_FILES (SMALL_FILES + BIG_FILES)
+
+typedef struct BenchFile {
+    char    path[256];
+    size_t  size;
+    size_t  offset;     // in read buffer
+} BenchFile;
+
+static BenchFile g_files[NUM_FILES];
+static u8* g_buffer;
+static size_t g_total;
+static ThreadPool g_threadPool;
+static u32 g_failed;
+
+static u8
+_pattern(u32 file, size_t i) {
+    return (u8)(file * 31 + i * 7 + (i >> 12));
+}
+
+static u8
+_make_files(const char* dir) {
+
+    char cmd[300];
+    snprintf(cmd, sizeof cmd, "mkdir -p %s", dir);
+    if(system(cmd) != 0) return 0;
+    u8* data = (u8*)malloc(BIG_SIZE);
+    g_total = 0;
+    for(u32 i = 0; i < NUM_FILES; i++) {
+        BenchFile* file = &g_files[i];
+        file->size = i < SMALL_FILES ? SMALL_SIZE : BIG_SIZE;
+        file->offset = g_total;
+        g_total += file->size;
+        snprintf(file->path, sizeof file->path, "%s/%s%u.bin", dir, i < SMALL_FILES ? "small" : "big", i);
+        for(size_t j = 0; j < file->size; j++) data[j] = _pattern(i, j);
+        FILE* fp = fopen(file->path, "wb");
+        if(!fp || fwrite(data, file->size, 1, fp) != 1) {
+            LOG_ERR(CONSOLE_COLOR_RED, "Could not write %s", file->path);
+            if(fp) fclose(fp);
+            free(data);
+            return 0;
+        }
+        fclose(fp);
+    }
+    free(data);
+    g_buffer = (u8*)malloc(g_total);
+    return 1;
+}
+
+static void
+_drop_cache() {
+#if defined(LINUX_PLATFORM)
+    for(u32 i = 0; i < NUM_FILES; i++) {
+        int fd = open(g_files[i].path, O_RDONLY);
+        if(fd < 0) continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static u8
+_verify(u32 first, u32 count) {
+    for(u32 i = first; i < first + count; i++) {
+        const u8* data = g_buffer + g_files[i].offset;
+        for(size_t j = 0; j < g_files[i].size; j++) {
+            if(data[j] != _pattern(i, j)) return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+_read_done(void* user, u8* dst, size_t size, u8 ok) {
+    (void)user; (void)dst; (void)size;
+    if(!ok) g_failed++;
+}
+
+typedef enum BenchMode {
+    BenchBlocking,
+    BenchThreads,
+    BenchUring,
+} BenchMode;
+
+// Returns seconds for reading files [first, first + count)
+static double
+_run(BenchMode mode, u32 depth, u32 first, u32 count, u32* submits) {
+
+    memset(g_buffer, 0, g_total);
+    g_failed = 0;
+    *submits = 0;
+    u64 start = timer_now_ns();
+    if(mode == BenchBlocking) {
+        for(u32 i = first; i < first + count; i++) {
+            if(!file_read_range(g_files[i].path, 0, g_files[i].size, g_buffer + g_files[i].offset)) g_failed++;
+        }
+        *submits = count;
+    } else {
+        AsyncIO* io = &g_asyncIO;
+        asyncio_init(io, &g_threadPool, mode == BenchUring ? AsyncBackendAuto : AsyncBackendThreads);
+        if(mode == BenchUring && !io->uring) {
+            asyncio_dispose(io);
+            return -1.0;
+        }
+        if(depth && depth < io->depth) io->depth = depth;
+        for(u32 i = first; i < first + count; i++) {
+            while(!asyncio_read(io, g_files[i].path, 0, g_files[i].size, g_buffer + g_files[i].offset,
+                        _read_done, NULL)) {
+                asyncio_update(io);
+            }
+        }
+        asyncio_wait(io);
+        *submits = io->numSubmits;
+        asyncio_dispose(io);
+    }
+    double seconds = (double)(timer_now_ns() - start) / 1e9;
+    if(g_failed || !_verify(first, count)) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Read back wrong data, %u reads failed", g_failed);
+        g_failed = 1;
+    }
+    return seconds;
+}
+
+static void
+_report(const char* name, BenchMode mode, u32 depth, u32 first, u32 count, u8 cold, u32* failures) {
+
+    if(cold) {
+        _drop_cache();
+    } else {
+        u32 submits;
+        _run(BenchBlocking, 0, first, count, &submits);
+    }
+    u32 submits;
+    double seconds = _run(mode, depth, first, count, &submits);
+    if(seconds < 0.0) {
+        printf("%-22s %-5s no io_uring\n", name, cold ? "cold" : "warm");
+        return;
+    }
+    *failures += g_failed;
+    size_t bytes = 0;
+    for(u32 i = first; i < first + count; i++) bytes += g_files[i].size;
+    printf("%-22s %-5s %8.1f MB/s %9.0f files/s %6u submits\n", name, cold ? "cold" : "warm",
+            (double)bytes / (1024.0 * 1024.0) / seconds, count / seconds, submits);
+}
+
+int main(int argc, char** argv) {
+
+    const char* dir = argc > 1 ? argv[1] : "build/release/iofiles";
+    if(!_make_files(dir)) return 1;
+    threadpool_init(&g_threadPool, 0);
+    LOG("%u files of %u KB and %u of %u MB in %s, %u pool threads", SMALL_FILES, SMALL_SIZE / 1024,
+            BIG_FILES, BIG_SIZE / (1024 * 1024), dir, g_threadPool.numThreads);
+
+    u32 failures = 0;
+    const char* sets[] = {"small files", "big files"};
+    u32 firsts[] = {0, SMALL_FILES};
+    u32 counts[] = {SMALL_FILES, BIG_FILES};
+    for(u32 set = 0; set < 2; set++) {
+        printf("\n%s\n", sets[set]);
+        for(u32 pass = 0; pass < 2; pass++) {
+            u8 cold = pass == 0;
+            _report("blocking pread", BenchBlocking, 0, firsts[set], counts[set], cold, &failures);
+            _report("thread pool", BenchThreads, 0, firsts[set], counts[set], cold, &failures);
+            _report("io_uring depth 1", BenchUring, 1, firsts[set], counts[set], cold, &failures);
+            _report("io_uring depth 8", BenchUring, 8, firsts[set], counts[set], cold, &failures);
+            _report("io_uring depth 64", BenchUring, 64, firsts[set], counts[set], cold, &failures);
+        }
+    }
+
+    threadpool_dispose(&g_threadPool);
+    for(u32 i = 0; i < NUM_FILES; i++) remove(g_files[i].path);
+    free(g_buffer);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Checks that job dependencies hold and measures what spawning and stealing a job costs,
+// compared to the locked queue of the thread pool.
+// Build and run with jobbench.sh, usage: jobbench [workers]. Exits with 1 if a check fails
+
+#include "utils.h"
+#include "timer.h"
+#include "threadpool.h"
+#include "jobs.h"
+
+#define STAGE_JOBS 64
+#define ROUNDS 500
+#define SPAWN_JOBS 200000
+#define SPAWN_BATCH 256
+
+static u32 g_failures;
+
+static void
+_check(u8 ok, const char* what) {
+    if(!ok) {
+        __atomic_add_fetch(&g_failures, 1, __ATOMIC_RELAXED);
+        LOG_ERR(CONSOLE_COLOR_RED, "Check failed: %s", what);
+    }
+}
+
+// Three stages chained with jobs_run_after, every job checks the whole stage before it
+typedef struct Stages {
+    i32     a[STAGE_JOBS];
+    i32     b[STAGE_JOBS];
+    i32     c;
+    i32     round;
+} Stages;
+
+typedef struct StageJob {
+    Stages* stages;
+    u32     index;
+} StageJob;
+
+static void
+_stage_a(void* data) {
+    StageJob* job = (StageJob*)data;
+    __atomic_store_n(&job->stages->a[job->index], job->stages->round, __ATOMIC_RELAXED);
+}
+
+static void
+_stage_b(void* data) {
+    StageJob* job = (StageJob*)data;
+    Stages* stages = job->stages;
+    for(u32 i = 0; i < STAGE_JOBS; i++) {
+        _check(__atomic_load_n(&stages->a[i], __ATOMIC_RELAXED) == stages->round, "stage b ran before a");
+    }
+    __atomic_store_n(&stages->b[job->index], stages->round, __ATOMIC_RELAXED);
+}
+
+static void
+_stage_c(void* data) {
+    Stages* stages = ((StageJob*)data)->stages;
+    for(u32 i = 0; i < STAGE_JOBS; i++) {
+        _check(__atomic_load_n(&stages->b[i], __ATOMIC_RELAXED) == stages->round, "stage c ran before b");
+    }
+    __atomic_store_n(&stages->c, stages->round, __ATOMIC_RELAXED);
+}
+
+static void
+_test_stages(JobSystem* jobs) {
+
+    static Stages stages;
+    static StageJob data[STAGE_JOBS];
+    Job a[STAGE_JOBS], b[STAGE_JOBS], c;
+    for(u32 i = 0; i < STAGE_JOBS; i++) {
+        data[i] = (StageJob){.stages = &stages, .index = i};
+        a[i] = (Job){.func = _stage_a, .data = &data[i]};
+        b[i] = (Job){.func = _stage_b, .data = &data[i]};
+    }
+    c = (Job){.func = _stage_c, .data = &data[0]};
+
+    for(i32 round = 1; round <= ROUNDS; round++) {
+        stages.round = round;
+        JobCounter doneA = {}, doneB = {}, doneC = {};
+        // each stage raises its counter before the next one depends on it
+        jobs_run(jobs, a, STAGE_JOBS, &doneA);
+        jobs_run_after(jobs, &doneA, b, STAGE_JOBS, &doneB);
+        jobs_run_after(jobs, &doneB, &c, 1, &doneC);
+        jobs_wait(jobs, &doneC);
+        _check(stages.c == round, "waiting on last stage returned early");
+    }
+}
+
+// Jobs that spawn and wait for their own children
+typedef struct TreeJob {
+    u32     depth;
+    u64     sum;
+} TreeJob;
+
+static void
+_tree_job(void* data) {
+    TreeJob* node = (TreeJob*)data;
+    if(!node->depth) {
+        node->sum = 1;
+        return;
+    }
+    TreeJob children[4];
+    Job batch[4];
+    for(u32 i = 0; i < 4; i++) {
+        children[i] = (TreeJob){.depth = node->depth - 1};
+        batch[i] = (Job){.func = _tree_job, .data = &children[i]};
+    }
+    JobCounter counter = {};
+    jobs_run(&g_jobs, batch, 4, &counter);
+    jobs_wait(&g_jobs, &counter);
+    node->sum = 0;
+    for(u32 i = 0; i < 4; i++) node->sum += children[i].sum;
+}
+
+static void
+_sum_range(void* data, u32 first, u32 count) {
+    u64 sum = 0;
+    for(u32 i = first; i < first + count; i++) sum += i;
+    __atomic_add_fetch((u64*)data, sum, __ATOMIC_RELAXED);
+}
+
+static void
+_empty_job(void* data) {
+    (void)data;
+}
+
+// Few hundred nanoseconds of work so there is something worth stealing
+static void
+_small_job(void* data) {
+    volatile u32 x = 0;
+    for(u32 i = 0; i < 200; i++) x += i;
+    (void)data;
+}
+
+static double
+_bench_jobs(JobSystem* jobs, JobFunc func) {
+
+    Job batch[SPAWN_BATCH];
+    for(u32 i = 0; i < SPAWN_BATCH; i++) batch[i] = (Job){.func = func};
+    u64 start = timer_now_ns();
+    for(u32 done = 0; done < SPAWN_JOBS; done += SPAWN_BATCH) {
+        JobCounter counter = {};
+        jobs_run(jobs, batch, SPAWN_BATCH, &counter);
+        jobs_wait(jobs, &counter);
+    }
+    return (double)(timer_now_ns() - start) / SPAWN_JOBS;
+}
+
+static double
+_bench_threadpool(ThreadPool* pool, ThreadFunc func) {
+
+    u64 start = timer_now_ns();
+    for(u32 done = 0; done < SPAWN_JOBS; done += SPAWN_BATCH) {
+        for(u32 i = 0; i < SPAWN_BATCH; i++) threadpool_push(pool, func, NULL);
+        threadpool_wait(pool);
+    }
+    return (double)(timer_now_ns() - start) / SPAWN_JOBS;
+}
+
+int main(int argc, char** argv) {
+
+    u32 workers = argc > 1 ? (u32)atoi(argv[1]) : 0;
+    ThreadPool pool;
+    threadpool_init(&pool, workers);
+    jobs_init(&g_jobs, &pool);
+    LOG("Job system with %u pool workers and main thread", g_jobs.numDeques - 1);
+
+    _test_stages(&g_jobs);
+    TreeJob root = {.depth = 6};
+    _tree_job(&root);
+    _check(root.sum == 4096, "nested jobs lost children");
+    u64 sum = 0;
+    jobs_parallel_for(&g_jobs, 1000000, 1024, _sum_range, &sum);
+    _check(sum == 1000000ull * 999999ull / 2, "parallel for missed a range");
+    if(g_failures) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Dependency test failed %u times", g_failures);
+    } else {
+        LOG("Dependency test passed, %u chained rounds, 4096 nested jobs", ROUNDS);
+    }
+
+    for(u32 i = 0; i < g_jobs.numDeques; i++) g_jobs.deques[i].stolen = 0;
+    double jobEmpty = _bench_jobs(&g_jobs, _empty_job);
+    double jobSmall = _bench_jobs(&g_jobs, _small_job);
+    u32 stolen = 0;
+    for(u32 i = 0; i < g_jobs.numDeques; i++) stolen += g_jobs.deques[i].stolen;
+
+    // same workers, queue of the pool instead of deques
+    double poolEmpty = _bench_threadpool(&pool, _empty_job);
+    double poolSmall = _bench_threadpool(&pool, _small_job);
+    threadpool_dispose(&pool);
+    jobs_dispose(&g_jobs);
+
+    u64 start = timer_now_ns();
+    for(u32 i = 0; i < SPAWN_JOBS; i++) _small_job(NULL);
+    double serial = (double)(timer_now_ns() - start) / SPAWN_JOBS;
+
+    LOG("Empty job, spawn and wait: %.0f ns jobs, %.0f ns thread pool", jobEmpty, poolEmpty);
+    LOG("Small job: %.0f ns jobs, %.0f ns thread pool, %.0f ns serial, %u of %u stolen",
+            jobSmall, poolSmall, serial, stolen, SPAWN_JOBS * 2);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,379 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Work stealing jobs for small cpu tasks that are waited on within a frame, like culling.
+// Workers are the ones of threadpool.h, they run jobs whenever they are not busy with
+// coarse work. Every worker and the main thread own a deque, new jobs go to the bottom
+// of the own one and are taken back from there, idle threads steal from top of others.
+// Finished jobs count their counter down, waiting on a counter runs other jobs meanwhile
+// and jobs started with jobs_run_after are pushed only when their dependency reaches zero.
+// Coarse blocking work like file reading belongs to threadpool.h instead, but its jobs may
+// split their cpu heavy parts to jobs since pool workers own a deque while running them too.
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "utils.h"
+#include "thread.h"
+#include "threadpool.h"
+#include "profiler.h"
+
+#define JOBS_DEQUE_SIZE 4096        // power of two, jobs pushed to a full deque run right away
+#define JOBS_MAX_CONTINUATIONS 64
+
+typedef void (*JobFunc)(void* data);
+
+typedef struct JobCounter JobCounter;
+
+typedef struct Job {
+    JobFunc     func;
+    void*       data;
+    JobCounter* counter;        // counted down when job is done, can be NULL
+} Job;
+
+// Zero initialized counter is ready to use
+struct JobCounter {
+    i32     value;
+    i32     lock;                               // spinlock for continuations
+    Job     continuations[JOBS_MAX_CONTINUATIONS];  // pushed when value gets to zero
+    u32     numContinuations;
+};
+
+// Chase-Lev deque, owner works at bottom and thieves take from top.
+// Indexes on own cache lines so thieves do not slow down the owner
+typedef struct JobDeque {
+    i64     top;
+    u8      pad0[56];
+    i64     bottom;
+    u8      pad1[56];
+    Job     jobs[JOBS_DEQUE_SIZE];
+    u32     executed;
+    u32     stolen;
+    u32     seed;
+    u8      pad2[52];
+} JobDeque;
+
+typedef struct JobSystem {
+    JobDeque*           deques;     // main thread is 0, worker i of pool is i + 1
+    u32                 numDeques;
+    i32                 queued;     // jobs in any deque
+    ThreadPool*         pool;
+} JobSystem;
+
+static JobSystem g_jobs;
+static THREAD_LOCAL i32 t_jobWorker = -1;     // main thread, pool workers go by t_poolWorker
+
+// Deque of calling thread or -1 when it can not start or wait jobs
+static inline i32
+_jobs_worker(const JobSystem* jobs) {
+    if(jobs->pool && t_pool == jobs->pool) return (i32)t_poolWorker + 1;
+    return t_jobWorker;
+}
+
+// Calling thread can start and wait jobs, false also before jobs_init
+static inline u8
+jobs_in_worker(const JobSystem* jobs) {
+    return jobs->numDeques && _jobs_worker(jobs) >= 0;
+}
+
+// Slots are read racily by thieves, those reads are thrown away when the steal fails
+static inline void
+_jobs_store(Job* slot, const Job* job) {
+    __atomic_store_n(&slot->func, job->func, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->data, job->data, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->counter, job->counter, __ATOMIC_RELAXED);
+}
+
+static inline Job
+_jobs_load(Job* slot) {
+    Job ret;
+    ret.func = __atomic_load_n(&slot->func, __ATOMIC_RELAXED);
+    ret.data = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+    ret.counter = __atomic_load_n(&slot->counter, __ATOMIC_RELAXED);
+    return ret;
+}
+
+static u8
+_jobdeque_push(JobDeque* deque, const Job* job) {
+
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if(bottom - top >= JOBS_DEQUE_SIZE) return 0;
+    _jobs_store(&deque->jobs[bottom & (JOBS_DEQUE_SIZE - 1)], job);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static u8
+_jobdeque_pop(JobDeque* deque, Job* job) {
+
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if(top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    *job = _jobs_load(&deque->jobs[bottom & (JOBS_DEQUE_SIZE - 1)]);
+    if(top == bottom) {
+        // last one, race with thieves for it
+        u8 won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return won;
+    }
+    return 1;
+}
+
+static u8
+_jobdeque_steal(JobDeque* deque, Job* job) {
+
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if(top >= bottom) return 0;
+
+    *job = _jobs_load(&deque->jobs[top & (JOBS_DEQUE_SIZE - 1)]);
+    return __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static inline void
+_jobcounter_lock(JobCounter* counter) {
+    while(__atomic_exchange_n(&counter->lock, 1, __ATOMIC_ACQUIRE)) {
+        while(__atomic_load_n(&counter->lock, __ATOMIC_RELAXED));
+    }
+}
+
+static inline void
+_jobcounter_unlock(JobCounter* counter) {
+    __atomic_store_n(&counter->lock, 0, __ATOMIC_RELEASE);
+}
+
+static void _jobs_push(JobSystem* jobs, const Job* job);
+
+static void
+_jobs_execute(JobSystem* jobs, const Job* job) {
+
+    job->func(job->data);
+    JobCounter* counter = job->counter;
+    if(!counter) return;
+
+    // Waiter may free the counter as soon as it is done, so the last decrement happens
+    // under the lock and nothing touches the counter after unlocking
+    for(;;) {
+        i32 value = __atomic_load_n(&counter->value, __ATOMIC_ACQUIRE);
+        if(value > 1) {
+            if(__atomic_compare_exchange_n(&counter->value, &value, value - 1, 0,
+                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return;
+            continue;
+        }
+        Job continuations[JOBS_MAX_CONTINUATIONS];
+        _jobcounter_lock(counter);
+        u32 count = 0;
+        if(!__atomic_sub_fetch(&counter->value, 1, __ATOMIC_ACQ_REL)) {
+            count = counter->numContinuations;
+            memcpy(continuations, counter->continuations, sizeof *continuations * count);
+            counter->numContinuations = 0;
+        }
+        _jobcounter_unlock(counter);
+        for(u32 i = 0; i < count; i++) {
+            _jobs_push(jobs, &continuations[i]);
+        }
+        return;
+    }
+}
+
+// Own deque first, then others starting from a random one
+static u8
+_jobs_take(JobSystem* jobs, u32 worker, Job* job) {
+
+    JobDeque* own = &jobs->deques[worker];
+    if(_jobdeque_pop(own, job)) {
+        __atomic_sub_fetch(&jobs->queued, 1, __ATOMIC_SEQ_CST);
+        return 1;
+    }
+    own->seed = own->seed * 1664525u + 1013904223u;
+    u32 start = (own->seed >> 16) % jobs->numDeques;
+    for(u32 i = 0; i < jobs->numDeques; i++) {
+        u32 victim = (start + i) % jobs->numDeques;
+        if(victim == worker) continue;
+        if(_jobdeque_steal(&jobs->deques[victim], job)) {
+            __atomic_sub_fetch(&jobs->queued, 1, __ATOMIC_SEQ_CST);
+            own->stolen++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+_jobs_push(JobSystem* jobs, const Job* job) {
+
+    i32 worker = _jobs_worker(jobs);
+    ASSERT_MESSAGE(worker >= 0, "Jobs can only be started from main thread or pool workers");
+    if(!_jobdeque_push(&jobs->deques[worker], job)) {
+        // full, caller does it instead
+        jobs->deques[worker].executed++;
+        _jobs_execute(jobs, job);
+        return;
+    }
+    __atomic_add_fetch(&jobs->queued, 1, __ATOMIC_SEQ_CST);
+    threadpool_wake(jobs->pool);
+}
+
+// Helper of the pool, run by its workers when they have nothing else to do
+static u8
+_jobs_help(void* data, u32 worker) {
+
+    JobSystem* jobs = (JobSystem*)data;
+    u32 index = worker + 1;
+    Job job;
+    if(!_jobs_take(jobs, index, &job)) return 0;
+    jobs->deques[index].executed++;
+    _jobs_execute(jobs, &job);
+    return 1;
+}
+
+// Calling thread becomes worker 0, workers of pool take the rest of the deques
+static void
+jobs_init(JobSystem* jobs, ThreadPool* pool) {
+
+    memset(jobs, 0, sizeof *jobs);
+    jobs->pool = pool;
+    jobs->numDeques = pool->numThreads + 1;
+    jobs->deques = (JobDeque*)calloc(jobs->numDeques, sizeof *jobs->deques);
+    for(u32 i = 0; i < jobs->numDeques; i++) {
+        jobs->deques[i].seed = i * 7919u + 1u;
+    }
+    t_jobWorker = 0;
+
+    ThreadPoolHelper helper = {.run = _jobs_help, .data = jobs, .pending = &jobs->queued};
+    threadpool_set_helper(pool, &helper);
+}
+
+// Counter goes up by count now and down as jobs finish
+static void
+jobs_run(JobSystem* jobs, const Job* batch, u32 count, JobCounter* counter) {
+
+    if(counter) __atomic_add_fetch(&counter->value, (i32)count, __ATOMIC_ACQ_REL);
+    for(u32 i = 0; i < count; i++) {
+        Job job = batch[i];
+        job.counter = counter;
+        _jobs_push(jobs, &job);
+    }
+}
+
+// Jobs are started once dependency reaches zero, right away if it already has, so start
+// the jobs of dependency first.
+// Counter is raised now so waiting on it covers jobs that are not started yet
+static void
+jobs_run_after(JobSystem* jobs, JobCounter* dependency, const Job* batch, u32 count, JobCounter* counter) {
+
+    if(counter) __atomic_add_fetch(&counter->value, (i32)count, __ATOMIC_ACQ_REL);
+    u32 started = 0;
+    _jobcounter_lock(dependency);
+    if(__atomic_load_n(&dependency->value, __ATOMIC_ACQUIRE)) {
+        ASSERT_MESSAGE(dependency->numContinuations + count <= JOBS_MAX_CONTINUATIONS,
+                "Too many jobs waiting for one counter");
+        for(u32 i = 0; i < count; i++) {
+            Job* job = &dependency->continuations[dependency->numContinuations++];
+            *job = batch[i];
+            job->counter = counter;
+        }
+        started = count;
+    }
+    _jobcounter_unlock(dependency);
+
+    for(u32 i = started; i < count; i++) {
+        Job job = batch[i];
+        job.counter = counter;
+        _jobs_push(jobs, &job);
+    }
+}
+
+// Zero and not locked, last job to finish has let go of it
+static inline u8
+jobs_done(JobCounter* counter) {
+    return __atomic_load_n(&counter->value, __ATOMIC_ACQUIRE) == 0 &&
+        __atomic_load_n(&counter->lock, __ATOMIC_ACQUIRE) == 0;
+}
+
+// Runs jobs until counter is zero, so waiting from inside a job does not block a worker
+static void
+jobs_wait(JobSystem* jobs, JobCounter* counter) {
+
+    ASSERT_MESSAGE(_jobs_worker(jobs) >= 0, "Jobs can only be waited from main thread or pool workers");
+    u32 worker = (u32)_jobs_worker(jobs);
+    while(!jobs_done(counter)) {
+        Job job;
+        if(_jobs_take(jobs, worker, &job)) {
+            jobs->deques[worker].executed++;
+            _jobs_execute(jobs, &job);
+        }
+    }
+}
+
+typedef struct JobRange {
+    void        (*func)(void* data, u32 first, u32 count);
+    void*       data;
+    u32         first;
+    u32         count;
+} JobRange;
+
+static void
+_jobs_range(void* data) {
+    JobRange* range = (JobRange*)data;
+    range->func(range->data, range->first, range->count);
+}
+
+#define JOBS_MAX_RANGES 256
+
+// Split [0, count) to batches of at least minBatch and wait for them
+static void
+jobs_parallel_for(JobSystem* jobs, u32 count, u32 minBatch,
+        void (*func)(void* data, u32 first, u32 count), void* data) {
+
+    u32 numRanges = (count + minBatch - 1) / minBatch;
+    if(numRanges > jobs->numDeques * 4) numRanges = jobs->numDeques * 4;
+    if(numRanges > JOBS_MAX_RANGES) numRanges = JOBS_MAX_RANGES;
+    if(numRanges <= 1) {
+        if(count) func(data, 0, count);
+        return;
+    }
+
+    JobRange ranges[JOBS_MAX_RANGES];
+    Job batch[JOBS_MAX_RANGES];
+    u32 first = 0;
+    for(u32 i = 0; i < numRanges; i++) {
+        u32 end = (u32)((u64)count * (i + 1) / numRanges);
+        ranges[i] = (JobRange){.func = func, .data = data, .first = first, .count = end - first};
+        batch[i] = (Job){.func = _jobs_range, .data = &ranges[i]};
+        first = end;
+    }
+    JobCounter counter = {};
+    // caller takes the first range itself
+    jobs_run(jobs, batch + 1, numRanges - 1, &counter);
+    _jobs_range(&ranges[0]);
+    jobs_wait(jobs, &counter);
+}
+
+// Call after threadpool_dispose, workers have run everything by then but jobs pushed
+// to the main thread deque after they saw nothing to do
+static void
+jobs_dispose(JobSystem* jobs) {
+
+    ASSERT_MESSAGE(!jobs->pool->numThreads, "Thread pool has to be disposed before jobs");
+    Job job;
+    while(_jobs_take(jobs, 0, &job)) {
+        _jobs_execute(jobs, &job);
+    }
+    free(jobs->deques);
+    t_jobWorker = -1;
+    jobs->numDeques = 0;
+}
+
+#endif /* JOBS_H */
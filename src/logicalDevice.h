@@ -18,6 +18,21 @@
 #include "commandBuffer.h"
 #include "vertex.h"
 #include "texture.h"
+#include "texturestream.h"
+#include "texturecache.h"
+#include "atlas.h"
+#include "assets.h"
+#include "drawList.h"
+#include "occlusion.h"
+#include "gputimer.h"
+#include "startup.h"
+#include "profiler.h"
+
+const u32 MAX_DRAW_OBJECTS = 8192;
+// gpu memory for streamed texture levels
+const VkDeviceSize TEXTURE_STREAM_BUDGET = 64 * 1024 * 1024;
+// resident bytes of cached textures, past it unreferenced ones go least recently used first
+const VkDeviceSize TEXTURE_CACHE_BUDGET = 48 * 1024 * 1024;
 
 // Store all needed data about Logical device
 typedef struct LogicalDevice {
@@ -33,12 +48,13 @@ typedef struct LogicalDevice {
     VertexData          vertexData;
 
     struct {
-        VkDescriptorPool    descriptorPool;
+        DescriptorAllocator descriptors;
         VkDescriptorSet*    descriptorSets;
     };
 
     UniformObject       ubo;
     Buffer*             uniformBuffers;
+    u32                 numUniformBuffers;  // kept over resizes while image count stays same
 
     struct {
         VkSemaphore*    imageSemaphore;
@@ -49,8 +65,17 @@ typedef struct LogicalDevice {
         VkFence*        imageFences;
     };
 
-    Texture texture;
     Texture depth;
+    BindlessTextures    textures;
+    TextureStreamer     streamer;
+    TextureCache        textureCache;
+    AssetLoader         assets;
+    u32                 streamedTexture;
+    u32                 material;       // bindless index of texture
+
+    DrawList            drawList;
+    OcclusionCuller     occlusion;
+    GpuTimers           gpuTimers;
 
 } LogicalDevice;
 
@@ -86,76 +111,148 @@ static void _create_fences(LogicalDevice* device, u32 numSwapChainImages) {
     }
 }
 
+// Culling pass, scene and pyramid build of the next frame, recorded when the image is free again
 static void
-logicaldevice_init(const PhysicalDevice* physicalDevice, LogicalDevice* device, VkSurfaceKHR surface) {
+logicaldevice_record_frame(LogicalDevice* device, u32 imageIndex, const PushConstants* push) {
+
+    PROFILE_FUNCTION();
+    VkCommandBuffer cmd = device->commandBuffer.buffers[imageIndex];
+    vkResetCommandBuffer(cmd, 0 /*flags*/);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS) {
+        ABORT("failed to begin recording command buffer!");
+    }
+    GpuTimers* timers = &device->gpuTimers;
+    gputimer_begin_frame(timers, cmd, imageIndex, device->device);
+
+    if(enableOcclusionCulling) {
+        gputimer_begin(timers, cmd, imageIndex, GpuPassCull);
+        occlusion_record_cull(&device->occlusion, cmd, imageIndex, &device->drawList, device->device);
+        gputimer_end(timers, cmd, imageIndex, GpuPassCull);
+    }
+
+    gputimer_begin(timers, cmd, imageIndex, GpuPassScene);
+    commandbuffer_record_scene(cmd, imageIndex, &device->frameBuffer, device->renderPass,
+            device->swapchain.extent, &device->pipeline, &device->vertexData,
+            device->descriptorSets, &device->drawList, push);
+    gputimer_end(timers, cmd, imageIndex, GpuPassScene);
+
+    if(enableOcclusionCulling) {
+        gputimer_begin(timers, cmd, imageIndex, GpuPassPyramid);
+        occlusion_record_pyramid(&device->occlusion, cmd);
+        gputimer_end(timers, cmd, imageIndex, GpuPassPyramid);
+    }
 
+    if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+        ABORT("failed to record command buffer!");
+    }
+}
+
+static void
+logicaldevice_init(const PhysicalDevice* physicalDevice, LogicalDevice* device, VkSurfaceKHR surface,
+        ThreadPool* threads) {
+
+    PROFILE_FUNCTION();
     device->device = physicaldevice_create_logicaldevice(physicalDevice);
-    LOG("Logical device created");
+    LOG("Logical device created, %.1f ms", startup_step(&g_startup, "logical device"));
     // set proper queues
     vkGetDeviceQueue(device->device, physicalDevice->queues.graphicsFamily, 0, &device->graphicsQueue);
     vkGetDeviceQueue(device->device, physicalDevice->queues.presentFamily, 0, &device->presentQueue);
 
     swapchain_init(&device->swapchain, physicalDevice->physicalDevice,
             surface, physicalDevice->queues,device->device);
-    LOG("Swapchain created");
+    LOG("Swapchain created, %.1f ms", startup_step(&g_startup, "swapchain"));
 
     device->renderPass = renderpass_create(&device->swapchain,
             device->device,
-            physicalDevice->physicalDevice);
-    LOG("Renderpass inited");
+            physicalDevice->physicalDevice, enableOcclusionCulling);
+    LOG("Renderpass inited, %.1f ms", startup_step(&g_startup, "renderpass"));
 
     uniformobject_init(&device->ubo, device->device);
-    LOG("uniform objects created");
+    LOG("uniform objects created, %.1f ms", startup_step(&g_startup, "uniform objects"));
 
     pipeline_init(&device->pipeline, device->device,
             device->swapchain.extent, device->renderPass, device->ubo.uboLayout);
-    LOG("Pipeline created");
+    LOG("Pipeline created, %.1f ms", startup_step(&g_startup, "pipeline"));
 
     device->commandPool = commandpool_create(physicalDevice->queues.graphicsFamily, device->device);
-    LOG("Commandpool created");
+    LOG("Commandpool created, %.1f ms", startup_step(&g_startup, "command pool"));
 
     device->depth = texture_depth_create(physicalDevice->physicalDevice, device->device, device->swapchain.extent);
-    LOG("Creted depth texture");
+    LOG("Creted depth texture, %.1f ms", startup_step(&g_startup, "depth texture"));
 
     framebuffer_init(&device->frameBuffer, device->device,
             &device->swapchain, device->renderPass, device->depth.view);
-    LOG("Framebuffer created");
-
-    vertexdata_init(&device->vertexData, device->device,
-            physicalDevice->physicalDevice, device->commandPool, device->graphicsQueue);
-    LOG("Vertex data inited");
-
-    device->texture = texture_load_and_create("textures/chalet.jpg", physicalDevice->physicalDevice,
-            device->device, device->commandPool, device->graphicsQueue, TextureSample | TextureMipmap);
-    LOG("Texture loaded and created");
+    LOG("Framebuffer created, %.1f ms", startup_step(&g_startup, "framebuffer"));
+
+    // mesh and texture load in workers while rest of the device is created,
+    // frames draw nothing and sample a placeholder until they are in
+    assets_init(&device->assets, threads, physicalDevice->physicalDevice, device->device,
+            device->commandPool, device->graphicsQueue);
+    assets_request_mesh(&device->assets, "models/chalet.obj", &device->vertexData);
+    LOG("Mesh requested, %.1f ms", startup_step(&g_startup, "asset loader"));
+
+    // small mips first, rest is streamed in when the mesh gets big enough on screen
+    bindless_init(&device->textures);
+    texturestream_init(&device->streamer, TEXTURE_STREAM_BUDGET, threads, &g_asyncIO,
+            physicalDevice->physicalDevice, device->device);
+    texturecache_init(&device->textureCache, &device->streamer, TEXTURE_CACHE_BUDGET);
+    device->streamedTexture = texturecache_acquire(&device->textureCache, "textures/chalet.jpg", &device->textures,
+            &device->assets.placeholder, device->device);
+    device->material = device->streamer.textures[device->streamedTexture].material;
+    LOG("Texture requested, %.1f ms", startup_step(&g_startup, "texture streamer"));
 
     device->uniformBuffers = uniformbuffers_create(device->swapchain.numImages,
             device->device, physicalDevice->physicalDevice);
-    LOG("Uniformbuffers created");
-
-    device->descriptorPool = descriptorpool_create(device->swapchain.numImages, device->device);
-    LOG("descriptorpool created");
+    device->numUniformBuffers = device->swapchain.numImages;
+    LOG("Uniformbuffers created, %.1f ms", startup_step(&g_startup, "uniform buffers"));
 
-    device->descriptorSets = descriptorsets_create( device->descriptorPool, device->device,
-            device->swapchain.numImages, device->ubo.uboLayout, device->uniformBuffers, &device->texture);
-    LOG("descriptorsets created");
+    descriptorallocator_init_ubo(&device->descriptors, device->device);
+    LOG("descriptor allocator created, %.1f ms", startup_step(&g_startup, "descriptor allocator"));
 
+    device->descriptorSets = (VkDescriptorSet*)malloc(sizeof *device->descriptorSets * device->numUniformBuffers);
+    descriptorsets_get(&device->descriptors, device->descriptorSets, device->swapchain.numImages,
+            device->ubo.uboLayout, device->uniformBuffers, &device->textures);
+    LOG("descriptorsets created, %.1f ms", startup_step(&g_startup, "descriptor sets"));
 
-    commandbuffers_init(&device->commandBuffer,
-            &device->frameBuffer, device->device, device->renderPass,
-            device->swapchain.extent, &device->pipeline,
-            device->commandPool, &device->vertexData, device->descriptorSets);
+    drawlist_init(&device->drawList, MAX_DRAW_OBJECTS, device->swapchain.numImages,
+            device->device, physicalDevice->physicalDevice);
+    LOG("Drawlist created, %.1f ms", startup_step(&g_startup, "draw list"));
 
+    if(enableOcclusionCulling) {
+        occlusion_init(&device->occlusion, &device->depth, &device->drawList,
+                physicalDevice->physicalDevice, device->device, device->commandPool, device->graphicsQueue);
+        LOG("Occlusion culler created, %.1f ms", startup_step(&g_startup, "occlusion culler"));
+    }
 
-    LOG("Commandbuffers created");
+    commandbuffers_init(&device->commandBuffer, device->frameBuffer.numBuffers,
+            device->device, device->commandPool);
+    LOG("Commandbuffers created, %.1f ms", startup_step(&g_startup, "command buffers"));
+    gputimer_init(&device->gpuTimers, device->swapchain.numImages, physicalDevice, device->device);
+    LOG("Gpu timers created, %.1f ms", startup_step(&g_startup, "gpu timers"));
     _create_semaphores(device);
-    LOG("Semaphores created");
+    LOG("Semaphores created, %.1f ms", startup_step(&g_startup, "semaphores"));
     _create_fences(device, device->swapchain.numImages);
-    LOG("Fences created");
+    LOG("Fences created, %.1f ms", startup_step(&g_startup, "fences"));
 }
 
 static void _swapchain_cleanup(LogicalDevice* device) {
 
+    if(enableOcclusionCulling) {
+        occlusion_dispose(&device->occlusion, device->device);
+        LOG("Disposed occlusion culler");
+    }
+
+    drawlist_dispose(&device->drawList, device->device);
+    LOG("Disposed drawlist");
+
+    gputimer_dispose(&device->gpuTimers, device->device);
+    LOG("Disposed gpu timers");
+
     texture_dispose(&device->depth, device->device);
     LOG("Disposed depth texture");
 
@@ -172,12 +269,6 @@ static void _swapchain_cleanup(LogicalDevice* device) {
     renderpass_dispose(device->renderPass, device->device);
     LOG("Disposed renderpass");
 
-    uniformbuffer_dispose(&device->uniformBuffers, device->swapchain.numImages, device->device);
-    LOG("Disposed uniformbuffers");
-
-    descriptorpool_dispose(device->descriptorPool, device->device);
-    LOG("Disposed descriptorpool");
-
     swapchain_dispose(&device->swapchain,device->device);
     LOG("Disposed swapchain");
 }
@@ -203,12 +294,23 @@ logicalDevice_dispose(LogicalDevice* device) {
     uniformobject_dispose(&device->ubo, device->device);
     LOG("Disposed uniform object");
 
-    descriptorsets_dispose(device->descriptorSets);
+    uniformbuffer_dispose(&device->uniformBuffers, device->numUniformBuffers, device->device);
+    LOG("Disposed uniformbuffers");
+
+    // sets go with the pools
+    free(device->descriptorSets);
+    descriptorallocator_dispose(&device->descriptors);
+    LOG("Disposed descriptor allocator");
 
     vertexdata_dispose(&device->vertexData, device->device);
     LOG("Diposed vertex buffer");
 
-    texture_dispose(&device->texture, device->device);
+    texturecache_release(&device->textureCache, device->streamedTexture);
+    texturecache_log_stats(&device->textureCache);
+    texturecache_dispose(&device->textureCache);
+    texturestream_dispose(&device->streamer, device->device, device->commandPool);
+    assets_dispose(&device->assets, device->device);
+    bindless_dispose(&device->textures);
 
     _semaphores_dispose(device);
     LOG("Disposed semaphores");
@@ -219,6 +321,9 @@ logicalDevice_dispose(LogicalDevice* device) {
     commandpool_dispose(device->commandPool, device->device);
     LOG("Disposed commandpool");
 
+    sampler_dispose_all(device->device);
+    LOG("Disposed samplers");
+
     // device queues are automaticly disposed when device is disposed
     vkDestroyDevice(device->device, NULL);
     LOG("Disposed logicaldevice");
@@ -229,6 +334,7 @@ logicalDevice_dispose(LogicalDevice* device) {
 static void
 logicaldevice_resize(LogicalDevice* device,const PhysicalDevice* physicalDevice, VkSurfaceKHR surface) {
 
+    PROFILE_FUNCTION();
     LOG_COLOR(CONSOLE_COLOR_BLUE, "Resizing window");
     vkDeviceWaitIdle(device->device);
 
@@ -241,7 +347,7 @@ logicaldevice_resize(LogicalDevice* device,const PhysicalDevice* physicalDevice,
     LOG("Swapchain recreated");
 
     device->renderPass = renderpass_create(&device->swapchain,
-            device->device, physicalDevice->physicalDevice);
+            device->device, physicalDevice->physicalDevice, enableOcclusionCulling);
     LOG("Renderpass recreated");
 
     pipeline_init(&device->pipeline, device->device,
@@ -255,21 +361,40 @@ logicaldevice_resize(LogicalDevice* device,const PhysicalDevice* physicalDevice,
             &device->swapchain, device->renderPass, device->depth.view);
     LOG("Framebuffer recreated");
 
-    device->uniformBuffers = uniformbuffers_create(device->swapchain.numImages,
-            device->device, physicalDevice->physicalDevice);
-    LOG("Uniformbuffers created");
+    // Same buffers give the cached descriptor sets back, rare image count change needs new ones
+    if(device->numUniformBuffers != device->swapchain.numImages) {
+        // new buffers can get handles of the old ones, cached sets would point to freed buffers
+        descriptorallocator_flush(&device->descriptors);
+        uniformbuffer_dispose(&device->uniformBuffers, device->numUniformBuffers, device->device);
+        device->uniformBuffers = uniformbuffers_create(device->swapchain.numImages,
+                device->device, physicalDevice->physicalDevice);
+        device->numUniformBuffers = device->swapchain.numImages;
+        device->descriptorSets = (VkDescriptorSet*)realloc(device->descriptorSets,
+                sizeof *device->descriptorSets * device->numUniformBuffers);
+        LOG("Uniformbuffers recreated");
+    }
+
+    u32 driverAllocations = device->descriptors.numDriverAllocations;
+    descriptorsets_get(&device->descriptors, device->descriptorSets, device->swapchain.numImages,
+            device->ubo.uboLayout, device->uniformBuffers, &device->textures);
+    LOG("descriptorsets ready, %u new allocations",
+            device->descriptors.numDriverAllocations - driverAllocations);
 
-    device->descriptorPool = descriptorpool_create(device->swapchain.numImages, device->device);
-    LOG("descriptorpool created");
+    drawlist_init(&device->drawList, MAX_DRAW_OBJECTS, device->swapchain.numImages,
+            device->device, physicalDevice->physicalDevice);
+    LOG("Drawlist recreated");
 
-    device->descriptorSets = descriptorsets_create( device->descriptorPool, device->device,
-            device->swapchain.numImages, device->ubo.uboLayout, device->uniformBuffers, &device->texture);
-    LOG("descriptorsets created");
+    if(enableOcclusionCulling) {
+        occlusion_init(&device->occlusion, &device->depth, &device->drawList,
+                physicalDevice->physicalDevice, device->device, device->commandPool, device->graphicsQueue);
+        LOG("Occlusion culler recreated");
+    }
 
-    commandbuffers_init(&device->commandBuffer, &device->frameBuffer, device->device,
-            device->renderPass, device->swapchain.extent, &device->pipeline,
-            device->commandPool, &device->vertexData, device->descriptorSets);
+    commandbuffers_init(&device->commandBuffer, device->frameBuffer.numBuffers,
+            device->device, device->commandPool);
     LOG("Commandbuffers recreated");
+    gputimer_init(&device->gpuTimers, device->swapchain.numImages, physicalDevice, device->device);
+    LOG("Gpu timers recreated");
     LOG_COLOR(CONSOLE_COLOR_BLUE, "Done resizing window");
 }
 
@@ -0,0 +1,159 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// LZ4 block format, output decodes with any lz4 block decoder and the other way.
+// Compressor is the simple greedy one, it only runs when packing assets so speed
+// there matters less than the decoder that runs when loading.
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "utils.h"
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5     // block always ends with this many literals
+#define LZ4_MATCH_LIMIT 12      // no match starts closer than this to end
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 14
+
+static inline size_t
+lz4_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+static inline u32
+_lz4_read32(const u8* p) {
+    u32 ret;
+    memcpy(&ret, p, sizeof ret);
+    return ret;
+}
+
+static inline u32
+_lz4_hash(u32 sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static u8*
+_lz4_write_length(u8* dst, size_t length) {
+    while(length >= 255) {
+        *dst++ = 255;
+        length -= 255;
+    }
+    *dst++ = (u8)length;
+    return dst;
+}
+
+static u8*
+_lz4_write_literals(u8* dst, u8* token, const u8* literals, size_t count) {
+    *token = (u8)((count >= 15 ? 15 : count) << 4);
+    if(count >= 15) dst = _lz4_write_length(dst, count - 15);
+    memcpy(dst, literals, count);
+    return dst + count;
+}
+
+// Returns compressed size, dst has to hold lz4_compress_bound(size) bytes
+static size_t
+lz4_compress(const u8* src, size_t size, u8* dst) {
+
+    ASSERT_MESSAGE(size <= 0xFFFFFFFFu, "Block too big to compress");
+    u32* table = (u32*)calloc((size_t)1 << LZ4_HASH_BITS, sizeof *table);
+    const u8* end = src + size;
+    const u8* anchor = src;
+    const u8* ip = src;
+    u8* op = dst;
+
+    if(size > LZ4_MATCH_LIMIT) {
+        const u8* limit = end - LZ4_MATCH_LIMIT;
+        const u8* matchEnd = end - LZ4_LAST_LITERALS;
+        while(ip < limit) {
+            u32 sequence = _lz4_read32(ip);
+            u32 hash = _lz4_hash(sequence);
+            const u8* ref = src + table[hash];
+            table[hash] = (u32)(ip - src);
+            if(ref >= ip || ip - ref > LZ4_MAX_OFFSET || _lz4_read32(ref) != sequence) {
+                ip++;
+                continue;
+            }
+            while(ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const u8* match = ip + LZ4_MIN_MATCH;
+            const u8* matchRef = ref + LZ4_MIN_MATCH;
+            while(match < matchEnd && *match == *matchRef) {
+                match++;
+                matchRef++;
+            }
+
+            u8* token = op++;
+            op = _lz4_write_literals(op, token, anchor, (size_t)(ip - anchor));
+            u32 offset = (u32)(ip - ref);
+            *op++ = (u8)(offset & 0xFF);
+            *op++ = (u8)(offset >> 8);
+            size_t length = (size_t)(match - ip) - LZ4_MIN_MATCH;
+            *token |= (u8)(length >= 15 ? 15 : length);
+            if(length >= 15) op = _lz4_write_length(op, length - 15);
+            ip = anchor = match;
+        }
+    }
+    u8* token = op++;
+    op = _lz4_write_literals(op, token, anchor, (size_t)(end - anchor));
+    free(table);
+    return (size_t)(op - dst);
+}
+
+// Returns 0 if src is broken or does not decode to exactly dstSize bytes
+static u8
+lz4_decompress(const u8* src, size_t srcSize, u8* dst, size_t dstSize) {
+
+    const u8* ip = src;
+    const u8* ipEnd = src + srcSize;
+    u8* op = dst;
+    u8* opEnd = dst + dstSize;
+    while(ip < ipEnd) {
+        u8 token = *ip++;
+        size_t literals = token >> 4;
+        if(literals == 15) {
+            u8 byte;
+            do {
+                if(ip >= ipEnd) return 0;
+                byte = *ip++;
+                literals += byte;
+            } while(byte == 255);
+        }
+        if(literals > (size_t)(ipEnd - ip) || literals > (size_t)(opEnd - op)) return 0;
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+        if(ip == ipEnd) break;  // last sequence has only literals
+
+        if(ipEnd - ip < 2) return 0;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if(!offset || offset > (size_t)(op - dst)) return 0;
+        size_t length = token & 15;
+        if(length == 15) {
+            u8 byte;
+            do {
+                if(ip >= ipEnd) return 0;
+                byte = *ip++;
+                length += byte;
+            } while(byte == 255);
+        }
+        length += LZ4_MIN_MATCH;
+        if(length > (size_t)(opEnd - op)) return 0;
+
+        const u8* match = op - offset;
+        if(offset >= length) {
+            memcpy(op, match, length);
+        } else {
+            // overlapping match repeats the last offset bytes
+            for(size_t i = 0; i < length; i++) op[i] = match[i];
+        }
+        op += length;
+    }
+    return op == opEnd;
+}
+
+#endif /* LZ4_H */
@@ -8,16 +8,42 @@
 #include "physicalDevice.h"
 #include "logicalDevice.h"
 #include "objload.h"
+#include "transform.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "framestats.h"
+#include "startup.h"
 
 
 static void init(VulkanContext* context,LogicalDevice* device);
 static void cleanup(VulkanContext* context,LogicalDevice* device);
 static void main_loop(LogicalDevice* device, VulkanContext* context);
 static void draw_frame(LogicalDevice* device, VulkanContext* context);
+static void update_drawlist(LogicalDevice* device, u32 imageIndex, const mat4* model);
+static void scene_init();
+static void scene_update();
+
+static u64 g_startNs;   // for time to first frame
+static const char* g_frameStatsPath;  // csv of frame times written at exit
+static const char* g_startupPath;     // json of startup times written when assets are in
+static TransformHierarchy g_scene;
+static u32 g_sceneRoot;
+static u32 g_meshNode;
+static float* g_meshletWorld;   // culling scratch, world space centers and results
+static u32 g_meshletWorldSize;
+static ThreadPool g_threadPool;     // loaders and jobs share its workers
 
 i32
 main(const int argc,char **argv) {
-    (void)argc;(void)argv;
+    g_startNs = timer_now_ns();
+    startup_init(&g_startup, g_startNs);
+    for(i32 i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-framestats") && i + 1 < argc) {
+            g_frameStatsPath = argv[++i];
+        } else if(!strcmp(argv[i], "-startup") && i + 1 < argc) {
+            g_startupPath = argv[++i];
+        }
+    }
     VulkanContext context = {};
     LogicalDevice logicalDevice = {};
     init(&context,&logicalDevice);
@@ -33,20 +59,67 @@ main(const int argc,char **argv) {
 void
 init(VulkanContext* context, LogicalDevice* device) {
     colored_print_init();
+    profiler_init();
+    PROFILE_FUNCTION();
+    framestats_init(&g_frameStats);
+    pack_mount(PACK_PATH);
+    startup_step(&g_startup, "pack mount");
+    // tables are read by loaders in workers
+    mipgen_init();
+    threadpool_init(&g_threadPool, 0);
+    LOG("Thread pool started with %u workers, %.1f ms", g_threadPool.numThreads,
+            startup_step(&g_startup, "thread pool"));
+    jobs_init(&g_jobs, &g_threadPool);
+    LOG("Job system started on %u pool workers, %.1f ms", g_jobs.numDeques - 1,
+            startup_step(&g_startup, "job system"));
+    asyncio_init(&g_asyncIO, &g_threadPool, AsyncBackendAuto);
+    startup_step(&g_startup, "async io");
     window_init();
-    LOG("Window initialized");
+    LOG("Window initialized, %.1f ms", startup_step(&g_startup, "window"));
     vulkancontext_init(context);
     LOG("Context initialized");
-    logicaldevice_init(&context->physicalDevice, device, context->surface);
+    logicaldevice_init(&context->physicalDevice, device, context->surface, &g_threadPool);
     LOG("logical parts initialized!");
+    scene_init();
+    startup_step(&g_startup, "scene");
+    startup_report(&g_startup);
+}
+
+static void
+scene_init() {
+    transform_init(&g_scene, 16);
+    // root spins around up axis, mesh is turned to stand up under it
+    g_sceneRoot = transform_add(&g_scene, TRANSFORM_NONE, (vec3){}, (quat){0.f, 0.f, 0.f, 1.f},
+            (vec3){1.f, 1.f, 1.f});
+    g_meshNode = transform_add(&g_scene, g_sceneRoot, (vec3){},
+            quat_from_axis((vec3){1.f, 0.f, 0.f}, -90.f * deg2rad), (vec3){1.f, 1.f, 1.f});
+}
+
+static void
+scene_update() {
+    PROFILE_FUNCTION();
+    float time = (float)glfwGetTime();
+    transform_set_rotation(&g_scene, g_sceneRoot, quat_from_axis(world_up, -time * 0.1f));
+    transform_update(&g_scene);
 }
 
 static void
 main_loop(LogicalDevice* device, VulkanContext* context) {
 
+    u8 dumpKeyDown = 0;
     while (!glfwWindowShouldClose(g_window)) {
-        glfwPollEvents();
+        {
+            PROFILE_ZONE("poll events");
+            glfwPollEvents();
+        }
         draw_frame(device, context);
+
+        // F2 writes what the profiler has, on release so one press is one dump
+        if(PROFILER_ENABLED) {
+            u8 down = glfwGetKey(g_window, GLFW_KEY_F2) == GLFW_PRESS;
+            if(dumpKeyDown && !down) profiler_dump(PROFILER_PATH);
+            dumpKeyDown = down;
+        }
     }
 
     vkDeviceWaitIdle(device->device);
@@ -55,12 +128,36 @@ main_loop(LogicalDevice* device, VulkanContext* context) {
 
 static void
 draw_frame(LogicalDevice* device, VulkanContext* context) {
+    PROFILE_FUNCTION();
     static u32 currentFrame = 0;
-    vkWaitForFences(device->device, 1, &device->flightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    static u64 lastLogNs = 0;
+    framestats_begin_frame(&g_frameStats);
+    u64 frameNs = g_frameStats.frameStart;
+    if(!lastLogNs) lastLogNs = frameNs;
+    if(frameNs - lastLogNs > 1000000000ull) {
+        lastLogNs = frameNs;
+        gputimer_log(&device->gpuTimers, &g_frameStats.recent);
+    }
+    {
+        PROFILE_ZONE("wait frame fence");
+        u64 start = timer_now_ns();
+        vkWaitForFences(device->device, 1, &device->flightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        framestats_add(&g_frameStats, FrameStatFence, timer_now_ns() - start);
+    }
+    // transient descriptors of this frame are free again
+    if(enableOcclusionCulling) {
+        descriptorallocator_begin_frame(&device->occlusion.descriptors, currentFrame);
+    }
     u32 imageIndex;
-    // Get image index
-    VkResult res = vkAcquireNextImageKHR(device->device, device->swapchain.swapchain, UINT64_MAX,
-            device->imageSemaphore[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult res;
+    {
+        PROFILE_ZONE("acquire image");
+        u64 start = timer_now_ns();
+        // Get image index
+        res = vkAcquireNextImageKHR(device->device, device->swapchain.swapchain, UINT64_MAX,
+                device->imageSemaphore[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        framestats_add(&g_frameStats, FrameStatAcquire, timer_now_ns() - start);
+    }
 
     if (res == VK_ERROR_OUT_OF_DATE_KHR) { // Resized and not avaivable
         logicaldevice_resize(device, &context->physicalDevice, context->surface);
@@ -70,12 +167,26 @@ draw_frame(LogicalDevice* device, VulkanContext* context) {
         ABORT("failed to aquire swapchain image");
     }
 
-    uniformbuffer_update(&device->uniformBuffers[imageIndex], &device->ubo, device->device);
-
     if (device->imageFences[imageIndex] != VK_NULL_HANDLE){
+        PROFILE_ZONE("wait image fence");
+        u64 start = timer_now_ns();
         vkWaitForFences(device->device, 1, &device->imageFences[imageIndex], VK_TRUE, UINT64_MAX);
+        framestats_add(&g_frameStats, FrameStatFence, timer_now_ns() - start);
     }
 
+    // Buffers of the image are not in use anymore
+    scene_update();
+    PushConstants push = {.model = *transform_world(&g_scene, g_meshNode)};
+    uniformbuffer_update(&device->uniformBuffers[imageIndex], &device->ubo, device->device);
+    asyncio_update(&g_asyncIO);
+    u32 loading = assets_update(&device->assets, context->physicalDevice.physicalDevice,
+            device->device, device->commandPool, device->graphicsQueue);
+    update_drawlist(device, imageIndex, &push.model);
+    texturestream_update(&device->streamer, &device->textures, device->descriptorSets,
+            device->swapchain.numImages, imageIndex, context->physicalDevice.physicalDevice,
+            device->device, device->commandPool, device->graphicsQueue);
+    logicaldevice_record_frame(device, imageIndex, &push);
+
     device->imageFences[imageIndex] = device->flightFences[currentFrame];
 
     // Submit command buffer
@@ -99,9 +210,12 @@ draw_frame(LogicalDevice* device, VulkanContext* context) {
 
     vkResetFences(device->device, 1, &device->flightFences[currentFrame]);
 
-    if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo,
-                device->flightFences[currentFrame]) != VK_SUCCESS) {
-        ABORT("failed to submit draw command buffer!");
+    {
+        PROFILE_ZONE("submit");
+        if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo,
+                    device->flightFences[currentFrame]) != VK_SUCCESS) {
+            ABORT("failed to submit draw command buffer!");
+        }
     }
 
     // Submit result to swap chain to eventually show it
@@ -116,7 +230,12 @@ draw_frame(LogicalDevice* device, VulkanContext* context) {
     presentInfo.pSwapchains = swapChains;
     presentInfo.pImageIndices = &imageIndex;
 
-    res = vkQueuePresentKHR(device->presentQueue, &presentInfo);
+    {
+        PROFILE_ZONE("present");
+        u64 start = timer_now_ns();
+        res = vkQueuePresentKHR(device->presentQueue, &presentInfo);
+        framestats_add(&g_frameStats, FrameStatPresent, timer_now_ns() - start);
+    }
 
     if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || g_resizedWindow) { // Resized and not avaivable
         g_resizedWindow = 0;
@@ -127,16 +246,203 @@ draw_frame(LogicalDevice* device, VulkanContext* context) {
         ABORT("failed to aquire swapchain image");
     }
 
+    // window is responsive from the first frame, assets come in while it runs
+    static u8 firstFrameDone = 0, assetsDone = 0;
+    loading += texturestream_loading(&device->streamer);
+    if(!firstFrameDone) {
+        firstFrameDone = 1;
+        LOG("First frame presented %.1f ms after start, %u assets loading",
+                (double)(timer_now_ns() - g_startNs) / 1e6, loading);
+        startup_milestone(&g_startup, "first frame");
+    }
+    if(!assetsDone && !loading) {
+        assetsDone = 1;
+        LOG("All assets ready %.1f ms after start", (double)(timer_now_ns() - g_startNs) / 1e6);
+        startup_milestone(&g_startup, "assets ready");
+        startup_finish(&g_startup, g_startupPath);
+    }
+
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     //vkQueueWaitIdle(device->presentQueue);
 }
 
+#define MESHLET_CULL_BATCH 256
+
+typedef enum MeshletCullResult {
+    MeshletVisible = 0,
+    MeshletConeCulled,
+    MeshletFrustumCulled,
+} MeshletCullResult;
+
+typedef struct MeshletCullJob {
+    const VertexData*   mesh;
+    const mat4*         model;
+    Frustum             frustum;
+    vec3                localEye;
+    float               scale;
+    float*              worldX;
+    float*              worldY;
+    float*              worldZ;
+    u8*                 results;    // MeshletCullResult for each meshlet
+} MeshletCullJob;
+
+// Range of meshlets to world space and tested, each range writes only its own slots
+static void
+_cull_meshlets(void* data, u32 first, u32 count) {
+
+    PROFILE_FUNCTION();
+    MeshletCullJob* job = (MeshletCullJob*)data;
+    const VertexData* mesh = job->mesh;
+    mat4_transform_points_soa(job->model, mesh->meshletBounds.x + first, mesh->meshletBounds.y + first,
+            mesh->meshletBounds.z + first, job->worldX + first, job->worldY + first, job->worldZ + first,
+            NULL, count);
+    for(u32 i = first; i < first + count; i++) {
+        if(meshlet_cone_culled(&mesh->meshlets[i], job->localEye)) {
+            job->results[i] = MeshletConeCulled;
+            continue;
+        }
+        vec3 sphere = {job->worldX[i], job->worldY[i], job->worldZ[i]};
+        job->results[i] = frustum_test_sphere(&job->frustum, sphere, mesh->meshletBounds.radius[i] * job->scale)
+            ? MeshletVisible : MeshletFrustumCulled;
+    }
+}
+
+static void
+update_drawlist(LogicalDevice* device, u32 imageIndex, const mat4* model) {
+
+    PROFILE_FUNCTION();
+    static double lastLog = 0;
+    double time = glfwGetTime();
+    u8 logStats = time - lastLog > 1.0;
+    if(logStats) lastLog = time;
+
+    if(enableOcclusionCulling) {
+        // Results of the last frame drawn with this image
+        OcclusionStats stats = occlusion_read_stats(&device->occlusion, imageIndex, device->device);
+        if(logStats) {
+            LOG("Occlusion: %u visible, %u culled", stats.visible, stats.culled);
+        }
+    }
+
+    mat4 viewProjection;
+    mat4_mult_mat4(&viewProjection, &device->ubo.data.projection, &device->ubo.data.view);
+    drawlist_clear(&device->drawList);
+
+    // empty draw while mesh is loading
+    const VertexData* mesh = &device->vertexData;
+    if(!vertexdata_ready(mesh)) {
+        drawlist_upload(&device->drawList, imageIndex, &viewProjection,
+                !enableOcclusionCulling, device->device);
+        return;
+    }
+    vec4 bounds = mesh->bounds;
+    vec4 center = mat4_mult_vec4(model, (vec4){bounds.x, bounds.y, bounds.z, 1.f});
+
+    // Radius grows with the largest scale of the model
+    float scale = 0.f;
+    for(u32 i = 0; i < 3; i++) {
+        vec3 axis = {model->mat[i][0], model->mat[i][1], model->mat[i][2]};
+        scale = maxf(scale, lenght_vec3(axis));
+    }
+
+    // Pick detail level from how many pixels the simplification error would cover
+    vec3 toCamera = neg_vec3((vec3){center.x, center.y, center.z}, device->ubo.eye);
+    float distance = maxf(lenght_vec3(toCamera) - bounds.w * scale, 0.f);
+    float projectionScale = fabsf(device->ubo.data.projection.mat[1][1]) * device->ubo.viewportHeight * 0.5f;
+    u32 lod = meshlod_select(mesh->lods, mesh->numLods, distance / scale, projectionScale, 1.f);
+
+    // Texture is mapped over the mesh once, its size on screen picks the finest mip needed
+    float screenPixels = 2.f * bounds.w * scale * projectionScale / maxf(distance, 0.01f);
+    texturestream_request(&device->streamer, device->streamedTexture, screenPixels);
+
+    if(lod == 0 && mesh->numMeshlets <= device->drawList.header.maxObjects) {
+        // Full detail is drawn per meshlet, backfacing and offscreen clusters are skipped
+        mat4 inverseModel;
+        inverse_mat4(&inverseModel, model);
+        vec4 eye = mat4_mult_vec4(&inverseModel,
+                (vec4){device->ubo.eye.x, device->ubo.eye.y, device->ubo.eye.z, 1.f});
+        vec3 localEye = {eye.x, eye.y, eye.z};
+        Frustum frustum = frustum_from_mat4(&viewProjection);
+
+        // Meshlets are culled in parallel to a result each, draws are pushed in order after
+        if(g_meshletWorldSize < mesh->numMeshlets) {
+            if(g_meshletWorld) free(g_meshletWorld);
+            g_meshletWorldSize = mesh->numMeshlets;
+            g_meshletWorld = (float*)malloc((sizeof *g_meshletWorld * 3 + 1) * g_meshletWorldSize);
+        }
+        float* world = g_meshletWorld;
+        u32 worldSize = g_meshletWorldSize;
+        MeshletCullJob cull = {
+            .mesh = mesh,
+            .model = model,
+            .frustum = frustum,
+            .localEye = localEye,
+            .scale = scale,
+            .worldX = world,
+            .worldY = world + worldSize,
+            .worldZ = world + worldSize * 2,
+            .results = (u8*)(world + worldSize * 3),
+        };
+        jobs_parallel_for(&g_jobs, mesh->numMeshlets, MESHLET_CULL_BATCH, _cull_meshlets, &cull);
+
+        MeshletCullStats stats = {};
+        for(u32 i = 0; i < mesh->numMeshlets; i++) {
+            if(cull.results[i] == MeshletConeCulled) {
+                stats.coneCulled++;
+                continue;
+            }
+            if(cull.results[i] == MeshletFrustumCulled) {
+                stats.frustumCulled++;
+                continue;
+            }
+            const Meshlet* meshlet = &mesh->meshlets[i];
+            DrawObject object = {
+                .sphere = {cull.worldX[i], cull.worldY[i], cull.worldZ[i], mesh->meshletBounds.radius[i] * scale},
+                .indexCount = meshlet->numIndexes,
+                .firstIndex = meshlet->firstIndex,
+                .vertexOffset = 0,
+                .materialId = device->material,
+            };
+            drawlist_push(&device->drawList, &object);
+            stats.drawn++;
+        }
+
+        if(logStats) {
+            LOG("Meshlets: %u drawn, %u backfacing, %u outside frustum",
+                    stats.drawn, stats.coneCulled, stats.frustumCulled);
+        }
+    } else {
+        DrawObject object = {
+            .sphere = {center.x, center.y, center.z, bounds.w * scale},
+            .indexCount = mesh->lods[lod].numIndexes,
+            .firstIndex = mesh->lods[lod].firstIndex,
+            .vertexOffset = 0,
+            .materialId = device->material,
+        };
+        drawlist_push(&device->drawList, &object);
+    }
+
+    drawlist_upload(&device->drawList, imageIndex, &viewProjection,
+            !enableOcclusionCulling, device->device);
+}
+
 // free memory, context and other resources
 static void
 cleanup(VulkanContext* context, LogicalDevice* device) {
 
+    framestats_report(&g_frameStats, g_frameStatsPath);
     LOG_COLOR(CONSOLE_COLOR_BLUE,"********Starting to dispose********");
+    transform_dispose(&g_scene);
+    if(g_meshletWorld) free(g_meshletWorld);
+    g_meshletWorldSize = 0;
     logicalDevice_dispose(device);
     vulkancontext_dispose(context);
     dispose_window();
+    asyncio_dispose(&g_asyncIO);
+    threadpool_dispose(&g_threadPool);
+    jobs_dispose(&g_jobs);
+    pack_unmount();
+    profiler_dispose();
+    framestats_dispose(&g_frameStats);
+    startup_dispose(&g_startup);
 }
@@ -0,0 +1,288 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Meshlets are small clusters of triangles with bounds for cheap culling.
+// Builder reorders the index buffer so that each meshlet is one contiguous range
+// and can be drawn with a single indexed indirect command.
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "utils.h"
+#include "cmath.h"
+#include "jobs.h"
+
+#define MESHLET_MAX_VERTEXES 64
+#define MESHLET_BOUNDS_BATCH 256
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct Meshlet {
+    vec4    sphere;         // object space, radius in w
+    vec3    coneAxis;       // average facing of triangles
+    float   coneCutoff;     // 1 when cone is too wide to cull anything
+    u32     firstIndex;
+    u32     numIndexes;
+    u32     numVertexes;
+} Meshlet;
+
+// Sphere centers split to arrays for batched transforms
+typedef struct MeshletBounds {
+    float*  x;
+    float*  y;
+    float*  z;
+    float*  radius;
+    u32     count;
+} MeshletBounds;
+
+typedef struct Frustum {
+    vec4    planes[6];      // inside when dot(plane.xyz, p) + plane.w >= 0
+} Frustum;
+
+typedef struct MeshletCullStats {
+    u32     drawn;
+    u32     coneCulled;
+    u32     frustumCulled;
+} MeshletCullStats;
+
+static inline vec3
+_meshlet_position(const float* positions, u32 stride, u32 index) {
+    const float* p = (const float*)((const u8*)positions + (size_t)stride * index);
+    return (vec3){p[0], p[1], p[2]};
+}
+
+static void
+_meshlet_compute_bounds(Meshlet* meshlet, const u32* indexes, const float* positions, u32 stride) {
+
+    const u32* tris = &indexes[meshlet->firstIndex];
+    u32 numTriangles = meshlet->numIndexes / 3;
+
+    vec3 low = _meshlet_position(positions, stride, tris[0]);
+    vec3 high = low;
+    vec3 normalSum = {};
+    for(u32 i = 0; i < meshlet->numIndexes; i++) {
+        vec3 p = _meshlet_position(positions, stride, tris[i]);
+        low = (vec3){minf(low.x, p.x), minf(low.y, p.y), minf(low.z, p.z)};
+        high = (vec3){maxf(high.x, p.x), maxf(high.y, p.y), maxf(high.z, p.z)};
+    }
+    vec3 center = scale_vec3(add_vec3(low, high), 0.5f);
+
+    float radius = 0.f;
+    for(u32 i = 0; i < meshlet->numIndexes; i++) {
+        radius = maxf(radius, lenght_vec3(neg_vec3(_meshlet_position(positions, stride, tris[i]), center)));
+    }
+    meshlet->sphere = (vec4){center.x, center.y, center.z, radius};
+
+    // Unit normals, every triangle has the same vote in the cone
+    vec3* normals = (vec3*)malloc(sizeof *normals * numTriangles);
+    for(u32 t = 0; t < numTriangles; t++) {
+        vec3 a = _meshlet_position(positions, stride, tris[t * 3 + 0]);
+        vec3 b = _meshlet_position(positions, stride, tris[t * 3 + 1]);
+        vec3 c = _meshlet_position(positions, stride, tris[t * 3 + 2]);
+        vec3 n = cross_product(neg_vec3(b, a), neg_vec3(c, a));
+        float len = lenght_vec3(n);
+        normals[t] = len > 0.f ? scale_vec3(n, 1.f / len) : (vec3){};
+        normalSum = add_vec3(normalSum, normals[t]);
+    }
+
+    float sumLen = lenght_vec3(normalSum);
+    meshlet->coneAxis = sumLen > 0.f ? scale_vec3(normalSum, 1.f / sumLen) : (vec3){0.f, 0.f, 1.f};
+    meshlet->coneCutoff = 1.f;
+    if(sumLen > 0.f) {
+        float minDot = 1.f;
+        for(u32 t = 0; t < numTriangles; t++) {
+            vec3 n = normals[t];
+            minDot = minf(minDot, n.x * meshlet->coneAxis.x + n.y * meshlet->coneAxis.y + n.z * meshlet->coneAxis.z);
+        }
+        // wider than ~85 degrees is hardly ever culled
+        if(minDot > 0.1f) {
+            meshlet->coneCutoff = sqrtf(1.f - minDot * minDot);
+        }
+    }
+    free(normals);
+}
+
+typedef struct MeshletBoundsJob {
+    Meshlet*        meshlets;
+    const u32*      indexes;
+    const float*    positions;
+    u32             stride;
+} MeshletBoundsJob;
+
+static void
+_meshlet_bounds_range(void* data, u32 first, u32 count) {
+    MeshletBoundsJob* job = (MeshletBoundsJob*)data;
+    for(u32 i = first; i < first + count; i++) {
+        _meshlet_compute_bounds(&job->meshlets[i], job->indexes, job->positions, job->stride);
+    }
+}
+
+// Greedy clustering, grow from the seed triangle by adding neighbours that bring fewest new vertexes
+// Reorders indexes in place and returns meshlet array, count in numMeshlets.
+// Clustering is serial, bounds go to jobs when called from main thread or a pool worker
+static Meshlet*
+meshlet_build(u32* indexes, u32 numIndexes, const float* positions, u32 stride, u32 numVertexes,
+        u32* numMeshlets) {
+
+    u32 numTriangles = numIndexes / 3;
+
+    // vertex to triangle adjacency
+    u32* offsets = (u32*)calloc(numVertexes + 1, sizeof *offsets);
+    u32* fill = (u32*)calloc(numVertexes, sizeof *fill);
+    u32* adjacency = (u32*)malloc(sizeof *adjacency * numIndexes + 1);
+    for(u32 i = 0; i < numIndexes; i++) {
+        offsets[indexes[i] + 1]++;
+    }
+    for(u32 i = 0; i < numVertexes; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    for(u32 i = 0; i < numIndexes; i++) {
+        adjacency[offsets[indexes[i]] + fill[indexes[i]]++] = i / 3;
+    }
+
+    u8* used = (u8*)calloc(numTriangles + 1, sizeof *used);
+    // meshlet slot of each vertex, valid when owner is current meshlet
+    u32* owner = (u32*)malloc(sizeof *owner * numVertexes + 1);
+    memset(owner, 0xFF, sizeof *owner * numVertexes);
+
+    u32* ordered = (u32*)malloc(sizeof *ordered * numIndexes + 1);
+    u32 maxMeshlets = numTriangles + 1;
+    Meshlet* meshlets = (Meshlet*)malloc(sizeof *meshlets * maxMeshlets);
+    u32 count = 0;
+    u32 written = 0;
+    u32 seed = 0;
+
+    u32 vertexList[MESHLET_MAX_VERTEXES];
+
+    while(written < numIndexes) {
+        while(used[seed]) seed++;
+
+        Meshlet* meshlet = &meshlets[count];
+        *meshlet = (Meshlet){.firstIndex = written};
+        u32 numMeshletVerts = 0;
+        u32 next = seed;
+
+        while(next != numeric_max_u32) {
+            // add triangle
+            const u32* tri = &indexes[next * 3];
+            for(u32 k = 0; k < 3; k++) {
+                if(owner[tri[k]] != count) {
+                    owner[tri[k]] = count;
+                    vertexList[numMeshletVerts++] = tri[k];
+                }
+                ordered[written++] = tri[k];
+            }
+            used[next] = 1;
+            meshlet->numIndexes += 3;
+            if(meshlet->numIndexes / 3 >= MESHLET_MAX_TRIANGLES) break;
+
+            // best neighbour of the current vertexes
+            next = numeric_max_u32;
+            u32 bestNew = 4;
+            for(u32 v = 0; v < numMeshletVerts && bestNew > 0; v++) {
+                u32 vert = vertexList[v];
+                for(u32 a = offsets[vert]; a < offsets[vert + 1]; a++) {
+                    u32 t = adjacency[a];
+                    if(used[t]) continue;
+                    const u32* cand = &indexes[t * 3];
+                    u32 numNew = (owner[cand[0]] != count) + (owner[cand[1]] != count) + (owner[cand[2]] != count);
+                    if(numMeshletVerts + numNew > MESHLET_MAX_VERTEXES) continue;
+                    if(numNew < bestNew) {
+                        bestNew = numNew;
+                        next = t;
+                        if(!numNew) break;
+                    }
+                }
+            }
+        }
+        meshlet->numVertexes = numMeshletVerts;
+        count++;
+    }
+
+    memcpy(indexes, ordered, sizeof *indexes * numIndexes);
+    MeshletBoundsJob bounds = {.meshlets = meshlets, .indexes = indexes, .positions = positions, .stride = stride};
+    if(jobs_in_worker(&g_jobs)) {
+        jobs_parallel_for(&g_jobs, count, MESHLET_BOUNDS_BATCH, _meshlet_bounds_range, &bounds);
+    } else {
+        _meshlet_bounds_range(&bounds, 0, count);
+    }
+
+    free(ordered);
+    free(owner);
+    free(used);
+    free(adjacency);
+    free(fill);
+    free(offsets);
+
+    *numMeshlets = count;
+    return (Meshlet*)realloc(meshlets, sizeof *meshlets * count);
+}
+
+static MeshletBounds
+meshlet_bounds_create(const Meshlet* meshlets, u32 count) {
+
+    MeshletBounds ret = {.count = count};
+    // one block, arrays back to back
+    ret.x = (float*)malloc(sizeof(float) * 4 * count + 1);
+    ret.y = ret.x + count;
+    ret.z = ret.y + count;
+    ret.radius = ret.z + count;
+    for(u32 i = 0; i < count; i++) {
+        ret.x[i] = meshlets[i].sphere.x;
+        ret.y[i] = meshlets[i].sphere.y;
+        ret.z[i] = meshlets[i].sphere.z;
+        ret.radius[i] = meshlets[i].sphere.w;
+    }
+    return ret;
+}
+
+static void
+meshlet_bounds_dispose(MeshletBounds* bounds) {
+    free(bounds->x);
+    memset(bounds, 0, sizeof *bounds);
+}
+
+// Planes of vulkan clip space (z from 0 to w) pulled out of view projection matrix
+static Frustum
+frustum_from_mat4(const mat4* m) {
+
+    vec4 rows[4];
+    for(u32 r = 0; r < 4; r++) {
+        rows[r] = (vec4){m->mat[0][r], m->mat[1][r], m->mat[2][r], m->mat[3][r]};
+    }
+
+    Frustum ret = {};
+    ret.planes[0] = add_vec4(rows[3], rows[0]);  // left
+    ret.planes[1] = neg_vec4(rows[3], rows[0]);  // right
+    ret.planes[2] = add_vec4(rows[3], rows[1]);  // top
+    ret.planes[3] = neg_vec4(rows[3], rows[1]);  // bottom
+    ret.planes[4] = rows[2];                     // near
+    ret.planes[5] = neg_vec4(rows[3], rows[2]);  // far
+
+    for(u32 i = 0; i < 6; i++) {
+        vec4* p = &ret.planes[i];
+        float len = sqrtf(p->x * p->x + p->y * p->y + p->z * p->z);
+        if(len > 0.f) *p = scale_vec4(*p, 1.f / len);
+    }
+    return ret;
+}
+
+static inline u8
+frustum_test_sphere(const Frustum* frustum, vec3 center, float radius) {
+    for(u32 i = 0; i < 6; i++) {
+        const vec4* p = &frustum->planes[i];
+        if(p->x * center.x + p->y * center.y + p->z * center.z + p->w < -radius) return 0;
+    }
+    return 1;
+}
+
+// All triangles face away from the camera, camera in object space
+static inline u8
+meshlet_cone_culled(const Meshlet* meshlet, vec3 camera) {
+    vec3 center = {meshlet->sphere.x, meshlet->sphere.y, meshlet->sphere.z};
+    vec3 dir = neg_vec3(center, camera);
+    float d = dir.x * meshlet->coneAxis.x + dir.y * meshlet->coneAxis.y + dir.z * meshlet->coneAxis.z;
+    return d >= meshlet->coneCutoff * lenght_vec3(dir) + meshlet->sphere.w;
+}
+
+#endif /* MESHLET_H */
@@ -0,0 +1,383 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Quadric error metric mesh simplification
+// Edges are collapsed to one of their end points so the simplified index buffer
+// can use the original vertex buffer. Uv seams and open borders are locked.
+
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include "utils.h"
+#include "cmath.h"
+
+#define MESH_MAX_LODS 4
+
+typedef struct MeshLod {
+    u32     firstIndex;
+    u32     numIndexes;
+    float   error;          // object space distance from the base mesh
+} MeshLod;
+
+// Symmetric 4x4 plane matrix, weight is the area it was built from
+typedef struct Quadric {
+    double  xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    double  weight;
+} Quadric;
+
+typedef struct SimplifyCollapse {
+    u32     from;
+    u32     to;
+    double  cost;
+} SimplifyCollapse;
+
+static inline void
+_quadric_add(Quadric* q, const Quadric* o) {
+    q->xx += o->xx; q->xy += o->xy; q->xz += o->xz; q->xw += o->xw;
+    q->yy += o->yy; q->yz += o->yz; q->yw += o->yw;
+    q->zz += o->zz; q->zw += o->zw;
+    q->ww += o->ww;
+    q->weight += o->weight;
+}
+
+static inline double
+_quadric_error(const Quadric* q, vec3 p) {
+    double x = p.x, y = p.y, z = p.z;
+    double ret = q->xx * x * x + q->yy * y * y + q->zz * z * z + q->ww
+        + 2.0 * (q->xy * x * y + q->xz * x * z + q->yz * y * z)
+        + 2.0 * (q->xw * x + q->yw * y + q->zw * z);
+    return ret < 0.0 ? 0.0 : ret;
+}
+
+static inline Quadric
+_quadric_from_triangle(vec3 a, vec3 b, vec3 c) {
+    vec3 n = cross_product(neg_vec3(b, a), neg_vec3(c, a));
+    float len = lenght_vec3(n);
+    Quadric q = {};
+    if(len <= 0.f) return q;
+
+    // plane weighted by triangle area so small triangles do not dominate
+    double area = 0.5 * len;
+    double nx = n.x / len, ny = n.y / len, nz = n.z / len;
+    double d = -(nx * a.x + ny * a.y + nz * a.z);
+
+    q.xx = nx * nx * area; q.xy = nx * ny * area; q.xz = nx * nz * area; q.xw = nx * d * area;
+    q.yy = ny * ny * area; q.yz = ny * nz * area; q.yw = ny * d * area;
+    q.zz = nz * nz * area; q.zw = nz * d * area;
+    q.ww = d * d * area;
+    q.weight = area;
+    return q;
+}
+
+static inline vec3
+_simplify_position(const float* positions, u32 stride, u32 index) {
+    const float* p = (const float*)((const u8*)positions + (size_t)stride * index);
+    return (vec3){p[0], p[1], p[2]};
+}
+
+static int
+_simplify_collapse_compare(const void* l, const void* r) {
+    double lc = ((const SimplifyCollapse*)l)->cost;
+    double rc = ((const SimplifyCollapse*)r)->cost;
+    return (lc > rc) - (lc < rc);
+}
+
+static inline u32
+_simplify_hash_position(vec3 p) {
+    u32 h[3];
+    memcpy(h, &p, sizeof h);
+    return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+}
+
+// Vertexes sharing position (split by uv) point to the first one of them
+static u32*
+_simplify_canonical(const float* positions, u32 stride, u32 numVertexes) {
+
+    u32 tableSize = 1;
+    while(tableSize < numVertexes * 2) tableSize <<= 1;
+
+    u32* table = (u32*)malloc(sizeof *table * tableSize);
+    memset(table, 0xFF, sizeof *table * tableSize);
+    u32* canonical = (u32*)malloc(sizeof *canonical * numVertexes);
+
+    for(u32 i = 0; i < numVertexes; i++) {
+        vec3 p = _simplify_position(positions, stride, i);
+        u32 slot = _simplify_hash_position(p) & (tableSize - 1);
+        for(;;) {
+            if(table[slot] == numeric_max_u32) {
+                table[slot] = i;
+                canonical[i] = i;
+                break;
+            }
+            vec3 other = _simplify_position(positions, stride, table[slot]);
+            if(other.x == p.x && other.y == p.y && other.z == p.z) {
+                canonical[i] = table[slot];
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    free(table);
+    return canonical;
+}
+
+// Would moving vertex from to position of to flip or collapse any remaining triangle around it
+static u8
+_simplify_flips(const u32* indexes, const u32* adjacencyOffsets, const u32* adjacency,
+        const float* positions, u32 stride, u32 from, u32 to) {
+
+    vec3 target = _simplify_position(positions, stride, to);
+
+    for(u32 i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++) {
+        const u32* tri = &indexes[adjacency[i] * 3];
+        if(tri[0] == to || tri[1] == to || tri[2] == to) continue; // removed by the collapse
+
+        vec3 p[3];
+        vec3 moved[3];
+        for(u32 k = 0; k < 3; k++) {
+            p[k] = _simplify_position(positions, stride, tri[k]);
+            moved[k] = tri[k] == from ? target : p[k];
+        }
+        vec3 before = cross_product(neg_vec3(p[1], p[0]), neg_vec3(p[2], p[0]));
+        vec3 after = cross_product(neg_vec3(moved[1], moved[0]), neg_vec3(moved[2], moved[0]));
+
+        float dot = before.x * after.x + before.y * after.y + before.z * after.z;
+        if(dot <= 0.f) return 1;
+    }
+    return 0;
+}
+
+// Writes simplified indexes to dst (same capacity as indexes) and returns their count
+// Stops when targetIndexes is reached or nothing can be collapsed anymore
+static u32
+meshsimplify(u32* dst, const u32* indexes, u32 numIndexes,
+        const float* positions, u32 stride, u32 numVertexes,
+        u32 targetIndexes, float* resultError) {
+
+    ASSERT_MESSAGE(numIndexes % 3 == 0, "Index count must be multiple of 3");
+
+    memcpy(dst, indexes, sizeof *indexes * numIndexes);
+    u32 numTriangles = numIndexes / 3;
+    u32 targetTriangles = targetIndexes / 3;
+
+    u32* canonical = _simplify_canonical(positions, stride, numVertexes);
+    u32* wedges = (u32*)calloc(numVertexes, sizeof *wedges);
+    for(u32 i = 0; i < numVertexes; i++) {
+        wedges[canonical[i]]++;
+    }
+
+    // Quadrics of the whole position, uv split vertexes share them
+    Quadric* quadrics = (Quadric*)calloc(numVertexes, sizeof *quadrics);
+    for(u32 t = 0; t < numTriangles; t++) {
+        const u32* tri = &dst[t * 3];
+        Quadric q = _quadric_from_triangle(
+                _simplify_position(positions, stride, tri[0]),
+                _simplify_position(positions, stride, tri[1]),
+                _simplify_position(positions, stride, tri[2]));
+        for(u32 k = 0; k < 3; k++) {
+            _quadric_add(&quadrics[canonical[tri[k]]], &q);
+        }
+    }
+
+    // Seams would tear uvs and borders would shrink the silhouette, keep both
+    u8* locked = (u8*)calloc(numVertexes, sizeof *locked);
+    for(u32 i = 0; i < numVertexes; i++) {
+        locked[i] = wedges[canonical[i]] > 1;
+    }
+    {
+        // edge is on border when only one triangle uses it, opposite directions cancel out
+        u32* edgeCount = (u32*)calloc(numVertexes, sizeof *edgeCount);
+        u32* edgeOffsets = (u32*)calloc(numVertexes + 1, sizeof *edgeOffsets);
+        for(u32 i = 0; i < numTriangles * 3; i++) {
+            edgeOffsets[canonical[dst[i]] + 1]++;
+        }
+        for(u32 i = 0; i < numVertexes; i++) {
+            edgeOffsets[i + 1] += edgeOffsets[i];
+        }
+        u32* edgeTargets = (u32*)malloc(sizeof *edgeTargets * numTriangles * 3 + 1);
+        for(u32 i = 0; i < numTriangles * 3; i++) {
+            u32 a = canonical[dst[i]];
+            u32 b = canonical[dst[i - i % 3 + (i + 1) % 3]];
+            edgeTargets[edgeOffsets[a] + edgeCount[a]++] = b;
+        }
+        for(u32 a = 0; a < numVertexes; a++) {
+            for(u32 e = edgeOffsets[a]; e < edgeOffsets[a + 1]; e++) {
+                u32 b = edgeTargets[e];
+                u8 found = 0;
+                for(u32 r = edgeOffsets[b]; r < edgeOffsets[b + 1]; r++) {
+                    if(edgeTargets[r] == a) {
+                        found = 1;
+                        break;
+                    }
+                }
+                if(!found) {
+                    locked[a] = locked[b] = 1;
+                }
+            }
+        }
+        for(u32 i = 0; i < numVertexes; i++) {
+            if(locked[canonical[i]]) locked[i] = 1;
+        }
+        free(edgeCount);
+        free(edgeOffsets);
+        free(edgeTargets);
+    }
+
+    u32* remap = (u32*)malloc(sizeof *remap * numVertexes);
+    u8* touched = (u8*)malloc(sizeof *touched * numVertexes);
+    u32* adjacencyOffsets = (u32*)malloc(sizeof *adjacencyOffsets * (numVertexes + 1));
+    u32* adjacencyFill = (u32*)malloc(sizeof *adjacencyFill * numVertexes);
+    u32* adjacency = (u32*)malloc(sizeof *adjacency * numIndexes + 1);
+    SimplifyCollapse* collapses = (SimplifyCollapse*)malloc(sizeof *collapses * numIndexes + 1);
+
+    double maxError = 0.0;
+
+    while(numTriangles > targetTriangles) {
+        // Vertex to triangle adjacency of the current mesh
+        memset(adjacencyOffsets, 0, sizeof *adjacencyOffsets * (numVertexes + 1));
+        memset(adjacencyFill, 0, sizeof *adjacencyFill * numVertexes);
+        for(u32 i = 0; i < numTriangles * 3; i++) {
+            adjacencyOffsets[dst[i] + 1]++;
+        }
+        for(u32 i = 0; i < numVertexes; i++) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        for(u32 i = 0; i < numTriangles * 3; i++) {
+            u32 v = dst[i];
+            adjacency[adjacencyOffsets[v] + adjacencyFill[v]++] = i / 3;
+        }
+
+        // Every half edge starting from a free vertex is a candidate,
+        // the opposite direction comes from the neighbouring triangle
+        u32 numCollapses = 0;
+        for(u32 i = 0; i < numTriangles * 3; i++) {
+            u32 from = dst[i];
+            u32 to = dst[i - i % 3 + (i + 1) % 3];
+            if(locked[from]) continue;
+
+            Quadric q = quadrics[canonical[from]];
+            _quadric_add(&q, &quadrics[canonical[to]]);
+            collapses[numCollapses++] = (SimplifyCollapse){
+                .from = from,
+                .to = to,
+                .cost = _quadric_error(&q, _simplify_position(positions, stride, to)),
+            };
+        }
+        if(!numCollapses) break;
+
+        qsort(collapses, numCollapses, sizeof *collapses, _simplify_collapse_compare);
+
+        for(u32 i = 0; i < numVertexes; i++) {
+            remap[i] = i;
+        }
+        memset(touched, 0, sizeof *touched * numVertexes);
+
+        // Cheapest collapses first, each neighbourhood only once in a pass
+        u32 removed = 0;
+        u32 wanted = numTriangles - targetTriangles;
+        for(u32 c = 0; c < numCollapses && removed < wanted; c++) {
+            const SimplifyCollapse* collapse = &collapses[c];
+            if(touched[collapse->from] || touched[collapse->to]) continue;
+            if(_simplify_flips(dst, adjacencyOffsets, adjacency, positions, stride,
+                        collapse->from, collapse->to)) continue;
+
+            remap[collapse->from] = collapse->to;
+            _quadric_add(&quadrics[canonical[collapse->to]], &quadrics[canonical[collapse->from]]);
+
+            Quadric* q = &quadrics[canonical[collapse->to]];
+            if(q->weight > 0.0 && collapse->cost / q->weight > maxError) {
+                maxError = collapse->cost / q->weight;
+            }
+
+            for(u32 a = adjacencyOffsets[collapse->from]; a < adjacencyOffsets[collapse->from + 1]; a++) {
+                const u32* tri = &dst[adjacency[a] * 3];
+                if(tri[0] == collapse->to || tri[1] == collapse->to || tri[2] == collapse->to) {
+                    removed++;
+                }
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+            }
+        }
+        if(!removed) break;
+
+        // Remap and drop triangles that collapsed to a line
+        u32 write = 0;
+        for(u32 t = 0; t < numTriangles; t++) {
+            u32 a = remap[dst[t * 3 + 0]];
+            u32 b = remap[dst[t * 3 + 1]];
+            u32 c = remap[dst[t * 3 + 2]];
+            if(a == b || b == c || a == c) continue;
+            dst[write++] = a;
+            dst[write++] = b;
+            dst[write++] = c;
+        }
+        numTriangles = write / 3;
+    }
+
+    free(collapses);
+    free(adjacency);
+    free(adjacencyFill);
+    free(adjacencyOffsets);
+    free(touched);
+    free(remap);
+    free(locked);
+    free(quadrics);
+    free(wedges);
+    free(canonical);
+
+    if(resultError) *resultError = (float)sqrt(maxError);
+    return numTriangles * 3;
+}
+
+// Simplify each level from the previous one, lods[0] is the base mesh
+// Indexes of all levels are written back to back to dst which needs room for numIndexes * 2
+static u32
+meshsimplify_build_lods(MeshLod* lods, u32 maxLods, u32* dst, const u32* indexes, u32 numIndexes,
+        const float* positions, u32 stride, u32 numVertexes) {
+
+    static const float ratios[MESH_MAX_LODS] = {1.f, 0.5f, 0.25f, 0.1f};
+
+    memcpy(dst, indexes, sizeof *indexes * numIndexes);
+    lods[0] = (MeshLod){.firstIndex = 0, .numIndexes = numIndexes, .error = 0.f};
+    u32 numLods = 1;
+    u32 written = numIndexes;
+
+    for(u32 i = 1; i < maxLods && i < MESH_MAX_LODS; i++) {
+        const MeshLod* prev = &lods[numLods - 1];
+        u32 target = (u32)(numIndexes / 3 * ratios[i]) * 3;
+        if(target >= prev->numIndexes) continue;
+
+        float error;
+        u32 count = meshsimplify(&dst[written], &dst[prev->firstIndex], prev->numIndexes,
+                positions, stride, numVertexes, target, &error);
+        // stuck on locked vertexes, level would be the same as previous
+        if(count >= prev->numIndexes) break;
+
+        lods[numLods++] = (MeshLod){
+            .firstIndex = written,
+            .numIndexes = count,
+            .error = maxf(error, prev->error),
+        };
+        written += count;
+    }
+    return numLods;
+}
+
+// Coarsest level whose error stays under pixelThreshold on screen
+// projectionScale is projection[1][1] * viewportHeight / 2
+static u32
+meshlod_select(const MeshLod* lods, u32 numLods, float distance, float projectionScale,
+        float pixelThreshold) {
+
+    if(distance <= 0.f) return 0;
+    u32 ret = 0;
+    for(u32 i = 1; i < numLods; i++) {
+        float pixels = lods[i].error / distance * projectionScale;
+        if(pixels > pixelThreshold) break;
+        ret = i;
+    }
+    return ret;
+}
+
+#endif /* MESHSIMPLIFY_H */
@@ -0,0 +1,377 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Mip chain of an rgba8 srgb image built on cpu with a 2x2 box filter in linear space.
+// Levels after the first are kept in linear float between passes so only the
+// source is converted from srgb, rows of a level are split to bands for jobs.h, or for
+// helpers in the thread pool when it has no job system like in the tools.
+// Finished chain can be cached to disk next to the source.
+
+#ifndef MIPGEN_H
+#define MIPGEN_H
+
+#include "utils.h"
+#include "cmath.h"
+#include "threadpool.h"
+#include "jobs.h"
+#include "pack.h"
+
+#define MIPGEN_MAX_LEVELS 16
+#define MIPGEN_BAND_ROWS 32
+// linear to srgb table, fine enough that darkest srgb steps do not merge
+#define MIPGEN_LUT_SIZE 16384
+#define MIPGEN_CACHE_MAGIC 0x4350494D // "MIPC"
+#define MIPGEN_CACHE_VERSION 1
+
+typedef struct MipChain {
+    u8*         data;       // every level rgba8, largest first
+    size_t      size;
+    u32         width, height;
+    u32         mipLevels;
+    size_t      offsets[MIPGEN_MAX_LEVELS];
+} MipChain;
+
+// Source file is stored so that an edited image does not use stale mips
+typedef struct MipCacheHeader {
+    u32     magic;
+    u32     version;
+    u64     sourceSize;
+    i64     sourceTime;
+    u32     width, height;
+    u32     mipLevels;
+    u32     padding;
+} MipCacheHeader;
+
+static float    g_mipgenToLinear[256];
+static u8       g_mipgenToSrgb[MIPGEN_LUT_SIZE];
+static u8       g_mipgenTablesDone = 0;
+
+// Call once before any mipchain_build, workers only read the tables
+static void
+mipgen_init() {
+    if(g_mipgenTablesDone) return;
+    for(u32 i = 0; i < 256; i++) {
+        float c = (float)i / 255.f;
+        g_mipgenToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for(u32 i = 0; i < MIPGEN_LUT_SIZE; i++) {
+        float c = (float)i / (float)(MIPGEN_LUT_SIZE - 1);
+        c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+        g_mipgenToSrgb[i] = (u8)(c * 255.f + 0.5f);
+    }
+    g_mipgenTablesDone = 1;
+}
+
+static inline u32
+mipgen_levels(u32 width, u32 height) {
+    u32 ret = (u32)(floorf(log2f(max_u32(width, height)))) + 1;
+    return ret > MIPGEN_MAX_LEVELS ? MIPGEN_MAX_LEVELS : ret;
+}
+
+// Offsets and size of every level, data is left alone
+static void
+mipchain_layout(MipChain* chain, u32 width, u32 height, u32 mipLevels) {
+
+    chain->width = width;
+    chain->height = height;
+    chain->mipLevels = mipLevels;
+    size_t size = 0;
+    for(u32 i = 0; i < mipLevels; i++) {
+        chain->offsets[i] = size;
+        size += (size_t)width * height * 4;
+        if(width > 1) width /= 2;
+        if(height > 1) height /= 2;
+    }
+    chain->size = size;
+}
+
+static void
+_mipchain_alloc(MipChain* chain, u32 width, u32 height, u32 mipLevels) {
+    mipchain_layout(chain, width, height, mipLevels);
+    chain->data = (u8*)malloc(chain->size);
+}
+
+// Average of four linear pixels to linear float and srgb bytes, linear may be NULL on last level
+static inline void
+_mipgen_store(float* linear, u8* dst, const float* a, const float* b, const float* c, const float* d) {
+#if defined(CMATH_SSE)
+    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)),
+            _mm_add_ps(_mm_loadu_ps(c), _mm_loadu_ps(d)));
+    sum = _mm_mul_ps(sum, _mm_set1_ps(0.25f));
+    if(linear) _mm_storeu_ps(linear, sum);
+    // rgb index the srgb table, alpha stays linear
+    const __m128 scale = _mm_setr_ps(MIPGEN_LUT_SIZE - 1, MIPGEN_LUT_SIZE - 1, MIPGEN_LUT_SIZE - 1, 255.f);
+    i32 index[4];
+    _mm_storeu_si128((__m128i*)index, _mm_cvtps_epi32(_mm_mul_ps(sum, scale)));
+#elif defined(CMATH_NEON)
+    float32x4_t sum = vaddq_f32(vaddq_f32(vld1q_f32(a), vld1q_f32(b)), vaddq_f32(vld1q_f32(c), vld1q_f32(d)));
+    sum = vmulq_n_f32(sum, 0.25f);
+    if(linear) vst1q_f32(linear, sum);
+    const float scaleData[4] = {MIPGEN_LUT_SIZE - 1, MIPGEN_LUT_SIZE - 1, MIPGEN_LUT_SIZE - 1, 255.f};
+    i32 index[4];
+    vst1q_s32(index, vcvtq_s32_f32(vaddq_f32(vmulq_f32(sum, vld1q_f32(scaleData)), vdupq_n_f32(0.5f))));
+#else
+    float sum[4];
+    for(u32 i = 0; i < 4; i++) sum[i] = (a[i] + b[i] + c[i] + d[i]) * 0.25f;
+    if(linear) memcpy(linear, sum, sizeof sum);
+    i32 index[4];
+    for(u32 i = 0; i < 3; i++) index[i] = (i32)(sum[i] * (MIPGEN_LUT_SIZE - 1) + 0.5f);
+    index[3] = (i32)(sum[3] * 255.f + 0.5f);
+#endif
+    dst[0] = g_mipgenToSrgb[index[0]];
+    dst[1] = g_mipgenToSrgb[index[1]];
+    dst[2] = g_mipgenToSrgb[index[2]];
+    dst[3] = (u8)index[3];
+}
+
+static inline void
+_mipgen_to_linear(const u8* src, float* dst) {
+    dst[0] = g_mipgenToLinear[src[0]];
+    dst[1] = g_mipgenToLinear[src[1]];
+    dst[2] = g_mipgenToLinear[src[2]];
+    dst[3] = (float)src[3] * (1.f / 255.f);
+}
+
+// One level of work, either from srgb source or from linear floats of previous level
+typedef struct MipgenLevel {
+    const u8*       srcBytes;
+    const float*    srcLinear;
+    u32             srcWidth, srcHeight;
+    float*          dstLinear;
+    u8*             dst;
+    u32             dstWidth, dstHeight;
+
+    Mutex           lock;
+    ConditionVariable done;
+    u32             nextBand, numBands, bandsDone;
+    u32             refs;       // helpers still holding this, last one frees
+} MipgenLevel;
+
+static void
+_mipgen_band(const MipgenLevel* level, u32 band) {
+
+    u32 rowStart = band * MIPGEN_BAND_ROWS;
+    u32 rowEnd = min_u32(rowStart + MIPGEN_BAND_ROWS, level->dstHeight);
+    u32 sw = level->srcWidth, dw = level->dstWidth;
+    // odd sizes reuse the last row and column
+    for(u32 y = rowStart; y < rowEnd; y++) {
+        u32 y0 = min_u32(y * 2, level->srcHeight - 1), y1 = min_u32(y * 2 + 1, level->srcHeight - 1);
+        float* linear = level->dstLinear ? &level->dstLinear[(size_t)y * dw * 4] : NULL;
+        u8* dst = &level->dst[(size_t)y * dw * 4];
+
+        if(level->srcLinear) {
+            const float* row0 = &level->srcLinear[(size_t)y0 * sw * 4];
+            const float* row1 = &level->srcLinear[(size_t)y1 * sw * 4];
+            for(u32 x = 0; x < dw; x++) {
+                u32 x0 = min_u32(x * 2, sw - 1) * 4, x1 = min_u32(x * 2 + 1, sw - 1) * 4;
+                _mipgen_store(linear ? linear + x * 4 : NULL, dst + x * 4,
+                        row0 + x0, row0 + x1, row1 + x0, row1 + x1);
+            }
+        } else {
+            const u8* row0 = &level->srcBytes[(size_t)y0 * sw * 4];
+            const u8* row1 = &level->srcBytes[(size_t)y1 * sw * 4];
+            for(u32 x = 0; x < dw; x++) {
+                u32 x0 = min_u32(x * 2, sw - 1) * 4, x1 = min_u32(x * 2 + 1, sw - 1) * 4;
+                float p[4][4];
+                _mipgen_to_linear(row0 + x0, p[0]);
+                _mipgen_to_linear(row0 + x1, p[1]);
+                _mipgen_to_linear(row1 + x0, p[2]);
+                _mipgen_to_linear(row1 + x1, p[3]);
+                _mipgen_store(linear ? linear + x * 4 : NULL, dst + x * 4, p[0], p[1], p[2], p[3]);
+            }
+        }
+    }
+}
+
+static void
+_mipgen_release(MipgenLevel* level) {
+    mutex_lock(&level->lock);
+    u32 refs = --level->refs;
+    mutex_unlock(&level->lock);
+    if(refs) return;
+    condition_dispose(&level->done);
+    mutex_dispose(&level->lock);
+    free(level);
+}
+
+// Take bands until none are left, caller and helpers run this same loop
+static void
+_mipgen_work(MipgenLevel* level) {
+    for(;;) {
+        mutex_lock(&level->lock);
+        u32 band = level->nextBand++;
+        mutex_unlock(&level->lock);
+        if(band >= level->numBands) break;
+
+        _mipgen_band(level, band);
+
+        mutex_lock(&level->lock);
+        if(++level->bandsDone == level->numBands) {
+            condition_broadcast(&level->done);
+        }
+        mutex_unlock(&level->lock);
+    }
+}
+
+static void
+_mipgen_helper_job(void* data) {
+    MipgenLevel* level = (MipgenLevel*)data;
+    _mipgen_work(level);
+    _mipgen_release(level);
+}
+
+static void
+_mipgen_bands(void* data, u32 first, u32 count) {
+    for(u32 band = first; band < first + count; band++) {
+        _mipgen_band((const MipgenLevel*)data, band);
+    }
+}
+
+// Calling thread works too so this is safe to call from a pool job, helpers that start
+// late find no bands left and only drop their reference
+static void
+_mipgen_level(MipgenLevel* level, ThreadPool* threads) {
+
+    level->numBands = (level->dstHeight + MIPGEN_BAND_ROWS - 1) / MIPGEN_BAND_ROWS;
+    if(threads && threads == g_jobs.pool && jobs_in_worker(&g_jobs)) {
+        jobs_parallel_for(&g_jobs, level->numBands, 1, _mipgen_bands, level);
+        free(level);
+        return;
+    }
+    level->refs = 1;
+    mutex_init(&level->lock);
+    condition_init(&level->done);
+
+    u32 numHelpers = threads ? min_u32(threads->numThreads, level->numBands - 1) : 0;
+    level->refs += numHelpers;
+    for(u32 i = 0; i < numHelpers; i++) {
+        threadpool_push(threads, _mipgen_helper_job, level);
+    }
+
+    _mipgen_work(level);
+    mutex_lock(&level->lock);
+    while(level->bandsDone < level->numBands) {
+        condition_wait(&level->done, &level->lock);
+    }
+    mutex_unlock(&level->lock);
+    _mipgen_release(level);
+}
+
+// First maxLevels of the chain from rgba8 srgb pixels, threads may be NULL
+static void
+mipchain_build_levels(MipChain* chain, const u8* pixels, u32 width, u32 height, u32 maxLevels,
+        ThreadPool* threads) {
+
+    ASSERT_MESSAGE(g_mipgenTablesDone, "mipgen_init has not been called");
+    _mipchain_alloc(chain, width, height, min_u32(mipgen_levels(width, height), maxLevels));
+    memcpy(chain->data, pixels, (size_t)width * height * 4);
+
+    // ping pong linear levels, second buffer is only needed from level 2 on
+    u32 w1 = width > 1 ? width / 2 : 1, h1 = height > 1 ? height / 2 : 1;
+    float* linear[2] = {NULL, NULL};
+    if(chain->mipLevels > 2) {
+        linear[0] = (float*)malloc(sizeof(float) * 4 * w1 * h1);
+        linear[1] = (float*)malloc(sizeof(float) * 4 * max_u32(w1 / 2, 1) * max_u32(h1 / 2, 1));
+    }
+
+    u32 srcWidth = width, srcHeight = height;
+    for(u32 i = 1; i < chain->mipLevels; i++) {
+        MipgenLevel* level = (MipgenLevel*)calloc(1, sizeof *level);
+        level->srcBytes = i == 1 ? pixels : NULL;
+        level->srcLinear = i == 1 ? NULL : linear[(i - 2) % 2];
+        level->srcWidth = srcWidth;
+        level->srcHeight = srcHeight;
+        level->dstWidth = srcWidth > 1 ? srcWidth / 2 : 1;
+        level->dstHeight = srcHeight > 1 ? srcHeight / 2 : 1;
+        level->dstLinear = i + 1 < chain->mipLevels ? linear[(i - 1) % 2] : NULL;
+        level->dst = chain->data + chain->offsets[i];
+
+        srcWidth = level->dstWidth;
+        srcHeight = level->dstHeight;
+        _mipgen_level(level, threads);
+    }
+    free(linear[0]);
+    free(linear[1]);
+}
+
+// Whole chain from rgba8 srgb pixels, threads may be NULL
+static void
+mipchain_build(MipChain* chain, const u8* pixels, u32 width, u32 height, ThreadPool* threads) {
+    mipchain_build_levels(chain, pixels, width, height, MIPGEN_MAX_LEVELS, threads);
+}
+
+static void
+mipchain_dispose(MipChain* chain) {
+    free(chain->data);
+    memset(chain, 0, sizeof *chain);
+}
+
+static u8
+_mipgen_source_stat(const char* sourcePath, u64* size, i64* time) {
+    // packed source has time of the file it was packed from
+    return vfs_stat(sourcePath, size, time);
+}
+
+// Header of cache if it exists and was made from current version of source
+static u8
+mipchain_cache_header(const char* cachePath, const char* sourcePath, MipCacheHeader* header) {
+
+    u64 sourceSize;
+    i64 sourceTime;
+    if(!_mipgen_source_stat(sourcePath, &sourceSize, &sourceTime)) return 0;
+
+    FILE* fp = fopen(cachePath, "rb");
+    if(!fp) return 0;
+    u8 valid = fread(header, sizeof *header, 1, fp) == 1 &&
+        header->magic == MIPGEN_CACHE_MAGIC && header->version == MIPGEN_CACHE_VERSION &&
+        header->sourceSize == sourceSize && header->sourceTime == sourceTime &&
+        header->mipLevels == mipgen_levels(header->width, header->height);
+    fclose(fp);
+    return valid;
+}
+
+// Levels [firstMip, mipLevels) of a cache to dst, they are stored one after another
+static u8
+mipchain_cache_read_levels(const char* cachePath, const MipChain* layout, u32 firstMip, u8* dst) {
+
+    size_t size = layout->size - layout->offsets[firstMip];
+    return file_read_range(cachePath, sizeof(MipCacheHeader) + layout->offsets[firstMip], size, dst);
+}
+
+// Loads chain if cache exists and was made from current version of source
+static u8
+mipchain_cache_load(MipChain* chain, const char* cachePath, const char* sourcePath) {
+
+    MipCacheHeader header;
+    if(!mipchain_cache_header(cachePath, sourcePath, &header)) return 0;
+    _mipchain_alloc(chain, header.width, header.height, header.mipLevels);
+    if(!mipchain_cache_read_levels(cachePath, chain, 0, chain->data)) {
+        mipchain_dispose(chain);
+        return 0;
+    }
+    return 1;
+}
+
+static void
+mipchain_cache_save(const MipChain* chain, const char* cachePath, const char* sourcePath) {
+
+    MipCacheHeader header = {};
+    if(!_mipgen_source_stat(sourcePath, &header.sourceSize, &header.sourceTime)) return;
+    header.magic = MIPGEN_CACHE_MAGIC;
+    header.version = MIPGEN_CACHE_VERSION;
+    header.width = chain->width;
+    header.height = chain->height;
+    header.mipLevels = chain->mipLevels;
+
+    FILE* fp = fopen(cachePath, "wb");
+    if(!fp) {
+        LOG("Could not write mip cache %s", cachePath);
+        return;
+    }
+    fwrite(&header, sizeof header, 1, fp);
+    fwrite(chain->data, chain->size, 1, fp);
+    fclose(fp);
+}
+
+#endif /* MIPGEN_H */
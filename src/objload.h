@@ -10,6 +10,7 @@
 #include "cmath.h"
 #include "dynamicArray.h"
 #include "hash_table.h"
+#include "pack.h"
 
 typedef struct Vertex {
     vec3    pos;
@@ -32,6 +33,15 @@ typedef struct ObjElementIndex {
 DECLARE_HASHTABLEKEY(Vertex, Vertex);
 DECLARE_HASHTABLE( VertexKey, Vertex, vertex);
 
+// Arguments after keyword at start of line, NULL if line is something else
+static const char*
+_obj_keyword(const char* line, const char* keyword) {
+    while (*line == ' ' || *line == '\t') line++;
+    size_t length = strlen(keyword);
+    if (strncmp(line, keyword, length) || (line[length] != ' ' && line[length] != '\t')) return NULL;
+    return line + length + 1;
+}
+
 static VertexLoadData
 obj_load(const char* name) {
 
@@ -41,42 +51,71 @@ obj_load(const char* name) {
     vec2* uvBuffer = (vec2*)dynamicarray_create(sizeof(vec2));
     ObjElementIndex* indexBuffer = (ObjElementIndex*)dynamicarray_create(sizeof(ObjElementIndex));
 
-    FILE* f = fopen(name, "r");
-    if(!f) {
+    VfsFile file;
+    if(!vfs_open(name, &file)) {
         ABORT("Failed to open model file");
     }
 
-    char buffer[255];
-    int end = fscanf(f, "%s", buffer);
-    while (end != EOF) {
-        if (!strcmp("v", buffer)) {
+    // Parsed a line at a time from memory, file may be in pack and is not zero terminated.
+    // Line buffer grows for long lines, tokens can be separated by spaces or tabs
+    u32 capacity = 256;
+    char* line = (char*)malloc(capacity);
+    size_t cursor = 0;
+    u32 lineNumber = 0;
+    while (cursor < file.size) {
+        u32 length = 0;
+        lineNumber++;
+        while (cursor < file.size && file.data[cursor] != '\n') {
+            if (length + 1 == capacity) {
+                capacity *= 2;
+                line = (char*)realloc(line, capacity);
+            }
+            line[length++] = (char)file.data[cursor];
+            cursor++;
+        }
+        cursor++;
+        line[length] = 0;
+
+        const char* args;
+        if ((args = _obj_keyword(line, "v"))) {
             // read vertex
             vec3 temp;
-            int matches = fscanf(f, "%f %f %f\n", &temp.x, &temp.y, &temp.z);
+            int matches = sscanf(args, "%f %f %f", &temp.x, &temp.y, &temp.z);
             ASSERT_MESSAGE(matches == 3,"Vertex does not have enough matches!");
             dynamicarray_push_back(vertexBuffer, &temp);
         }
 
-        if (!strcmp("vt", buffer)) {
+        if ((args = _obj_keyword(line, "vt"))) {
             // read vertex
             vec2 temp;
-            int matches = fscanf(f, "%f %f\n", &temp.x, &temp.y);
+            int matches = sscanf(args, "%f %f", &temp.x, &temp.y);
             ASSERT_MESSAGE(matches == 2,"Uv does not have enough matches!");
             temp.y = 1.f - temp.y;
             dynamicarray_push_back(uvBuffer, &temp);
         }
 
-        if (!strcmp("f", buffer)) {
+        if ((args = _obj_keyword(line, "f"))) {
             // read index buffer for 3 vertexes
-            ObjElementIndex temp;
+            ObjElementIndex temp[3];
+            int matches = sscanf(args, "%d/%d %d/%d %d/%d", &temp[0].vert, &temp[0].uv,
+                    &temp[1].vert, &temp[1].uv, &temp[2].vert, &temp[2].uv);
+            if (matches != 6) {
+                ABORT("Face of %s line %u is not a v/vt triangle", name, lineNumber);
+            }
+            // indexes are one based and refer to vertexes and uvs before the face
+            int numPositions = (int)dynamicarray_size(vertexBuffer);
+            int numUvs = (int)dynamicarray_size(uvBuffer);
             for(u32 i = 0 ; i < 3; i++) {
-                int matches = fscanf(f, "%d/%d\n", &temp.vert, &temp.uv);
-                ASSERT_MESSAGE(matches == 2,"Indexes does not have enough matches!");
-                dynamicarray_push_back(indexBuffer, &temp);
+                if (temp[i].vert < 1 || temp[i].vert > numPositions || temp[i].uv < 1 || temp[i].uv > numUvs) {
+                    ABORT("Face of %s line %u refers to vertex %d uv %d, file has %d vertexes %d uvs so far",
+                            name, lineNumber, temp[i].vert, temp[i].uv, numPositions, numUvs);
+                }
+                dynamicarray_push_back(indexBuffer, &temp[i]);
             }
         }
-        end = fscanf(f, "%s", buffer);
     }
+    free(line);
+    vfs_close(&file);
     u32 numIndexes = dynamicarray_size(indexBuffer);
     ret.vertexes = malloc(sizeof(Vertex) * numIndexes);
     ret.indexes = malloc(sizeof(int) * numIndexes);
@@ -88,8 +127,8 @@ obj_load(const char* name) {
     ASSERT_MESSAGE(hashmap_find_primeindex(1300) == 5, "Failed to find map prime");
     vertex_hashtable_init(&table, sizeof(int), hashmap_find_primeindex(numIndexes));
 
+    // same position and uv is one vertex, indexes were checked while parsing
     u32 numVertexes = 0;
-#if 1
     for(u32 i = 0; i < numIndexes; i++) {
         Vertex vert = {
             .pos = vertexBuffer[indexBuffer[i].vert - 1],
@@ -108,25 +147,14 @@ obj_load(const char* name) {
         }
         ret.indexes[i] = realIndex;
     }
-#else
-    for(u32 i = 0; i < numIndexes; i++) {
-        //printf("index %d %d\n", indexBuffer[i].vert , indexBuffer[i].uv);fflush(stdout);
-        //if(indexBuffer[i].vert == 0 || i > 100) ABORT("RE");
-        ret.vertexes[i].pos = vertexBuffer[indexBuffer[i].vert - 1];
-        ret.vertexes[i].uv = uvBuffer[indexBuffer[i].uv - 1];
-        ret.indexes[i] = i;
-    }
-#endif
     ret.numVertexes = numVertexes;
 
+    vertex_hashtable_dispose(&table);
     dynamicarray_dispose(vertexBuffer);
     dynamicarray_dispose(indexBuffer);
     dynamicarray_dispose(uvBuffer);
-
-    fclose(f);
     return ret;
 }
 
 // TODO free obj memory
-// TODO map memory
 #endif /* OBJLOAD_H */
@@ -0,0 +1,502 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Hierarchical-Z occlusion culling
+// Depth of the last frame is reduced to a max depth mip pyramid at the end of the frame.
+// Before the next frame draws, every object's bounding sphere is projected to screen and tested
+// against the pyramid level where the projection covers at most 2x2 texels.
+// Visible objects get an indirect draw command with one instance, hidden ones zero instances.
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+#include "buffer.h"
+#include "texture.h"
+#include "pipeline.h"
+#include "drawList.h"
+#include "descriptorAllocator.h"
+#include "profiler.h"
+
+static const u8 enableOcclusionCulling = 1;
+
+#define OCCLUSION_REDUCE_GROUP_SIZE 8
+#define OCCLUSION_CULL_GROUP_SIZE 64
+#define OCCLUSION_SETS_PER_POOL 16
+
+typedef struct OcclusionStats {
+    u32     visible;
+    u32     culled;
+} OcclusionStats;
+
+typedef struct OcclusionCuller {
+    Texture                 pyramid;        // R32 max depth, one mip per reduction
+    VkImageView*            mipViews;
+    VkExtent2D*             mipExtents;
+
+    VkDescriptorSetLayout   reduceLayout;
+    VkPipelineLayout        reducePipelineLayout;
+    VkPipeline              reducePipeline;
+    VkDescriptorSet*        reduceSets;     // one per mip
+
+    VkDescriptorSetLayout   cullLayout;
+    VkPipelineLayout        cullPipelineLayout;
+    VkPipeline              cullPipeline;
+
+    DescriptorAllocator     descriptors;    // reduce sets persistent, cull sets transient
+    Buffer*                 statsBuffers;   // one per swapchain image
+    u32                     numImages;
+
+    OcclusionStats          lastStats;
+} OcclusionCuller;
+
+typedef struct OcclusionReduceConstants {
+    i32     srcSize[2];
+    i32     dstSize[2];
+} OcclusionReduceConstants;
+
+static VkSampler
+_occlusion_create_sampler(VkDevice device) {
+
+    SamplerDesc desc;
+    memset(&desc, 0, sizeof desc);
+    // Depth values can not be filtered, take exact texels
+    desc.magFilter = VK_FILTER_NEAREST;
+    desc.minFilter = VK_FILTER_NEAREST;
+    desc.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    desc.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    desc.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    desc.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    desc.anisotropyEnable = VK_FALSE;
+    desc.maxAnisotropy = 1.f;
+    desc.unnormalizedCoordinates = VK_FALSE;
+    desc.compareEnable = VK_FALSE;
+    desc.compareOp = VK_COMPARE_OP_ALWAYS;
+    desc.minLod = 0.f;
+    desc.maxLod = VK_LOD_CLAMP_NONE;
+
+    return sampler_get(device, &desc);
+}
+
+// Pyramid is kept in general layout for its whole life and cleared to far plane so first frame culls nothing
+static void
+_occlusion_pyramid_clear(OcclusionCuller* culler, VkDevice device, VkCommandPool pool, VkQueue graphicsQue) {
+
+    VkCommandBuffer cmd = commandbuffer_begin_single_time(device, pool);
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = culler->pyramid.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = culler->pyramid.mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, NULL,
+            0, NULL,
+            1, &barrier);
+
+    VkClearColorValue far = {.float32 = {1.f, 1.f, 1.f, 1.f}};
+    vkCmdClearColorImage(cmd, culler->pyramid.image, VK_IMAGE_LAYOUT_GENERAL,
+            &far, 1, &barrier.subresourceRange);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, NULL,
+            0, NULL,
+            1, &barrier);
+
+    commandbuffer_end_single_time(device, cmd, pool, graphicsQue);
+}
+
+static void
+_occlusion_create_layouts(OcclusionCuller* culler, VkDevice device) {
+
+    { // reduce: previous level (or depth) in, next level out
+        VkDescriptorSetLayoutBinding bindings[2] = {};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layout = {};
+        layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout.bindingCount = SIZEOF_ARRAY(bindings);
+        layout.pBindings = bindings;
+
+        if(vkCreateDescriptorSetLayout(device, &layout, NULL, &culler->reduceLayout) != VK_SUCCESS) {
+            ABORT("Failed to create reduce descriptor layout");
+        }
+
+        VkPushConstantRange range = {};
+        range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        range.offset = 0;
+        range.size = sizeof(OcclusionReduceConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayout = {};
+        pipelineLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayout.setLayoutCount = 1;
+        pipelineLayout.pSetLayouts = &culler->reduceLayout;
+        pipelineLayout.pushConstantRangeCount = 1;
+        pipelineLayout.pPushConstantRanges = &range;
+
+        if(vkCreatePipelineLayout(device, &pipelineLayout, NULL, &culler->reducePipelineLayout) != VK_SUCCESS) {
+            ABORT("Failed to create reduce pipeline layout");
+        }
+    }
+
+    { // cull: objects, commands, stats and pyramid
+        VkDescriptorSetLayoutBinding bindings[4] = {};
+        for(u32 i = 0; i < 3; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        bindings[3].binding = 3;
+        bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[3].descriptorCount = 1;
+        bindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layout = {};
+        layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout.bindingCount = SIZEOF_ARRAY(bindings);
+        layout.pBindings = bindings;
+
+        if(vkCreateDescriptorSetLayout(device, &layout, NULL, &culler->cullLayout) != VK_SUCCESS) {
+            ABORT("Failed to create cull descriptor layout");
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayout = {};
+        pipelineLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayout.setLayoutCount = 1;
+        pipelineLayout.pSetLayouts = &culler->cullLayout;
+
+        if(vkCreatePipelineLayout(device, &pipelineLayout, NULL, &culler->cullPipelineLayout) != VK_SUCCESS) {
+            ABORT("Failed to create cull pipeline layout");
+        }
+    }
+}
+
+static void
+_occlusion_create_descriptors(OcclusionCuller* culler, VkDevice device, const Texture* depth) {
+
+    u32 numMips = culler->pyramid.mipLevels;
+
+    // enough for either layout, 3 buffers and pyramid for cull or 2 images for reduce
+    VkDescriptorPoolSize sizes[3] = {};
+    sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sizes[0].descriptorCount = 1;
+    sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    sizes[1].descriptorCount = 1;
+    sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sizes[2].descriptorCount = 3;
+    descriptorallocator_init(&culler->descriptors, device, sizes, SIZEOF_ARRAY(sizes),
+            OCCLUSION_SETS_PER_POOL, 0 /*flags*/, MAX_FRAMES_IN_FLIGHT);
+
+    culler->reduceSets = (VkDescriptorSet*)malloc(sizeof *culler->reduceSets * numMips);
+
+    for(u32 i = 0; i < numMips; i++) {
+        culler->reduceSets[i] = descriptorallocator_allocate(&culler->descriptors, culler->reduceLayout);
+
+        // First level is a copy of the depth attachment, others reduce previous level
+        VkDescriptorImageInfo srcInfo = {};
+        srcInfo.sampler = culler->pyramid.sampler;
+        if(i == 0) {
+            srcInfo.imageView = depth->view;
+            srcInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        } else {
+            srcInfo.imageView = culler->mipViews[i - 1];
+            srcInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        VkDescriptorImageInfo dstInfo = {};
+        dstInfo.imageView = culler->mipViews[i];
+        dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet writes[2] = {};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = culler->reduceSets[i];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &srcInfo;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = culler->reduceSets[i];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &dstInfo;
+
+        vkUpdateDescriptorSets(device, SIZEOF_ARRAY(writes), writes, 0, NULL);
+    }
+}
+
+// Cull set of the frame, comes from the frame pool so nothing is kept per swapchain image
+static VkDescriptorSet
+_occlusion_cull_set(OcclusionCuller* culler, VkDevice device, const DrawList* drawList, u32 imageIndex) {
+
+    VkDescriptorSet set = descriptorallocator_allocate_transient(&culler->descriptors, culler->cullLayout);
+
+    VkDescriptorBufferInfo bufferInfos[3] = {};
+    bufferInfos[0].buffer = drawList->objectBuffers[imageIndex].bufferId;
+    bufferInfos[0].range = drawList->objectBuffers[imageIndex].size;
+    bufferInfos[1].buffer = drawList->indirectBuffers[imageIndex].bufferId;
+    bufferInfos[1].range = drawList->indirectBuffers[imageIndex].size;
+    bufferInfos[2].buffer = culler->statsBuffers[imageIndex].bufferId;
+    bufferInfos[2].range = culler->statsBuffers[imageIndex].size;
+
+    VkDescriptorImageInfo pyramidInfo = {};
+    pyramidInfo.sampler = culler->pyramid.sampler;
+    pyramidInfo.imageView = culler->pyramid.view;
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet writes[4] = {};
+    for(u32 b = 0; b < 3; b++) {
+        writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[b].dstSet = set;
+        writes[b].dstBinding = b;
+        writes[b].descriptorCount = 1;
+        writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[b].pBufferInfo = &bufferInfos[b];
+    }
+    writes[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[3].dstSet = set;
+    writes[3].dstBinding = 3;
+    writes[3].descriptorCount = 1;
+    writes[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[3].pImageInfo = &pyramidInfo;
+
+    vkUpdateDescriptorSets(device, SIZEOF_ARRAY(writes), writes, 0, NULL);
+    return set;
+}
+
+static void
+occlusion_init(OcclusionCuller* culler, const Texture* depth, const DrawList* drawList,
+        VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool pool, VkQueue graphicsQue) {
+
+    PROFILE_FUNCTION();
+    culler->numImages = drawList->numBuffers;
+
+    culler->pyramid = texture_create(physicalDevice, device, VK_FORMAT_R32_SFLOAT,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            depth->width, depth->height, TextureSample | TextureMipmap);
+
+    u32 numMips = culler->pyramid.mipLevels;
+    culler->pyramid.view = imageview_create(culler->pyramid.image, numMips,
+            VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, device);
+    culler->pyramid.sampler = _occlusion_create_sampler(device);
+
+    // Separate view for each mip so they can be written and read as individual images
+    culler->mipViews = (VkImageView*)malloc(sizeof *culler->mipViews * numMips);
+    culler->mipExtents = (VkExtent2D*)malloc(sizeof *culler->mipExtents * numMips);
+    for(u32 i = 0; i < numMips; i++) {
+        VkImageViewCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        info.image = culler->pyramid.image;
+        info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        info.format = VK_FORMAT_R32_SFLOAT;
+        info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        info.subresourceRange.baseMipLevel = i;
+        info.subresourceRange.levelCount = 1;
+        info.subresourceRange.baseArrayLayer = 0;
+        info.subresourceRange.layerCount = 1;
+
+        if(vkCreateImageView(device, &info, NULL, &culler->mipViews[i]) != VK_SUCCESS) {
+            ABORT("Failed to create pyramid mip view");
+        }
+
+        culler->mipExtents[i].width = max_u32(depth->width >> i, 1);
+        culler->mipExtents[i].height = max_u32(depth->height >> i, 1);
+    }
+
+    culler->statsBuffers = (Buffer*)malloc(sizeof *culler->statsBuffers * culler->numImages);
+    for(u32 i = 0; i < culler->numImages; i++) {
+        culler->statsBuffers[i] = buffer_create(physicalDevice, device, sizeof(OcclusionStats),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, // usage
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT); // properties
+
+        // stats can be read before the image is submitted first time
+        void* data;
+        vkMapMemory(device, culler->statsBuffers[i].bufferMemory, 0, sizeof(OcclusionStats), 0, &data);
+        memset(data, 0, sizeof(OcclusionStats));
+        vkUnmapMemory(device, culler->statsBuffers[i].bufferMemory);
+    }
+
+    _occlusion_create_layouts(culler, device);
+    culler->reducePipeline = computepipeline_create("shaders/hiz_reduce_comp.spv",
+            culler->reducePipelineLayout, device);
+    culler->cullPipeline = computepipeline_create("shaders/occlusion_cull_comp.spv",
+            culler->cullPipelineLayout, device);
+
+    _occlusion_create_descriptors(culler, device, depth);
+    _occlusion_pyramid_clear(culler, device, pool, graphicsQue);
+    culler->lastStats = (OcclusionStats){};
+}
+
+// Record before the renderpass, writes indirect commands of the objects in the drawlist.
+// Frame pools of the culler must have been reset with descriptorallocator_begin_frame
+static void
+occlusion_record_cull(OcclusionCuller* culler, VkCommandBuffer cmd, u32 imageIndex, const DrawList* drawList,
+        VkDevice device) {
+
+    VkDescriptorSet cullSet = _occlusion_cull_set(culler, device, drawList, imageIndex);
+
+    vkCmdFillBuffer(cmd, culler->statsBuffers[imageIndex].bufferId, 0, sizeof(OcclusionStats), 0);
+
+    // Stats are cleared, last frame has finished reading commands and pyramid is written
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1, &barrier,
+            0, NULL,
+            0, NULL);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culler->cullPipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culler->cullPipelineLayout,
+            0, 1, &cullSet, 0, NULL);
+    // only slots the draw reads, empty list clears the stats and dispatches nothing
+    u32 numObjects = drawList->header.numObjects;
+    if(numObjects) {
+        vkCmdDispatch(cmd, (numObjects + OCCLUSION_CULL_GROUP_SIZE - 1) / OCCLUSION_CULL_GROUP_SIZE, 1, 1);
+    }
+
+    // Commands are consumed by the draw and stats by the host
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            1, &barrier,
+            0, NULL,
+            0, NULL);
+}
+
+// Record after the renderpass, depth attachment must be in depth read only layout
+static void
+occlusion_record_pyramid(const OcclusionCuller* culler, VkCommandBuffer cmd) {
+
+    // Culling of this frame must have read the pyramid before it is overwritten
+    VkMemoryBarrier readBarrier = {};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    readBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &readBarrier,
+            0, NULL,
+            0, NULL);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culler->reducePipeline);
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = culler->pyramid.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    for(u32 i = 0; i < culler->pyramid.mipLevels; i++) {
+        VkExtent2D src = i == 0 ? culler->mipExtents[0] : culler->mipExtents[i - 1];
+        VkExtent2D dst = culler->mipExtents[i];
+
+        OcclusionReduceConstants constants = {
+            .srcSize = {(i32)src.width, (i32)src.height},
+            .dstSize = {(i32)dst.width, (i32)dst.height},
+        };
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, culler->reducePipelineLayout,
+                0, 1, &culler->reduceSets[i], 0, NULL);
+        vkCmdPushConstants(cmd, culler->reducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                0, sizeof constants, &constants);
+        vkCmdDispatch(cmd,
+                (dst.width + OCCLUSION_REDUCE_GROUP_SIZE - 1) / OCCLUSION_REDUCE_GROUP_SIZE,
+                (dst.height + OCCLUSION_REDUCE_GROUP_SIZE - 1) / OCCLUSION_REDUCE_GROUP_SIZE, 1);
+
+        // next level reads this one
+        barrier.subresourceRange.baseMipLevel = i;
+        vkCmdPipelineBarrier(cmd,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                0, NULL,
+                0, NULL,
+                1, &barrier);
+    }
+}
+
+// Read results of the last submission of the image, image fence must be waited before
+static OcclusionStats
+occlusion_read_stats(OcclusionCuller* culler, u32 imageIndex, VkDevice device) {
+
+    Buffer* buffer = &culler->statsBuffers[imageIndex];
+    void* data;
+    vkMapMemory(device, buffer->bufferMemory, 0, sizeof(OcclusionStats), 0, &data);
+    memcpy(&culler->lastStats, data, sizeof(OcclusionStats));
+    vkUnmapMemory(device, buffer->bufferMemory);
+    return culler->lastStats;
+}
+
+static void
+occlusion_dispose(OcclusionCuller* culler, VkDevice device) {
+
+    vkDestroyPipeline(device, culler->cullPipeline, NULL);
+    vkDestroyPipeline(device, culler->reducePipeline, NULL);
+    vkDestroyPipelineLayout(device, culler->cullPipelineLayout, NULL);
+    vkDestroyPipelineLayout(device, culler->reducePipelineLayout, NULL);
+    vkDestroyDescriptorSetLayout(device, culler->cullLayout, NULL);
+    vkDestroyDescriptorSetLayout(device, culler->reduceLayout, NULL);
+    // sets are freed with the pools
+    descriptorallocator_dispose(&culler->descriptors);
+    free(culler->reduceSets);
+
+    for(u32 i = 0; i < culler->numImages; i++) {
+        buffer_dispose(&culler->statsBuffers[i], device);
+    }
+    free(culler->statsBuffers);
+
+    for(u32 i = 0; i < culler->pyramid.mipLevels; i++) {
+        imageview_dispose(culler->mipViews[i], device);
+    }
+    free(culler->mipViews);
+    free(culler->mipExtents);
+    texture_dispose(&culler->pyramid, device);
+    memset(culler, 0, sizeof *culler);
+}
+
+#endif /* OCCLUSION_H */
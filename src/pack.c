@@ -0,0 +1,224 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Packs asset files to one file that pack_mount maps at startup, see pack.h.
+// Build with pack.sh, usage: pack [-o out.pack] [-raw] path...
+// Directories are packed recursively, default is models, textures and shaders to data.pack.
+// Files are compressed with lz4 unless -raw is given, it saves less than an eighth or they
+// are dds that are streamed a few levels at a time. Generated mip caches are left out.
+
+#include "utils.h"
+#include <dirent.h>
+#include <limits.h>
+#include "timer.h"
+#include "pack.h"
+
+typedef struct PackSource {
+    char    path[256];      // normalized, name in pack
+    u64     hash;
+    i64     time;
+} PackSource;
+
+typedef struct PackSources {
+    PackSource* files;
+    u32         count;
+    u32         capacity;
+} PackSources;
+
+static u8
+_ends_with(const char* str, const char* end) {
+    size_t len = strlen(str), endLen = strlen(end);
+    return len >= endLen && !strcmp(str + len - endLen, end);
+}
+
+static void
+_collect(PackSources* sources, const char* path) {
+
+    struct stat info;
+    if(stat(path, &info) != 0) {
+        LOG_ERR(CONSOLE_COLOR_RED, "No such file %s", path);
+        return;
+    }
+    if(S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(path);
+        if(!dir) return;
+        struct dirent* entry;
+        while((entry = readdir(dir))) {
+            if(entry->d_name[0] == '.') continue;
+            char child[PATH_MAX];
+            int length = snprintf(child, sizeof child, "%s/%s", path, entry->d_name);
+            if(length < 0 || (size_t)length >= sizeof child) {
+                LOG_ERR(CONSOLE_COLOR_RED, "Path too long, skipping %s/%s", path, entry->d_name);
+                continue;
+            }
+            _collect(sources, child);
+        }
+        closedir(dir);
+        return;
+    }
+    if(!S_ISREG(info.st_mode) || _ends_with(path, ".mips")) return;
+    if(strlen(path) >= MEMBER_SIZE(PackSource, path)) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Path too long for pack, skipping %s", path);
+        return;
+    }
+
+    if(sources->count == sources->capacity) {
+        sources->capacity = sources->capacity ? sources->capacity * 2 : 64;
+        sources->files = (PackSource*)realloc(sources->files, sizeof *sources->files * sources->capacity);
+    }
+    PackSource* source = &sources->files[sources->count++];
+    _pack_normalize(path, source->path, sizeof source->path);
+    source->hash = _pack_hash(source->path);
+    source->time = (i64)info.st_mtime;
+}
+
+static int
+_compare_sources(const void* a, const void* b) {
+    const PackSource* lhs = (const PackSource*)a;
+    const PackSource* rhs = (const PackSource*)b;
+    if(lhs->hash != rhs->hash) return lhs->hash < rhs->hash ? -1 : 1;
+    return strcmp(lhs->path, rhs->path);
+}
+
+static void
+_write_padding(FILE* fp, u64* offset) {
+    static const u8 zeros[PACK_ALIGN] = {};
+    u64 aligned = (*offset + PACK_ALIGN - 1) & ~(u64)(PACK_ALIGN - 1);
+    fwrite(zeros, aligned - *offset, 1, fp);
+    *offset = aligned;
+}
+
+static u8
+_write_pack(const char* outPath, PackSources* sources, u8 compress) {
+
+    FILE* fp = fopen(outPath, "wb");
+    if(!fp) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Could not write %s", outPath);
+        return 0;
+    }
+    PackHeader header = {.magic = PACK_MAGIC, .version = PACK_VERSION, .numEntries = sources->count};
+    fwrite(&header, sizeof header, 1, fp);
+    u64 offset = sizeof header;
+
+    PackEntry* entries = (PackEntry*)calloc(sources->count ? sources->count : 1, sizeof *entries);
+    u64 rawTotal = 0, packedTotal = 0;
+    u32 nameOffset = 0;
+    for(u32 i = 0; i < sources->count; i++) {
+        PackSource* source = &sources->files[i];
+        FileView file;
+        if(!file_map(source->path, &file)) {
+            LOG_ERR(CONSOLE_COLOR_RED, "Could not read %s", source->path);
+            fclose(fp);
+            free(entries);
+            return 0;
+        }
+
+        _write_padding(fp, &offset);
+        PackEntry* entry = &entries[i];
+        entry->hash = source->hash;
+        entry->offset = offset;
+        entry->rawSize = file.size;
+        entry->time = source->time;
+        entry->nameOffset = nameOffset;
+        nameOffset += (u32)strlen(source->path) + 1;
+
+        u8* compressed = NULL;
+        size_t compressedSize = 0;
+        if(compress && file.size && !_ends_with(source->path, ".dds")) {
+            compressed = (u8*)malloc(lz4_compress_bound(file.size));
+            compressedSize = lz4_compress(file.data, file.size, compressed);
+        }
+        if(compressed && compressedSize < file.size - file.size / 8) {
+            entry->flags = PACK_FLAG_LZ4;
+            entry->size = compressedSize;
+            fwrite(compressed, compressedSize, 1, fp);
+        } else {
+            entry->size = file.size;
+            if(file.size) fwrite(file.data, file.size, 1, fp);
+        }
+        offset += entry->size;
+        rawTotal += entry->rawSize;
+        packedTotal += entry->size;
+        LOG("%s %.1f KB%s", source->path, (double)entry->size / 1024.0,
+                entry->flags & PACK_FLAG_LZ4 ? " lz4" : "");
+        if(compressed) free(compressed);
+        file_unmap(&file);
+    }
+
+    _write_padding(fp, &offset);
+    header.tocOffset = offset;
+    header.namesSize = nameOffset;
+    fwrite(entries, sizeof *entries, sources->count, fp);
+    for(u32 i = 0; i < sources->count; i++) {
+        fwrite(sources->files[i].path, strlen(sources->files[i].path) + 1, 1, fp);
+    }
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof header, 1, fp);
+    u8 ok = !ferror(fp);
+    fclose(fp);
+    free(entries);
+    LOG("Packed %u files to %s, %.1f MB from %.1f MB", sources->count, outPath,
+            (double)packedTotal / (1024.0 * 1024.0), (double)rawTotal / (1024.0 * 1024.0));
+    return ok;
+}
+
+// Every file read back through the pack has to match its source
+static u8
+_verify_pack(const char* outPath, const PackSources* sources) {
+
+    if(!pack_mount(outPath)) return 0;
+    u32 failed = 0;
+    u64 start = timer_now_ns();
+    for(u32 i = 0; i < sources->count; i++) {
+        const char* path = sources->files[i].path;
+        const PackEntry* entry = pack_find(path);
+        VfsFile packed;
+        FileView loose;
+        if(!file_map(path, &loose) || !entry || !_vfs_open_packed(entry, &packed)) {
+            failed++;
+        } else {
+            if(packed.size != loose.size || (loose.size && memcmp(packed.data, loose.data, loose.size))) failed++;
+            vfs_close(&packed);
+        }
+        file_unmap(&loose);
+    }
+    LOG("Read back %u files in %.1f ms, %u differ", sources->count,
+            (double)(timer_now_ns() - start) / 1e6, failed);
+    pack_unmount();
+    return failed == 0;
+}
+
+int main(int argc, char** argv) {
+
+    const char* outPath = PACK_PATH;
+    u8 compress = 1;
+    PackSources sources = {};
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if(!strcmp(argv[i], "-raw")) {
+            compress = 0;
+        } else {
+            _collect(&sources, argv[i]);
+        }
+    }
+    if(!sources.count) {
+        const char* defaults[] = {"models", "textures", "shaders"};
+        for(u32 i = 0; i < SIZEOF_ARRAY(defaults); i++) {
+            struct stat info;
+            if(stat(defaults[i], &info) == 0) _collect(&sources, defaults[i]);
+        }
+    }
+
+    qsort(sources.files, sources.count, sizeof *sources.files, _compare_sources);
+    for(u32 i = 1; i < sources.count; i++) {
+        if(!strcmp(sources.files[i - 1].path, sources.files[i].path)) {
+            LOG_ERR(CONSOLE_COLOR_RED, "%s given twice", sources.files[i].path);
+            return 1;
+        }
+    }
+    u8 ok = _write_pack(outPath, &sources, compress) && _verify_pack(outPath, &sources);
+    free(sources.files);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Assets packed to one file by pack.sh and mapped to memory at startup. Table of contents
+// is sorted by path hash so finding a file is a binary search, and uncompressed entries are
+// used right from the mapping without copying. Entries compressed with lz4 are decoded to
+// the heap when opened.
+// Loaders go through vfs_open which looks at the pack and at loose files. Debug builds
+// try loose files first so edited assets show up without repacking, release prefers pack.
+
+#ifndef PACK_H
+#define PACK_H
+
+#include "utils.h"
+#include "fileutils.h"
+#include "lz4.h"
+#include <sys/stat.h>
+
+#define PACK_PATH "data.pack"
+#define PACK_MAGIC 0x4B505642   // "BVPK"
+#define PACK_VERSION 1
+#define PACK_ALIGN 64           // entries start at this, enough for any data used in place
+#define PACK_FLAG_LZ4 0x1
+
+#if defined(BUILD_DEBUG)
+#define VFS_LOOSE_FIRST 1
+#else
+#define VFS_LOOSE_FIRST 0
+#endif
+
+// File is header, entry data, table of contents and names of entries
+typedef struct PackHeader {
+    u32     magic;
+    u32     version;
+    u32     numEntries;
+    u32     namesSize;
+    u64     tocOffset;
+} PackHeader;
+
+typedef struct PackEntry {
+    u64     hash;           // of path, entries are sorted by this
+    u64     offset;
+    u64     size;           // bytes in pack
+    u64     rawSize;        // bytes when decompressed
+    i64     time;           // modification time of source, caches built from it compare this
+    u32     nameOffset;     // to names, zero terminated
+    u32     flags;
+} PackEntry;
+
+typedef struct PackFile {
+    char                path[256];
+    FileView            view;
+    u8*                 base;
+    size_t              size;
+    const PackHeader*   header;
+    const PackEntry*    entries;
+    const char*         names;
+} PackFile;
+
+// Contents of an opened file, in place in pack or in a view of the loose file
+typedef struct VfsFile {
+    u8*         data;
+    size_t      size;
+    u8*         decoded;    // heap buffer of a compressed entry
+    FileView    view;       // loose file
+} VfsFile;
+
+static PackFile g_pack;
+
+// Paths in pack are relative with forward slashes
+static void
+_pack_normalize(const char* path, char* dst, size_t dstSize) {
+
+    while(path[0] == '.' && (path[1] == '/' || path[1] == '\\')) path += 2;
+    size_t i = 0;
+    for(; path[i] && i + 1 < dstSize; i++) {
+        dst[i] = path[i] == '\\' ? '/' : path[i];
+    }
+    dst[i] = 0;
+}
+
+static u64
+_pack_hash(const char* path) {
+    u64 hash = 0xCBF29CE484222325ULL;
+    for(const u8* c = (const u8*)path; *c; c++) {
+        hash = (hash ^ *c) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Returns 0 when there is no pack, assets are then read from loose files only
+static u8
+pack_mount(const char* path) {
+
+    PackFile* pack = &g_pack;
+    memset(pack, 0, sizeof *pack);
+    if(!file_map(path, &pack->view)) {
+        LOG("No asset pack %s, using loose files", path);
+        return 0;
+    }
+    pack->base = pack->view.data;
+    pack->size = pack->view.size;
+    snprintf(pack->path, sizeof pack->path, "%s", path);
+
+    const PackHeader* header = (const PackHeader*)pack->base;
+    u8 valid = pack->size >= sizeof *header && header->magic == PACK_MAGIC &&
+        header->version == PACK_VERSION && header->tocOffset <= pack->size &&
+        (pack->size - header->tocOffset) / sizeof(PackEntry) >= header->numEntries &&
+        pack->size - header->tocOffset - header->numEntries * sizeof(PackEntry) >= header->namesSize;
+    // every entry has to be inside the file and its name inside the names, raw ones are
+    // read in place up to rawSize
+    const PackEntry* entries = NULL;
+    const char* names = NULL;
+    if(valid) {
+        entries = (const PackEntry*)(pack->base + header->tocOffset);
+        names = (const char*)(entries + header->numEntries);
+    }
+    for(u32 i = 0; valid && i < header->numEntries; i++) {
+        const PackEntry* entry = &entries[i];
+        valid = entry->offset <= pack->size && entry->size <= pack->size - entry->offset &&
+            ((entry->flags & PACK_FLAG_LZ4) || entry->rawSize == entry->size) &&
+            entry->nameOffset < header->namesSize &&
+            memchr(names + entry->nameOffset, 0, header->namesSize - entry->nameOffset);
+        if(!valid) {
+            LOG_ERR(CONSOLE_COLOR_RED, "Asset pack %s entry %u is out of range", path, i);
+        }
+    }
+    if(!valid) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Asset pack %s is broken or from other version", path);
+        file_unmap(&pack->view);
+        memset(pack, 0, sizeof *pack);
+        return 0;
+    }
+    pack->header = header;
+    pack->entries = entries;
+    pack->names = names;
+    LOG("Mounted asset pack %s, %u files in %.1f MB", path, header->numEntries,
+            (double)pack->size / (1024.0 * 1024.0));
+    return 1;
+}
+
+static void
+pack_unmount() {
+    file_unmap(&g_pack.view);
+    memset(&g_pack, 0, sizeof g_pack);
+}
+
+static const PackEntry*
+pack_find(const char* path) {
+
+    const PackFile* pack = &g_pack;
+    if(!pack->header) return NULL;
+    char name[256];
+    _pack_normalize(path, name, sizeof name);
+    u64 hash = _pack_hash(name);
+
+    u32 low = 0, high = pack->header->numEntries;
+    while(low < high) {
+        u32 mid = low + (high - low) / 2;
+        if(pack->entries[mid].hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    for(u32 i = low; i < pack->header->numEntries && pack->entries[i].hash == hash; i++) {
+        if(!strcmp(pack->names + pack->entries[i].nameOffset, name)) return &pack->entries[i];
+    }
+    return NULL;
+}
+
+static u8
+_vfs_loose_exists(const char* path) {
+    struct stat info;
+    return stat(path, &info) == 0;
+}
+
+// Entry that vfs_open would use, NULL when it reads a loose file
+static const PackEntry*
+vfs_packed(const char* path) {
+    if(VFS_LOOSE_FIRST && _vfs_loose_exists(path)) return NULL;
+    return pack_find(path);
+}
+
+static u8
+_vfs_open_packed(const PackEntry* entry, VfsFile* file) {
+
+    memset(file, 0, sizeof *file);
+    if(!(entry->flags & PACK_FLAG_LZ4)) {
+        file->data = g_pack.base + entry->offset;
+        file->size = entry->size;
+        return 1;
+    }
+    file->decoded = (u8*)malloc(entry->rawSize ? entry->rawSize : 1);
+    if(!lz4_decompress(g_pack.base + entry->offset, entry->size, file->decoded, entry->rawSize)) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Packed file %s is broken", g_pack.names + entry->nameOffset);
+        free(file->decoded);
+        return 0;
+    }
+    file->data = file->decoded;
+    file->size = entry->rawSize;
+    return 1;
+}
+
+// Whole file, returns 0 if it is in neither pack nor disk. Close when done
+static u8
+vfs_open(const char* path, VfsFile* file) {
+
+    memset(file, 0, sizeof *file);
+    const PackEntry* entry = vfs_packed(path);
+    if(entry) return _vfs_open_packed(entry, file);
+
+    if(!file_map(path, &file->view)) return 0;
+    file->data = file->view.data;
+    file->size = file->view.size;
+    return 1;
+}
+
+static void
+vfs_close(VfsFile* file) {
+    if(file->decoded) {
+        free(file->decoded);
+    }
+    file_unmap(&file->view);
+    memset(file, 0, sizeof *file);
+}
+
+// Part of a file, compressed entries are decoded whole for this so files read
+// in parts are packed uncompressed
+static u8
+vfs_read_range(const char* path, u64 offset, size_t size, void* dst) {
+
+    const PackEntry* entry = vfs_packed(path);
+    if(!entry) return file_read_range(path, offset, size, dst);
+    if(offset > entry->rawSize || size > entry->rawSize - offset) return 0;
+    if(!(entry->flags & PACK_FLAG_LZ4)) {
+        memcpy(dst, g_pack.base + entry->offset + offset, size);
+        return 1;
+    }
+    VfsFile file;
+    if(!_vfs_open_packed(entry, &file)) return 0;
+    memcpy(dst, file.data + offset, size);
+    vfs_close(&file);
+    return 1;
+}
+
+// File and offset where contents of path are stored as they are, for reading them
+// without the mapping. Returns 0 for compressed entries
+static u8
+vfs_locate(const char* path, char* file, size_t fileSize, u64* offset) {
+
+    const PackEntry* entry = vfs_packed(path);
+    if(entry && (entry->flags & PACK_FLAG_LZ4)) return 0;
+    snprintf(file, fileSize, "%s", entry ? g_pack.path : path);
+    *offset = entry ? entry->offset : 0;
+    return 1;
+}
+
+// Size and modification time of the version vfs_open would read
+static u8
+vfs_stat(const char* path, u64* size, i64* time) {
+
+    const PackEntry* entry = vfs_packed(path);
+    if(entry) {
+        *size = entry->rawSize;
+        *time = entry->time;
+        return 1;
+    }
+    struct stat info;
+    if(stat(path, &info) != 0) return 0;
+    *size = (u64)info.st_size;
+    *time = (i64)info.st_mtime;
+    return 1;
+}
+
+#endif /* PACK_H */
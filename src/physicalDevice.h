@@ -9,6 +9,7 @@
 #include "utils.h"
 #include "queueIndexes.h"
 #include "vulkanExtensions.h"
+#include "profiler.h"
 // #include "swapchain.h"
 
 // Store all needed data about physical device
@@ -100,12 +101,26 @@ _is_device_suitable(const VkPhysicalDevice device,const VkSurfaceKHR surface) {
     VkPhysicalDeviceProperties deviceProperties;
     VkPhysicalDeviceFeatures deviceFeatures;
     vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    // features2 is core in 1.1, instance asks for 1.1 but older devices still get listed
+    if(deviceProperties.apiVersion < VK_API_VERSION_1_1) {
+        LOG("Skipping %s, supports only Vulkan %u.%u", deviceProperties.deviceName,
+                VK_VERSION_MAJOR(deviceProperties.apiVersion), VK_VERSION_MINOR(deviceProperties.apiVersion));
+        return 0;
+    }
     vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
     QueueFamilyIndices families = _find_queue_families(device,surface);
 
     u8 extensionsSupported = _check_device_extension_support(device);
     u8 swapChainSupported = 0;
     if (extensionsSupported) {
+        // only valid to chain when extension exists
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+
         SwapchainSupportDetails swapchainSupport =
             physicaldevice_get_swapchain_support_details(device,surface);
 
@@ -119,6 +134,12 @@ _is_device_suitable(const VkPhysicalDevice device,const VkSurfaceKHR surface) {
             deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) &&
         deviceFeatures.geometryShader &&
         deviceFeatures.samplerAnisotropy &&
+        deviceFeatures.multiDrawIndirect &&
+        deviceFeatures.drawIndirectFirstInstance &&
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+        indexingFeatures.descriptorBindingPartiallyBound &&
+        indexingFeatures.runtimeDescriptorArray &&
         extensionsSupported &&
         swapChainSupported &&
         _verify_queueFamilyIndices(&families);
@@ -153,6 +174,7 @@ physical_device_pick(const VkInstance instance, PhysicalDevice* device, const Vk
 static VkDevice
 physicaldevice_create_logicaldevice(const PhysicalDevice* physicalDevice) {
 
+    PROFILE_FUNCTION();
     // if present and graphics queues are not same we need to create two separate
     VkDeviceQueueCreateInfo queueCreateInfos[(sizeof(QueueFamilyIndices)) / (sizeof(u32))] = {};
     // get unique indexes
@@ -186,6 +208,21 @@ physicaldevice_create_logicaldevice(const PhysicalDevice* physicalDevice) {
     // specify what device features we are using
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE; //enable anisotrophic filtering
+    deviceFeatures.multiDrawIndirect = VK_TRUE; // whole drawlist in one indirect call
+    deviceFeatures.drawIndirectFirstInstance = VK_TRUE; // material id goes in first instance
+
+    // compressed textures when gpu has them, loader falls back to rgba8 otherwise
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(physicalDevice->physicalDevice, &supported);
+    deviceFeatures.textureCompressionBC = supported.textureCompressionBC;
+
+    // bindless texture array
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
 
     LOG("initialized %d unique queue(s), graphics queue %d and presentation queue %d",
             numIndexes,physicalDevice->queues.graphicsFamily,physicalDevice->queues.presentFamily);
@@ -193,6 +230,7 @@ physicaldevice_create_logicaldevice(const PhysicalDevice* physicalDevice) {
     // logical devices create info
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &indexingFeatures;
     createInfo.pQueueCreateInfos = queueCreateInfos;
     createInfo.queueCreateInfoCount = numIndexes;
     createInfo.pEnabledFeatures = &deviceFeatures;
@@ -263,7 +301,8 @@ static VkFormat physicaldevice_find_depth_format(VkPhysicalDevice physicalDevice
 
     return physicaldevice_find_supported_format(physicalDevice,
             formatOptions, SIZEOF_ARRAY(formatOptions),
-            VK_IMAGE_TILING_OPTIMAL,  VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 
 }
 
@@ -7,8 +7,14 @@
 
 #include <vulkan/vulkan.h>
 #include "utils.h"
-#include "fileutils.h"
+#include "pack.h"
 #include "vertex.h"
+#include "profiler.h"
+
+// Per draw data, layout matches push_constant block of basic_shader.vert
+typedef struct PushConstants {
+    mat4    model;
+} PushConstants;
 
 typedef struct Pipeline {
     // Uniforms
@@ -38,16 +44,15 @@ pipeline_init(Pipeline* pipeline, const VkDevice device,
         const VkExtent2D drawExtent,const VkRenderPass renderPass,
         VkDescriptorSetLayout uboLayout) {
 
-    size_t vertSize = 0;
-    u8* vert_shader = load_binary_file("shaders/basic_shader_vert.spv",&vertSize);
-    size_t fragSize = 0;
-    u8* frag_shader = load_binary_file("shaders/basic_shader_frag.spv",&fragSize);
-    if(vert_shader == NULL || frag_shader == NULL) {
+    PROFILE_FUNCTION();
+    VfsFile vert_shader, frag_shader;
+    if(!vfs_open("shaders/basic_shader_vert.spv", &vert_shader) ||
+            !vfs_open("shaders/basic_shader_frag.spv", &frag_shader)) {
         ABORT("Failed to load shaders");
     }
 
-    VkShaderModule vertMod = shadermodule_create(vert_shader,vertSize,device);
-    VkShaderModule fragMod = shadermodule_create(frag_shader,fragSize,device);
+    VkShaderModule vertMod = shadermodule_create(vert_shader.data,vert_shader.size,device);
+    VkShaderModule fragMod = shadermodule_create(frag_shader.data,frag_shader.size,device);
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
     { // init vert shader stage info
@@ -157,8 +162,13 @@ pipeline_init(Pipeline* pipeline, const VkDevice device,
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1;
     pipelineLayoutInfo.pSetLayouts = &uboLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = NULL; // Optional
+    // Per draw data that does not need a buffer write
+    VkPushConstantRange pushRange = {};
+    pushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushRange.offset = 0;
+    pushRange.size = sizeof(PushConstants);
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushRange;
 
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipeline->pipelineLayout) != VK_SUCCESS) {
         ABORT("Failed to create pipeline layout");
@@ -211,8 +221,39 @@ pipeline_init(Pipeline* pipeline, const VkDevice device,
     // Clean things up
     vkDestroyShaderModule(device, vertMod, NULL);
     vkDestroyShaderModule(device, fragMod, NULL);
-    free(vert_shader);
-    free(frag_shader);
+    vfs_close(&vert_shader);
+    vfs_close(&frag_shader);
+}
+
+static VkPipeline
+computepipeline_create(const char* shaderPath, VkPipelineLayout layout, const VkDevice device) {
+
+    PROFILE_FUNCTION();
+    VfsFile shader;
+    if(!vfs_open(shaderPath, &shader)) {
+        ABORT("Failed to load shader %s", shaderPath);
+    }
+
+    VkShaderModule module = shadermodule_create(shader.data, shader.size, device);
+
+    VkComputePipelineCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module = module;
+    info.stage.pName = "main";
+    info.layout = layout;
+    info.basePipelineHandle = VK_NULL_HANDLE;
+    info.basePipelineIndex = -1;
+
+    VkPipeline ret;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &info, NULL, &ret) != VK_SUCCESS) {
+        ABORT("failed to create compute pipeline %s", shaderPath);
+    }
+
+    vkDestroyShaderModule(device, module, NULL);
+    vfs_close(&shader);
+    return ret;
 }
 
 static void
@@ -0,0 +1,190 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Scoped cpu timing zones. PROFILE_ZONE("name") times the rest of the enclosing block and
+// PROFILE_FUNCTION() the whole function, finished zones go to a ring buffer of the thread
+// they ran on so recording takes no locks. profiler_dump writes the buffers as Chrome trace
+// json, open it in chrome://tracing or ui.perfetto.dev. Oldest zones of a thread are
+// overwritten when its buffer is full.
+// Built in when PROFILER_ENABLED is 1, debug builds default to that. Otherwise the macros
+// are empty and functions do nothing. Zone names have to stay valid until the dump, string
+// literals and __func__ do.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "utils.h"
+#include "timer.h"
+
+#ifndef PROFILER_ENABLED
+#if defined(BUILD_DEBUG)
+#define PROFILER_ENABLED 1
+#else
+#define PROFILER_ENABLED 0
+#endif
+#endif
+
+#define PROFILER_PATH "profile.json"
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_EVENTS (1 << 16)   // per thread, power of two
+
+#if PROFILER_ENABLED
+
+typedef struct ProfileEvent {
+    const char* name;
+    u64         start;
+    u64         end;
+} ProfileEvent;
+
+typedef struct ProfileZone {
+    const char* name;
+    u64         start;
+} ProfileZone;
+
+// Written only by its own thread, count is published after the event
+typedef struct ProfileBuffer {
+    ProfileEvent    events[PROFILER_EVENTS];
+    u64             count;      // events ever recorded
+    const char*     name;
+} ProfileBuffer;
+
+typedef struct Profiler {
+    ProfileBuffer*  buffers[PROFILER_MAX_THREADS];
+    u32             numBuffers;
+    u64             startNs;    // zero of the trace
+} Profiler;
+
+static Profiler g_profiler;
+static THREAD_LOCAL ProfileBuffer* t_profileBuffer;
+static THREAD_LOCAL u8 t_profileFull;     // no buffer left for this thread
+
+static ProfileBuffer*
+_profiler_buffer() {
+
+    if(t_profileBuffer || t_profileFull) return t_profileBuffer;
+    u32 index = __atomic_fetch_add(&g_profiler.numBuffers, 1, __ATOMIC_ACQ_REL);
+    if(index >= PROFILER_MAX_THREADS) {
+        t_profileFull = 1;
+        return NULL;
+    }
+    ProfileBuffer* buffer = (ProfileBuffer*)calloc(1, sizeof *buffer);
+    buffer->name = "thread";
+    __atomic_store_n(&g_profiler.buffers[index], buffer, __ATOMIC_RELEASE);
+    t_profileBuffer = buffer;
+    return buffer;
+}
+
+static inline ProfileZone
+_profiler_zone_begin(const char* name) {
+    return (ProfileZone){.name = name, .start = timer_now_ns()};
+}
+
+static inline void
+_profiler_zone_end(ProfileZone* zone) {
+
+    u64 end = timer_now_ns();
+    ProfileBuffer* buffer = _profiler_buffer();
+    if(!buffer) return;
+    u64 count = buffer->count;
+    // dump may read the slot meanwhile, it throws away what could have been overwritten
+    ProfileEvent* event = &buffer->events[count & (PROFILER_EVENTS - 1)];
+    __atomic_store_n(&event->name, zone->name, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->start, zone->start, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->end, end, __ATOMIC_RELAXED);
+    __atomic_store_n(&buffer->count, count + 1, __ATOMIC_RELEASE);
+}
+
+#define _PROFILE_CONCAT2(A, B) A##B
+#define _PROFILE_CONCAT(A, B) _PROFILE_CONCAT2(A, B)
+#define PROFILE_ZONE(NAME) ProfileZone _PROFILE_CONCAT(_profileZone, __LINE__) \
+    __attribute__((cleanup(_profiler_zone_end))) = _profiler_zone_begin(NAME)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(NAME) profiler_thread_name(NAME)
+
+// Name shown for the calling thread, tid is added to it
+static void
+profiler_thread_name(const char* name) {
+    ProfileBuffer* buffer = _profiler_buffer();
+    if(buffer) buffer->name = name;
+}
+
+static void
+profiler_init() {
+    g_profiler.startNs = timer_now_ns();
+    profiler_thread_name("main");
+}
+
+// Everything recorded so far in all threads, threads can keep recording while this runs
+static u8
+profiler_dump(const char* path) {
+
+    FILE* fp = fopen(path, "w");
+    if(!fp) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Could not write profile %s", path);
+        return 0;
+    }
+    ProfileEvent* copy = (ProfileEvent*)malloc(sizeof *copy * PROFILER_EVENTS);
+    u32 numBuffers = __atomic_load_n(&g_profiler.numBuffers, __ATOMIC_ACQUIRE);
+    if(numBuffers > PROFILER_MAX_THREADS) numBuffers = PROFILER_MAX_THREADS;
+    u64 written = 0;
+    u8 first = 1;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for(u32 tid = 0; tid < numBuffers; tid++) {
+        ProfileBuffer* buffer = __atomic_load_n(&g_profiler.buffers[tid], __ATOMIC_ACQUIRE);
+        if(!buffer) continue;
+        fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s %u\"}}", first ? "" : ",", tid, buffer->name, tid);
+        first = 0;
+
+        u64 end = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        u64 begin = end > PROFILER_EVENTS ? end - PROFILER_EVENTS : 0;
+        for(u64 i = begin; i < end; i++) {
+            ProfileEvent* event = &buffer->events[i & (PROFILER_EVENTS - 1)];
+            copy[i - begin].name = __atomic_load_n(&event->name, __ATOMIC_RELAXED);
+            copy[i - begin].start = __atomic_load_n(&event->start, __ATOMIC_RELAXED);
+            copy[i - begin].end = __atomic_load_n(&event->end, __ATOMIC_RELAXED);
+        }
+        // slots the thread got to while copying are mixed, the one after count too
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        u64 now = __atomic_load_n(&buffer->count, __ATOMIC_RELAXED);
+        u64 valid = now + 1 > PROFILER_EVENTS ? now + 1 - PROFILER_EVENTS : 0;
+        for(u64 i = valid > begin ? valid : begin; i < end; i++) {
+            const ProfileEvent* event = &copy[i - begin];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name, tid, (double)(i64)(event->start - g_profiler.startNs) / 1000.0,
+                    (double)(event->end - event->start) / 1000.0);
+            written++;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    u8 ok = !ferror(fp);
+    fclose(fp);
+    free(copy);
+    LOG("Wrote %" PRIu64 " profile zones of %u threads to %s", written, numBuffers, path);
+    return ok;
+}
+
+// Threads that recorded have to be finished
+static void
+profiler_dispose() {
+    for(u32 i = 0; i < PROFILER_MAX_THREADS; i++) {
+        if(g_profiler.buffers[i]) free(g_profiler.buffers[i]);
+    }
+    memset(&g_profiler, 0, sizeof g_profiler);
+    t_profileBuffer = NULL;
+}
+
+#else
+
+#define PROFILE_ZONE(NAME)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD(NAME)
+
+static inline void profiler_init() {}
+static inline u8 profiler_dump(const char* path) { (void)path; return 0; }
+static inline void profiler_dispose() {}
+
+#endif /* PROFILER_ENABLED */
+
+#endif /* PROFILER_H */
@@ -9,12 +9,14 @@
 #include "utils.h"
 #include "swapchain.h"
 #include "physicalDevice.h"
+#include "profiler.h"
 
 
 static VkRenderPass
 renderpass_create(const SwapChain* swapchain, const VkDevice device,
-        const VkPhysicalDevice physicaldevice) {
+        const VkPhysicalDevice physicaldevice, u8 keepDepth) {
 
+    PROFILE_FUNCTION();
     VkRenderPass pass;
     VkAttachmentDescription colorAttachment = {};
     VkAttachmentReference colorAttachmentRef = {};
@@ -47,7 +49,8 @@ renderpass_create(const SwapChain* swapchain, const VkDevice device,
         depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 
         depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // Depth is read after the pass when building the occlusion pyramid
+        depthAttachment.storeOp = keepDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
         depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -55,7 +58,8 @@ renderpass_create(const SwapChain* swapchain, const VkDevice device,
         depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
         depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthAttachment.finalLayout = keepDepth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL :
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
         depthAttachmentRef.attachment = 1;
         depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -69,14 +73,31 @@ renderpass_create(const SwapChain* swapchain, const VkDevice device,
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
     // Describe what sub passes depends on to correctly synchronice them
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
+    VkSubpassDependency dependencies[2] = {};
+    VkSubpassDependency* dependency = &dependencies[0];
+    dependency->srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency->dstSubpass = 0;
     // Wait for swapchain to finish reading from it before we can access it
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency->srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency->srcAccessMask = 0;
+    dependency->dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency->dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    if(keepDepth) {
+        // Pyramid build of the last frame has to finish reading depth before clearing it
+        dependency->srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependency->dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency->dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // Depth writes are visible for the pyramid build after the pass
+        dependency = &dependencies[1];
+        dependency->srcSubpass = 0;
+        dependency->dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependency->srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency->srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency->dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependency->dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
 
     VkAttachmentDescription attachmets[] = {colorAttachment, depthAttachment};
     VkRenderPassCreateInfo renderPassInfo = {};
@@ -85,8 +106,8 @@ renderpass_create(const SwapChain* swapchain, const VkDevice device,
     renderPassInfo.pAttachments = attachmets;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = keepDepth ? 2 : 1;
+    renderPassInfo.pDependencies = dependencies;
 
     if (vkCreateRenderPass(device, &renderPassInfo, NULL, &pass) != VK_SUCCESS) {
         ABORT("Failed to create renderpass!");
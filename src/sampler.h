@@ -0,0 +1,127 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Samplers shared by all textures with the same sampling state. Nearly every texture
+// samples the same way and devices limit how many samplers can exist, so samplers are
+// reference counted and destroyed only when the last texture using one is gone.
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+
+#define SAMPLER_CACHE_MAX 64
+
+// Whole sampler state, zero it before filling so padding compares equal
+typedef struct SamplerDesc {
+    VkFilter                magFilter;
+    VkFilter                minFilter;
+    VkSamplerMipmapMode     mipmapMode;
+    VkSamplerAddressMode    addressModeU;
+    VkSamplerAddressMode    addressModeV;
+    VkSamplerAddressMode    addressModeW;
+    float                   mipLodBias;
+    VkBool32                anisotropyEnable;
+    float                   maxAnisotropy;
+    VkBool32                compareEnable;
+    VkCompareOp             compareOp;
+    float                   minLod;
+    float                   maxLod;
+    VkBorderColor           borderColor;
+    VkBool32                unnormalizedCoordinates;
+} SamplerDesc;
+
+typedef struct SamplerCache {
+    SamplerDesc     descs[SAMPLER_CACHE_MAX];
+    VkSampler       samplers[SAMPLER_CACHE_MAX];
+    u32             refs[SAMPLER_CACHE_MAX];
+    u32             numCreated;     // calls to driver, for stats
+    u32             numShared;
+} SamplerCache;
+
+static SamplerCache g_samplerCache;
+
+// Sampler with this state, created only if no live sampler has it
+static VkSampler
+sampler_get(VkDevice device, const SamplerDesc* desc) {
+
+    SamplerCache* cache = &g_samplerCache;
+    u32 empty = SAMPLER_CACHE_MAX;
+    for(u32 i = 0; i < SAMPLER_CACHE_MAX; i++) {
+        if(!cache->refs[i]) {
+            if(empty == SAMPLER_CACHE_MAX) empty = i;
+            continue;
+        }
+        if(!memcmp(&cache->descs[i], desc, sizeof *desc)) {
+            cache->refs[i]++;
+            cache->numShared++;
+            return cache->samplers[i];
+        }
+    }
+    ASSERT_MESSAGE(empty < SAMPLER_CACHE_MAX, "Too many different samplers");
+
+    VkSamplerCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    info.magFilter = desc->magFilter;
+    info.minFilter = desc->minFilter;
+    info.mipmapMode = desc->mipmapMode;
+    info.addressModeU = desc->addressModeU;
+    info.addressModeV = desc->addressModeV;
+    info.addressModeW = desc->addressModeW;
+    info.mipLodBias = desc->mipLodBias;
+    info.anisotropyEnable = desc->anisotropyEnable;
+    info.maxAnisotropy = desc->maxAnisotropy;
+    info.compareEnable = desc->compareEnable;
+    info.compareOp = desc->compareOp;
+    info.minLod = desc->minLod;
+    info.maxLod = desc->maxLod;
+    info.borderColor = desc->borderColor;
+    info.unnormalizedCoordinates = desc->unnormalizedCoordinates;
+
+    if(vkCreateSampler(device, &info, NULL /*allocator*/, &cache->samplers[empty]) != VK_SUCCESS) {
+        ABORT("Failed to create sampler");
+    }
+    cache->descs[empty] = *desc;
+    cache->refs[empty] = 1;
+    cache->numCreated++;
+    return cache->samplers[empty];
+}
+
+// Drop one reference, sampler is destroyed with the last one
+static void
+sampler_release(VkDevice device, VkSampler sampler) {
+
+    SamplerCache* cache = &g_samplerCache;
+    for(u32 i = 0; i < SAMPLER_CACHE_MAX; i++) {
+        if(cache->refs[i] && cache->samplers[i] == sampler) {
+            if(--cache->refs[i] == 0) {
+                vkDestroySampler(device, sampler, NULL /*allocator*/);
+                cache->samplers[i] = VK_NULL_HANDLE;
+            }
+            return;
+        }
+    }
+    ABORT("Released sampler that is not from sampler cache");
+}
+
+// Everything should be released by now, leftovers are destroyed anyway before device goes
+static void
+sampler_dispose_all(VkDevice device) {
+
+    SamplerCache* cache = &g_samplerCache;
+    u32 live = 0;
+    for(u32 i = 0; i < SAMPLER_CACHE_MAX; i++) {
+        if(!cache->refs[i]) continue;
+        live++;
+        vkDestroySampler(device, cache->samplers[i], NULL /*allocator*/);
+    }
+    if(live) {
+        LOG("%u samplers were not released", live);
+    }
+    LOG("Samplers created %u, shared %u times", cache->numCreated, cache->numShared);
+    memset(cache, 0, sizeof *cache);
+}
+
+#endif /* SAMPLER_H */
@@ -0,0 +1,173 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Where startup time goes. Init steps on the main thread are timed back to back with
+// startup_step, work that loaders do in workers meanwhile is added with startup_task.
+// startup_report logs both sorted by time at the end of init and startup_finish logs
+// workers again when assets are in, and writes everything as json when given a path.
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include "utils.h"
+#include "thread.h"
+#include "timer.h"
+
+#define STARTUP_MAX_PHASES 128
+#define STARTUP_MAX_MILESTONES 8
+
+typedef struct StartupPhase {
+    char    name[64];
+    u64     start;      // since startup
+    u64     ns;
+    u8      worker;     // ran in background while main thread went on
+} StartupPhase;
+
+typedef struct StartupMilestone {
+    const char* name;
+    u64         ns;     // since startup
+} StartupMilestone;
+
+typedef struct StartupTimeline {
+    StartupPhase        phases[STARTUP_MAX_PHASES];
+    u32                 numPhases;
+    StartupMilestone    milestones[STARTUP_MAX_MILESTONES];
+    u32                 numMilestones;
+    u64                 startNs;
+    u64                 lastNs;     // end of last step
+    u8                  finished;   // later tasks are not startup
+    Mutex               lock;
+} StartupTimeline;
+
+static StartupTimeline g_startup;
+
+static void
+startup_init(StartupTimeline* timeline, u64 startNs) {
+    memset(timeline, 0, sizeof *timeline);
+    mutex_init(&timeline->lock);
+    timeline->startNs = startNs;
+    timeline->lastNs = startNs;
+}
+
+static void
+_startup_add(StartupTimeline* timeline, const char* name, u64 start, u64 ns, u8 worker) {
+
+    mutex_lock(&timeline->lock);
+    if(!timeline->finished && timeline->numPhases < STARTUP_MAX_PHASES) {
+        StartupPhase* phase = &timeline->phases[timeline->numPhases++];
+        snprintf(phase->name, sizeof phase->name, "%s", name);
+        phase->start = start > timeline->startNs ? start - timeline->startNs : 0;
+        phase->ns = ns;
+        phase->worker = worker;
+    }
+    mutex_unlock(&timeline->lock);
+}
+
+// Main thread step that ended now and began when the last one ended. Returns its ms for logging
+static double
+startup_step(StartupTimeline* timeline, const char* name) {
+    u64 now = timer_now_ns();
+    u64 ns = now - timeline->lastNs;
+    _startup_add(timeline, name, timeline->lastNs, ns, 0);
+    timeline->lastNs = now;
+    return (double)ns / 1e6;
+}
+
+// Work done in a worker, any thread can call this
+static void
+startup_task(StartupTimeline* timeline, const char* name, u64 start, u64 ns) {
+    _startup_add(timeline, name, start, ns, 1);
+}
+
+// Point in time like first frame, name has to stay valid
+static void
+startup_milestone(StartupTimeline* timeline, const char* name) {
+    if(timeline->numMilestones == STARTUP_MAX_MILESTONES) return;
+    StartupMilestone* milestone = &timeline->milestones[timeline->numMilestones++];
+    milestone->name = name;
+    milestone->ns = timer_now_ns() - timeline->startNs;
+}
+
+static int
+_startup_compare(const void* a, const void* b) {
+    const StartupPhase* lhs = (const StartupPhase*)a;
+    const StartupPhase* rhs = (const StartupPhase*)b;
+    return lhs->ns > rhs->ns ? -1 : lhs->ns < rhs->ns;
+}
+
+static void
+_startup_log(StartupTimeline* timeline, u8 worker) {
+
+    StartupPhase sorted[STARTUP_MAX_PHASES];
+    u32 count = 0;
+    u64 total = 0;
+    mutex_lock(&timeline->lock);
+    for(u32 i = 0; i < timeline->numPhases; i++) {
+        if(timeline->phases[i].worker != worker) continue;
+        sorted[count++] = timeline->phases[i];
+        total += timeline->phases[i].ns;
+    }
+    mutex_unlock(&timeline->lock);
+    if(!count) return;
+    qsort(sorted, count, sizeof *sorted, _startup_compare);
+    LOG("%s %.1f ms:", worker ? "Startup work in workers" : "Init steps on main thread",
+            (double)total / 1e6);
+    for(u32 i = 0; i < count; i++) {
+        LOG("    %8.1f ms %5.1f%%  %s", (double)sorted[i].ns / 1e6,
+                total ? 100.0 * (double)sorted[i].ns / (double)total : 0.0, sorted[i].name);
+    }
+}
+
+// Breakdown of init, call when it is done
+static void
+startup_report(StartupTimeline* timeline) {
+    startup_milestone(timeline, "init");
+    _startup_log(timeline, 0);
+    _startup_log(timeline, 1);
+}
+
+// Startup is over, workers are logged again with what finished after init. jsonPath can be NULL
+static u8
+startup_finish(StartupTimeline* timeline, const char* jsonPath) {
+
+    mutex_lock(&timeline->lock);
+    timeline->finished = 1;
+    mutex_unlock(&timeline->lock);
+    _startup_log(timeline, 1);
+    if(!jsonPath) return 1;
+
+    FILE* fp = fopen(jsonPath, "w");
+    if(!fp) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Could not write startup times %s", jsonPath);
+        return 0;
+    }
+    fprintf(fp, "{\n\"milestones\": {");
+    for(u32 i = 0; i < timeline->numMilestones; i++) {
+        fprintf(fp, "%s\"%s\": %.3f", i ? ", " : "", timeline->milestones[i].name,
+                (double)timeline->milestones[i].ns / 1e6);
+    }
+    fprintf(fp, "},\n\"phases\": [");
+    for(u32 i = 0; i < timeline->numPhases; i++) {
+        const StartupPhase* phase = &timeline->phases[i];
+        fprintf(fp, "%s\n{\"name\": \"", i ? "," : "");
+        for(const char* c = phase->name; *c; c++) {
+            if(*c == '"' || *c == '\\') fputc('\\', fp);
+            fputc(*c, fp);
+        }
+        fprintf(fp, "\", \"thread\": \"%s\", \"startMs\": %.3f, \"ms\": %.3f}",
+                phase->worker ? "worker" : "main", (double)phase->start / 1e6, (double)phase->ns / 1e6);
+    }
+    fprintf(fp, "\n]\n}\n");
+    u8 ok = !ferror(fp);
+    fclose(fp);
+    LOG("Wrote startup times to %s", jsonPath);
+    return ok;
+}
+
+static void
+startup_dispose(StartupTimeline* timeline) {
+    mutex_dispose(&timeline->lock);
+}
+
+#endif /* STARTUP_H */
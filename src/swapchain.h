@@ -12,6 +12,7 @@
 #include "cmath.h"
 #include "imageview.h"
 #include "physicalDevice.h"
+#include "profiler.h"
 
 typedef struct SwapChain {
     VkSwapchainKHR  swapchain;
@@ -69,6 +70,7 @@ static VkExtent2D _swapchain_choose_extent(const VkSurfaceCapabilitiesKHR* capab
 static void swapchain_init(SwapChain* swapchain,const VkPhysicalDevice physicalDevice,
         const VkSurfaceKHR surface,const QueueFamilyIndices indexes,const VkDevice logicalDevice) {
 
+    PROFILE_FUNCTION();
     SwapchainSupportDetails supportDetails =
         physicaldevice_get_swapchain_support_details(physicalDevice,surface);
 
@@ -0,0 +1,256 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Offline texture converter, writes mip chain of an image as BC1 or BC3 blocks to dds
+// next to the source so the texture streamer reads it instead of decoding the source.
+// Build with texconvert.sh, usage: texconvert [-bc1 | -bc3] image...
+// Without a flag BC3 is used when image has alpha, BC1 otherwise
+
+#include "utils.h"
+#include "cmath.h"
+#include "timer.h"
+#include "dds.h"
+#include "mipgen.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../external/stb_image.h"
+
+static ThreadPool g_threadPool;     // mips of big images are built in bands
+
+typedef enum BlockFormat {
+    BlockAuto,
+    BlockBC1,
+    BlockBC3,
+} BlockFormat;
+
+static inline u16
+_rgb_to_565(const u8* c) {
+    return (u16)(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static inline void
+_565_to_rgb(u16 v, i32* c) {
+    c[0] = ((v >> 11) & 31) * 255 / 31;
+    c[1] = ((v >> 5) & 63) * 255 / 63;
+    c[2] = (v & 31) * 255 / 31;
+}
+
+// Endpoints from bounding box of the block inset a bit, indices to closest of four colors
+static void
+_encode_bc1_block(const u8 block[16][4], u8* dst) {
+
+    u8 lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for(u32 i = 0; i < 16; i++) {
+        for(u32 c = 0; c < 3; c++) {
+            if(block[i][c] < lo[c]) lo[c] = block[i][c];
+            if(block[i][c] > hi[c]) hi[c] = block[i][c];
+        }
+    }
+    for(u32 c = 0; c < 3; c++) {
+        u8 inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    u16 c0 = _rgb_to_565(hi), c1 = _rgb_to_565(lo);
+    u32 indices = 0;
+    if(c0 < c1) {
+        u16 tmp = c0; c0 = c1; c1 = tmp;
+    }
+    // c0 > c1 is the four color mode, equal endpoints mean solid block with index 0
+    if(c0 != c1) {
+        i32 palette[4][3];
+        _565_to_rgb(c0, palette[0]);
+        _565_to_rgb(c1, palette[1]);
+        for(u32 c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for(u32 i = 0; i < 16; i++) {
+            u32 best = 0;
+            i32 bestDist = 0x7FFFFFFF;
+            for(u32 p = 0; p < 4; p++) {
+                i32 dr = block[i][0] - palette[p][0];
+                i32 dg = block[i][1] - palette[p][1];
+                i32 db = block[i][2] - palette[p][2];
+                i32 dist = dr * dr + dg * dg + db * db;
+                if(dist < bestDist) {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+    memcpy(dst, &c0, 2);
+    memcpy(dst + 2, &c1, 2);
+    memcpy(dst + 4, &indices, 4);
+}
+
+// Eight interpolated alphas between min and max
+static void
+_encode_bc3_alpha(const u8 block[16][4], u8* dst) {
+
+    u8 lo = 255, hi = 0;
+    for(u32 i = 0; i < 16; i++) {
+        if(block[i][3] < lo) lo = block[i][3];
+        if(block[i][3] > hi) hi = block[i][3];
+    }
+    dst[0] = hi;
+    dst[1] = lo;
+    u64 indices = 0;
+    if(hi != lo) {
+        u32 palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for(u32 p = 1; p < 7; p++) {
+            palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+        }
+        for(u32 i = 0; i < 16; i++) {
+            u32 best = 0;
+            i32 bestDist = 256;
+            for(u32 p = 0; p < 8; p++) {
+                i32 dist = abs((i32)block[i][3] - (i32)palette[p]);
+                if(dist < bestDist) {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= (u64)best << (i * 3);
+        }
+    }
+    memcpy(dst + 2, &indices, 6);
+}
+
+static void
+_encode_image(const u8* pixels, u32 width, u32 height, BlockFormat format, u8* dst) {
+
+    u32 blockBytes = format == BlockBC1 ? 8 : 16;
+    for(u32 by = 0; by < (height + 3) / 4; by++) {
+        for(u32 bx = 0; bx < (width + 3) / 4; bx++) {
+            // edge blocks repeat last row and column
+            u8 block[16][4];
+            for(u32 i = 0; i < 16; i++) {
+                u32 x = min_u32(bx * 4 + i % 4, width - 1);
+                u32 y = min_u32(by * 4 + i / 4, height - 1);
+                memcpy(block[i], &pixels[(y * width + x) * 4], 4);
+            }
+            if(format == BlockBC1) {
+                _encode_bc1_block(block, dst);
+            } else {
+                _encode_bc3_alpha(block, dst);
+                _encode_bc1_block(block, dst + 8);
+            }
+            dst += blockBytes;
+        }
+    }
+}
+
+static u8
+_has_alpha(const u8* pixels, u32 width, u32 height) {
+    for(size_t i = 0; i < (size_t)width * height; i++) {
+        if(pixels[i * 4 + 3] != 255) return 1;
+    }
+    return 0;
+}
+
+static u8
+_convert(const char* path, BlockFormat format) {
+
+    u64 start = timer_now_ns();
+    i32 w, h, channels;
+    u8* pixels = stbi_load(path, &w, &h, &channels, STBI_rgb_alpha);
+    if(!pixels) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Failed to load %s", path);
+        return 0;
+    }
+    u64 decodeNs = timer_now_ns() - start;
+    u32 width = (u32)w, height = (u32)h;
+
+    if(format == BlockAuto) {
+        format = _has_alpha(pixels, width, height) ? BlockBC3 : BlockBC1;
+    }
+    u32 blockBytes = format == BlockBC1 ? 8 : 16;
+    u32 dxgi = format == BlockBC1 ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM_SRGB;
+    u32 mipLevels = mipgen_levels(width, height);
+
+    char dstPath[256];
+    const char* dot = strrchr(path, '.');
+    u32 len = dot ? (u32)(dot - path) : (u32)strlen(path);
+    snprintf(dstPath, sizeof dstPath, "%.*s.dds", len, path);
+    FILE* fp = fopen(dstPath, "wb");
+    if(!fp) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Failed to open %s", dstPath);
+        stbi_image_free(pixels);
+        return 0;
+    }
+    dds_write_header(fp, dxgi, blockBytes, width, height, mipLevels);
+
+    start = timer_now_ns();
+    MipChain chain;
+    mipchain_build(&chain, pixels, width, height, &g_threadPool);
+    stbi_image_free(pixels);
+
+    size_t blockTotal = 0;
+    u8* blocks = (u8*)malloc(dds_mip_size(blockBytes, width, height));
+    u32 levelWidth = width, levelHeight = height;
+    for(u32 i = 0; i < mipLevels; i++) {
+        size_t size = dds_mip_size(blockBytes, levelWidth, levelHeight);
+        _encode_image(chain.data + chain.offsets[i], levelWidth, levelHeight, format, blocks);
+        fwrite(blocks, size, 1, fp);
+        blockTotal += size;
+        if(levelWidth > 1) levelWidth /= 2;
+        if(levelHeight > 1) levelHeight /= 2;
+    }
+    size_t rgbaBytes = chain.size;
+    mipchain_dispose(&chain);
+    free(blocks);
+    fclose(fp);
+    u64 encodeNs = timer_now_ns() - start;
+
+    // what loading costs at startup, decode of source against plain read of blocks
+    start = timer_now_ns();
+    FileView file;
+    DdsImage check;
+    u8 valid = file_map(dstPath, &file) && dds_parse(file.data, file.size, &check);
+    u64 readNs = timer_now_ns() - start;
+    file_unmap(&file);
+    if(!valid) {
+        LOG_ERR(CONSOLE_COLOR_RED, "Written %s does not parse", dstPath);
+        return 0;
+    }
+
+    LOG("%s -> %s %ux%u %s %u mips, encoded in %.1f ms", path, dstPath, width, height,
+            format == BlockBC1 ? "BC1" : "BC3", mipLevels, (double)encodeNs / 1e6);
+    LOG("  gpu memory %.2f MB, rgba8 with mips %.2f MB (%.1fx smaller)",
+            (double)blockTotal / (1024.0 * 1024.0), (double)rgbaBytes / (1024.0 * 1024.0),
+            (double)rgbaBytes / (double)blockTotal);
+    LOG("  load %.2f ms for dds, %.2f ms to decode source without mips", (double)readNs / 1e6,
+            (double)decodeNs / 1e6);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+
+    if(argc < 2) {
+        printf("usage: %s [-bc1 | -bc3] image...\n", argv[0]);
+        return 1;
+    }
+    mipgen_init();
+    threadpool_init(&g_threadPool, 0);
+
+    BlockFormat format = BlockAuto;
+    u32 failed = 0;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-bc1")) {
+            format = BlockBC1;
+        } else if(!strcmp(argv[i], "-bc3")) {
+            format = BlockBC3;
+        } else if(!_convert(argv[i], format)) {
+            failed++;
+        }
+    }
+    threadpool_dispose(&g_threadPool);
+    return failed ? 1 : 0;
+}
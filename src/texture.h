@@ -12,6 +12,13 @@
 #include "commandBuffer.h"
 #include "imageview.h"
 #include "physicalDevice.h"
+#include "threadpool.h"
+#include "timer.h"
+#include "pack.h"
+#include "dds.h"
+#include "mipgen.h"
+#include "sampler.h"
+#include "profiler.h"
 
 typedef enum TextureType {
     TextureSample = (1 << 0),
@@ -34,7 +41,12 @@ static u8*
 _load_texture_data(const char* path, u32* width, u32* height) {
 
     i32 channels, _width, _height;
-    stbi_uc* data = stbi_load(path, &_width, &_height, &channels, STBI_rgb_alpha);
+    VfsFile file;
+    stbi_uc* data = NULL;
+    if(vfs_open(path, &file)) {
+        data = stbi_load_from_memory(file.data, (int)file.size, &_width, &_height, &channels, STBI_rgb_alpha);
+        vfs_close(&file);
+    }
     if(!data) {
         ABORT("Failed to load texture %s", path);
     }
@@ -124,53 +136,48 @@ _texture_to_layout(const Texture* tex, VkDevice device, VkCommandPool pool, VkQu
     commandbuffer_end_single_time(device, cmd, pool, graphicsQue);
 }
 
+// Shared sampler, maxLod is not clamped since view already limits the levels.
+// Formats without linear filtering get nearest between mips too
 static VkSampler
-_texture_create_sampler(VkDevice device, VkFilter filter, u32 mipLevels) {
-
-    VkSampler ret;
-
-    VkSamplerCreateInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    info.magFilter = filter;
-    info.minFilter = filter;
-    info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    info.anisotropyEnable = VK_TRUE;
-    info.maxAnisotropy = 16;
-    info.unnormalizedCoordinates = VK_FALSE;
-    info.compareEnable = VK_FALSE;
-    info.compareOp = VK_COMPARE_OP_ALWAYS;
+_texture_create_sampler(VkDevice device, VkFilter filter) {
+
+    SamplerDesc desc;
+    memset(&desc, 0, sizeof desc);
+    desc.magFilter = filter;
+    desc.minFilter = filter;
+    desc.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    desc.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    desc.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    desc.anisotropyEnable = VK_TRUE;
+    desc.maxAnisotropy = 16;
+    desc.unnormalizedCoordinates = VK_FALSE;
+    desc.compareEnable = VK_FALSE;
+    desc.compareOp = VK_COMPARE_OP_ALWAYS;
 
     //Mipmap data
-    info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    info.mipLodBias = 0.0f;
-    info.minLod =  0.0f;
-    //info.minLod = (float)mipLevels / 2.f;
-    info.maxLod = (float)mipLevels;
-
-    if(vkCreateSampler(device, &info, NULL /*allocator*/, &ret) != VK_SUCCESS) {
-        ABORT("Failed to create sampler");
-    }
+    desc.mipmapMode = filter == VK_FILTER_LINEAR ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    desc.mipLodBias = 0.0f;
+    desc.minLod =  0.0f;
+    desc.maxLod = VK_LOD_CLAMP_NONE;
 
-    return ret;
+    return sampler_get(device, &desc);
 }
 
 static Texture
-texture_create(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format,
-        VkImageUsageFlags usage, u32 width, u32 height, TextureType type) {
+_texture_create_image(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format,
+        VkImageUsageFlags usage, u32 width, u32 height, u32 mipLevels, TextureType type) {
 
-    u32 mipLevels = 1;
-    if(BIT_CHECK(type, TextureMipmap)) {
-        mipLevels = (uint32_t)(floorf(log2f(max_u32(width, height)))) + 1;
-    }
+    // sampling with linear filter is undefined for formats that do not support it
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    u8 linear = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
 
     Texture ret  = {
         .height = height,
         .width = width,
         .type = type,
         .mipLevels = mipLevels,
-        .filter = VK_FILTER_LINEAR,
+        .filter = linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST,
     };
 
     VkImageCreateInfo info = {};
@@ -216,6 +223,17 @@ texture_create(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format
     return ret;
 }
 
+static Texture
+texture_create(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format,
+        VkImageUsageFlags usage, u32 width, u32 height, TextureType type) {
+
+    u32 mipLevels = 1;
+    if(BIT_CHECK(type, TextureMipmap)) {
+        mipLevels = (uint32_t)(floorf(log2f(max_u32(width, height)))) + 1;
+    }
+    return _texture_create_image(physicalDevice, device, format, usage, width, height, mipLevels, type);
+}
+
 static void
 _texture_generate_mipmaps(const Texture* tex, VkFormat format,VkPhysicalDevice physicalDevice,
         VkDevice device, VkCommandPool pool, VkQueue graphicsQue) {
@@ -328,14 +346,129 @@ _texture_generate_mipmaps(const Texture* tex, VkFormat format,VkPhysicalDevice p
     commandbuffer_end_single_time(device, cmd, pool, graphicsQue);
 }
 
+// Same file with other extension, like the .dds made by texconvert
+static void
+_texture_sibling_path(const char* path, const char* extension, char* dst, u32 dstSize) {
+    const char* dot = strrchr(path, '.');
+    u32 len = dot ? (u32)(dot - path) : (u32)strlen(path);
+    snprintf(dst, dstSize, "%.*s%s", len, path, extension);
+}
+
+static u8
+texture_format_supported(VkPhysicalDevice physicalDevice, VkFormat format) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+// Copy of levels from buffer to a new image with both layout changes around it.
+// Level i is at offsets[i] - base in buffer
+static void
+_texture_record_levels(VkCommandBuffer cmd, VkBuffer buffer, size_t base, const size_t* offsets,
+        VkImage image, u32 width, u32 height, u32 mipLevels) {
+
+    VkBufferImageCopy regions[MIPGEN_MAX_LEVELS] = {};
+    ASSERT_MESSAGE(mipLevels <= MIPGEN_MAX_LEVELS, "Too many mip levels");
+    for(u32 i = 0; i < mipLevels; i++) {
+        regions[i].bufferOffset = offsets[i] - base;
+        regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].imageSubresource.mipLevel = i;
+        regions[i].imageSubresource.layerCount = 1;
+        regions[i].imageExtent = (VkExtent3D){.width = width, .height = height, 1};
+        if(width > 1) width /= 2;
+        if(height > 1) height /= 2;
+    }
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, NULL,
+            0, NULL,
+            1, &barrier);
+
+    vkCmdCopyBufferToImage(cmd, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, NULL,
+            0, NULL,
+            1, &barrier);
+}
+
+// All levels are in data already, copied with one region per mip and both layout
+// changes in the same submit
+static Texture
+_texture_upload_levels(const u8* data, size_t size, const size_t* offsets, VkFormat format,
+        u32 width, u32 height, u32 mipLevels, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue, TextureType type) {
+
+    Buffer stagingBuffer = buffer_create(physicalDevice, device, size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // usage
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT); // memrequiremets
+
+    void* stagingDst;
+    vkMapMemory(device, stagingBuffer.bufferMemory, 0, size, 0, &stagingDst);
+    memcpy(stagingDst, data, size);
+    vkUnmapMemory(device, stagingBuffer.bufferMemory);
+
+    // streamer copies levels out when it drops finer ones
+    Texture ret = _texture_create_image(physicalDevice, device, format,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            width, height, mipLevels, type);
+
+    VkCommandBuffer cmd = commandbuffer_begin_single_time(device, pool);
+    _texture_record_levels(cmd, stagingBuffer.bufferId, 0 /*buffer offset*/, offsets, ret.image,
+            width, height, mipLevels);
+    commandbuffer_end_single_time(device, cmd, pool, graphicsQue);
+
+    ret.view = imageview_create(ret.image, ret.mipLevels, format, VK_IMAGE_ASPECT_COLOR_BIT, device);
+    ret.sampler = _texture_create_sampler(device, ret.filter);
+
+    buffer_dispose(&stagingBuffer, device);
+    return ret;
+}
+
+// Upload mips generated on cpu, works without linear blit support
 static Texture
-texture_load_and_create(const char* path, VkPhysicalDevice physicalDevice, VkDevice device,
+texture_create_from_mipchain(const MipChain* chain, VkPhysicalDevice physicalDevice, VkDevice device,
         VkCommandPool pool, VkQueue graphicsQue, TextureType type) {
 
-    u32 width,height;
+    return _texture_upload_levels(chain->data, chain->size, chain->offsets, VK_FORMAT_R8G8B8A8_SRGB,
+            chain->width, chain->height, chain->mipLevels, physicalDevice, device, pool, graphicsQue, type);
+}
+
+// Upload decoded rgba pixels, caller owns data
+static Texture
+texture_create_from_pixels(const u8* data, u32 width, u32 height, VkPhysicalDevice physicalDevice,
+        VkDevice device, VkCommandPool pool, VkQueue graphicsQue, TextureType type) {
+
+    // no linear blit, build mips on cpu instead
+    if(BIT_CHECK(type, TextureMipmap) && !texture_format_supported(physicalDevice, VK_FORMAT_R8G8B8A8_SRGB)) {
+        MipChain chain;
+        mipchain_build(&chain, data, width, height, NULL /*threads*/);
+        Texture ret = texture_create_from_mipchain(&chain, physicalDevice, device, pool, graphicsQue, type);
+        mipchain_dispose(&chain);
+        return ret;
+    }
 
-    // Load texture
-    u8* data = _load_texture_data(path, &width, &height);
     VkDeviceSize size = width * height * 4;
 
     // create buffer and copy data to image
@@ -392,19 +525,48 @@ texture_load_and_create(const char* path, VkPhysicalDevice physicalDevice, VkDev
 
 
     ret.view = imageview_create(ret.image, ret.mipLevels,VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT,device);
-    ret.sampler = _texture_create_sampler(device, ret.filter, ret.mipLevels);
+    ret.sampler = _texture_create_sampler(device, ret.filter);
 
     buffer_dispose(&stagingBuffer, device);
+    return ret;
+}
+
+static Texture
+texture_load_and_create(const char* path, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue, TextureType type) {
+
+    u32 width,height;
+
+    // Load texture
+    u8* data = _load_texture_data(path, &width, &height);
+    Texture ret = texture_create_from_pixels(data, width, height, physicalDevice, device,
+            pool, graphicsQue, type);
     stbi_image_free(data);
     return ret;
 }
 
+// Upload blocks of every mip as they are, no decoding or mip generation.
+// Returns 0 when gpu can not sample the format, caller falls back to rgba8
+static u8
+texture_create_from_dds(const DdsImage* dds, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue, TextureType type, Texture* ret) {
+
+    if(!texture_format_supported(physicalDevice, dds->format)) {
+        return 0;
+    }
+
+    // chain comes from file, TextureMipmap does not generate more
+    *ret = _texture_upload_levels(dds->data, dds->dataSize, dds->mipOffsets, dds->format,
+            dds->width, dds->height, dds->mipLevels, physicalDevice, device, pool, graphicsQue, type);
+    return 1;
+}
+
 static void
 texture_dispose(Texture* tex, VkDevice device) {
 
     imageview_dispose(tex->view, device);
-    if(BIT_CHECK(tex->type, TextureSample)) {
-        vkDestroySampler(device, tex->sampler, NULL);
+    if(tex->sampler) {
+        sampler_release(device, tex->sampler);
     }
     vkDestroyImage(device, tex->image, NULL /*allocator*/);
     vkFreeMemory(device, tex->memory, NULL /*allocator*/);
@@ -419,11 +581,12 @@ _format_has_stencil(VkFormat format) {
 static Texture
 texture_depth_create(VkPhysicalDevice physicalDevice, VkDevice device, VkExtent2D swapExtent) {
 
+    PROFILE_FUNCTION();
 
     VkFormat format = physicaldevice_find_depth_format(physicalDevice);
 
     Texture ret = texture_create(physicalDevice, device,
-            format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
             swapExtent.width, swapExtent.height, TextureDepth);
 
     ret.view = imageview_create(ret.image, ret.mipLevels,format, VK_IMAGE_ASPECT_DEPTH_BIT, device);
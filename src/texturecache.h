@@ -0,0 +1,244 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Streamed textures shared by everything that asks for the same image. Lookup is by canonical
+// path first, and when the path is new by hash of the file so copies and links of an image
+// are streamed only once. Handles are reference counted. Levels are up to the streamer which
+// drops the ones nobody draws first, unreferenced textures stay in the streamer until resident
+// bytes of the cache go over its budget and then least recently used ones are removed.
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <limits.h>
+#include <stdlib.h>
+#include "utils.h"
+#include "hash_table.h"
+#include "texturestream.h"
+
+#if defined(WINDOWS_PLATFORM)
+#define TEXTURE_CACHE_PATH_MAX _MAX_PATH
+#else
+#define TEXTURE_CACHE_PATH_MAX PATH_MAX
+#endif
+
+#define TEXTURE_CACHE_INVALID 0xFFFFFFFF
+
+// Key is 64 bit hash of canonical path or file contents, value is handle of streamer
+DECLARE_HASHTABLEKEY(u64, TextureKey);
+DECLARE_HASHTABLE(TextureKeyKey, TextureKey, texturekey);
+
+// One for each streamer handle
+typedef struct TextureCacheEntry {
+    u64     lastUsed;
+    u32     refs;
+    u8      loaded;
+} TextureCacheEntry;
+
+typedef struct TextureCache {
+    TextureCacheEntry       entries[TEXTURESTREAM_MAX_TEXTURES];
+    TextureKeyHashTable     paths;
+    TextureKeyHashTable     contents;
+    TextureStreamer*        streamer;
+    VkDeviceSize            budget;     // resident bytes of all cached textures
+    u64                     tick;
+    u32                     hits;       // found by path or contents
+    u32                     misses;     // added to streamer
+    u32                     evictions;  // removed from streamer
+} TextureCache;
+
+static inline u64
+_texturecache_hash(u64 hash, const void* data, size_t size) {
+    // fnv-1a
+    const u8* bytes = (const u8*)data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static void
+texturecache_init(TextureCache* cache, TextureStreamer* streamer, VkDeviceSize budget) {
+
+    memset(cache, 0, sizeof *cache);
+    cache->streamer = streamer;
+    cache->budget = budget;
+    texturekey_hashtable_init(&cache->paths, sizeof(u32), 0);
+    texturekey_hashtable_init(&cache->contents, sizeof(u32), 0);
+}
+
+static VkDeviceSize
+_texturecache_used(TextureCache* cache) {
+    VkDeviceSize ret = 0;
+    for(u32 i = 0; i < TEXTURESTREAM_MAX_TEXTURES; i++) {
+        if(cache->entries[i].loaded) ret += texturestream_resident_bytes(cache->streamer, i);
+    }
+    return ret;
+}
+
+// Every key of the handle, removing moves the keys after it so scan starts again
+static void
+_texturecache_drop_keys(TextureKeyHashTable* table, u32 handle) {
+    for(u32 i = 0; i < table->size;) {
+        u32 value = *(const u32*)(table->values + i * table->sizeOfValue);
+        if(table->keys[i].hash && value == handle) {
+            texturekey_hashtable_remove(table, table->keys[i].key);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+}
+
+// Least recently used unreferenced texture is removed from streamer, returns 0 when every
+// texture is referenced or can not be removed while it is loading or changing
+static u8
+_texturecache_evict_oldest(TextureCache* cache, BindlessTextures* bindless, const Texture* placeholder,
+        VkDevice device) {
+
+    u8 busy[TEXTURESTREAM_MAX_TEXTURES] = {0};
+    for(;;) {
+        u32 oldest = TEXTURE_CACHE_INVALID;
+        for(u32 i = 0; i < TEXTURESTREAM_MAX_TEXTURES; i++) {
+            const TextureCacheEntry* entry = &cache->entries[i];
+            if(!entry->loaded || entry->refs || busy[i]) continue;
+            if(oldest == TEXTURE_CACHE_INVALID || entry->lastUsed < cache->entries[oldest].lastUsed) {
+                oldest = i;
+            }
+        }
+        if(oldest == TEXTURE_CACHE_INVALID) return 0;
+
+        if(!texturestream_remove(cache->streamer, oldest, bindless, placeholder, device)) {
+            busy[oldest] = 1;
+            continue;
+        }
+        _texturecache_drop_keys(&cache->paths, oldest);
+        _texturecache_drop_keys(&cache->contents, oldest);
+        cache->entries[oldest].loaded = 0;
+        cache->evictions++;
+        return 1;
+    }
+}
+
+// Removes textures nobody holds until cache is within budget, goes over it when everything
+// left is referenced. Streamer slots run out before memory with small textures so a full
+// streamer also makes room for one
+static void
+_texturecache_trim(TextureCache* cache, BindlessTextures* bindless, const Texture* placeholder,
+        VkDevice device) {
+
+    while(_texturecache_used(cache) > cache->budget &&
+            _texturecache_evict_oldest(cache, bindless, placeholder, device));
+
+    TextureStreamer* streamer = cache->streamer;
+    if(streamer->numTextures < TEXTURESTREAM_MAX_TEXTURES) return;
+    for(u32 i = 0; i < streamer->numTextures; i++) {
+        if(!cache->entries[i].loaded) return;
+    }
+    _texturecache_evict_oldest(cache, bindless, placeholder, device);
+}
+
+// Packed paths are already relative to root and unique, loose ones go through the os
+static u8
+_texturecache_canonical(const char* path, char* dst, size_t dstSize) {
+    if(vfs_packed(path)) {
+        _pack_normalize(path, dst, dstSize);
+        return 1;
+    }
+#if defined(WINDOWS_PLATFORM)
+    return _fullpath(dst, path, dstSize) != NULL;
+#else
+    ASSERT_MESSAGE(dstSize >= PATH_MAX, "realpath needs PATH_MAX bytes");
+    return realpath(path, dst) != NULL;
+#endif
+}
+
+// Streamer handle of the image, added to streamer only if neither path nor contents are known.
+// Unreferenced textures over the budget are removed first, their materials go back to placeholder.
+// Every acquire needs a texturecache_release
+static u32
+texturecache_acquire(TextureCache* cache, const char* path, BindlessTextures* bindless,
+        const Texture* placeholder, VkDevice device) {
+
+    char canonical[TEXTURE_CACHE_PATH_MAX];
+    if(!_texturecache_canonical(path, canonical, sizeof canonical)) {
+        ABORT("Failed to load texture %s", path);
+    }
+    cache->tick++;
+    u64 pathHash = _texturecache_hash(0xCBF29CE484222325ULL, canonical, strlen(canonical));
+    u32* found = (u32*)texturekey_hashtable_access(&cache->paths, pathHash);
+    if(found) {
+        cache->hits++;
+        TextureCacheEntry* entry = &cache->entries[*found];
+        entry->refs++;
+        entry->lastUsed = cache->tick;
+        return *found;
+    }
+
+    // new path, file could still be a copy of something streamed
+    VfsFile file;
+    if(!vfs_open(canonical, &file)) {
+        ABORT("Failed to load texture %s", path);
+    }
+    u64 contentHash = _texturecache_hash(0xCBF29CE484222325ULL, file.data, file.size);
+    vfs_close(&file);
+
+    u32 handle;
+    found = (u32*)texturekey_hashtable_access(&cache->contents, contentHash);
+    if(found) {
+        cache->hits++;
+        handle = *found;
+        LOG("Texture %s has same contents as %s", path, cache->streamer->textures[handle].path);
+    } else {
+        cache->misses++;
+        _texturecache_trim(cache, bindless, placeholder, device);
+        handle = texturestream_add(cache->streamer, path, bindless, placeholder);
+        cache->entries[handle].loaded = 1;
+        texturekey_hashtable_insert(&cache->contents, contentHash, (u8*)&handle);
+    }
+    texturekey_hashtable_insert(&cache->paths, pathHash, (u8*)&handle);
+    TextureCacheEntry* entry = &cache->entries[handle];
+    entry->refs++;
+    entry->lastUsed = cache->tick;
+    return handle;
+}
+
+// Texture stays in streamer until the cache budget needs room, without requests its finer
+// levels are the first to go
+static void
+texturecache_release(TextureCache* cache, u32 handle) {
+    ASSERT_MESSAGE(handle < TEXTURESTREAM_MAX_TEXTURES && cache->entries[handle].refs,
+            "Texture released too many times");
+    cache->entries[handle].refs--;
+}
+
+static void
+texturecache_log_stats(TextureCache* cache) {
+
+    u32 loaded = 0;
+    for(u32 i = 0; i < TEXTURESTREAM_MAX_TEXTURES; i++) {
+        loaded += cache->entries[i].loaded;
+    }
+    u32 lookups = cache->hits + cache->misses;
+    LOG("Texture cache %u textures, %.1f / %.1f MB, %u hits %u misses (%.0f%% hit rate), %u evictions",
+            loaded, (double)_texturecache_used(cache) / (1024.0 * 1024.0),
+            (double)cache->budget / (1024.0 * 1024.0), cache->hits, cache->misses,
+            lookups ? 100.0 * cache->hits / lookups : 0.0, cache->evictions);
+}
+
+static void
+texturecache_dispose(TextureCache* cache) {
+
+    for(u32 i = 0; i < TEXTURESTREAM_MAX_TEXTURES; i++) {
+        if(cache->entries[i].refs) {
+            LOG("Texture cache entry %u still has %u references", i, cache->entries[i].refs);
+        }
+    }
+    texturekey_hashtable_dispose(&cache->paths);
+    texturekey_hashtable_dispose(&cache->contents);
+    memset(cache, 0, sizeof *cache);
+}
+
+#endif /* TEXTURECACHE_H */
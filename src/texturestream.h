@@ -0,0 +1,721 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Textures that start with only their small mips on gpu, finer levels are streamed in
+// when the screen size asks for them and dropped again when over the memory budget.
+// Levels are read from the dds or the mip cache, both store them coarsest last so
+// every residency is one contiguous read. Image only holds the resident levels, a change
+// builds a new image in the background and swaps it to the bindless slot when the upload is done.
+// Dropping levels copies the ones that stay from the old image instead of reading them again.
+// Adding does not wait either, slot shows a placeholder until the first levels are read.
+// Removed textures free their slot and bindless slot for the next ones.
+
+#ifndef TEXTURESTREAM_H
+#define TEXTURESTREAM_H
+
+#include <vulkan/vulkan.h>
+#include "utils.h"
+#include "texture.h"
+#include "bindless.h"
+#include "threadpool.h"
+#include "asyncio.h"
+#include "startup.h"
+#include "profiler.h"
+
+#define TEXTURESTREAM_MAX_TEXTURES 256
+// levels up to this size are loaded when texture is added
+#define TEXTURESTREAM_START_SIZE 128
+#define TEXTURESTREAM_MAX_RETIRED 16
+
+typedef enum StreamedTextureState {
+    StreamedTextureOpening,     // worker finds level file and reads first levels
+    StreamedTextureOpened,
+    StreamedTextureReady,
+    StreamedTextureFree,        // removed, slot is given to next added texture
+} StreamedTextureState;
+
+typedef struct StreamedTexture {
+    StreamedTextureState    state;  // guarded by lock of streamer until ready
+    u8*         startData;          // levels from startMip, read when opening
+    u32         startMip;
+    struct TextureStreamer* streamer;
+    char        path[256];
+    char        levelPath[256];     // dds or mip cache
+    size_t      dataOffset;         // where levels start in levelPath
+    VkFormat    format;
+    MipChain    layout;             // offsets of levels, no data
+    Texture     texture;            // levels [residentMip, mipLevels)
+    u32         residentMip;
+    u32         wantedMip;          // finest level asked since last update
+    u32         material;
+    u64         openNs;             // decode or level file lookup and first read in worker
+} StreamedTexture;
+
+typedef enum TextureStreamState {
+    TextureStreamIdle,
+    TextureStreamReading,       // worker reads levels from disk
+    TextureStreamRead,
+    TextureStreamUploading,     // copy submitted, waiting for fence
+} TextureStreamState;
+
+// One residency change in flight at a time
+typedef struct TextureStreamChange {
+    TextureStreamState  state;
+    u32                 texture;
+    u32                 targetMip;
+    u8*                 data;
+    u8                  failed;
+    Buffer              staging;
+    Texture             next;
+    VkCommandBuffer     cmd;
+    u64                 startNs;
+} TextureStreamChange;
+
+typedef struct TextureStreamer {
+    StreamedTexture     textures[TEXTURESTREAM_MAX_TEXTURES];
+    u32                 numTextures;
+    VkDeviceSize        budget;
+    VkDeviceSize        used;
+
+    TextureStreamChange change;
+    Mutex               lock;       // guards change.state and opening textures with workers
+    VkFence             fence;
+    ThreadPool*         threads;
+    AsyncIO*            io;         // level reads, pool reads compressed ones
+    VkPhysicalDevice    physicalDevice;
+
+    // replaced textures wait until frames that may sample them are done
+    Texture             retired[TEXTURESTREAM_MAX_RETIRED];
+    u64                 retiredFrame[TEXTURESTREAM_MAX_RETIRED];
+    u32                 numRetired;
+    u8*                 setsDirty;  // sets that still point to replaced textures
+    u32                 numSets;
+    u64                 frame;
+
+    // textures added while others were still opening are reported together
+    u64                 batchStart;
+    u64                 batchSerialNs;
+    u32                 batchCount;
+} TextureStreamer;
+
+static inline VkDeviceSize
+_texturestream_bytes(const StreamedTexture* tex, u32 mip) {
+    return tex->layout.size - tex->layout.offsets[mip];
+}
+
+// State is written by workers while opening
+static inline u8
+_texturestream_ready(TextureStreamer* streamer, const StreamedTexture* tex) {
+    mutex_lock(&streamer->lock);
+    u8 ret = tex->state == StreamedTextureReady;
+    mutex_unlock(&streamer->lock);
+    return ret;
+}
+
+static void
+texturestream_init(TextureStreamer* streamer, VkDeviceSize budget, ThreadPool* threads, AsyncIO* io,
+        VkPhysicalDevice physicalDevice, VkDevice device) {
+
+    PROFILE_FUNCTION();
+    memset(streamer, 0, sizeof *streamer);
+    streamer->budget = budget;
+    streamer->threads = threads;
+    streamer->io = io;
+    streamer->physicalDevice = physicalDevice;
+    mutex_init(&streamer->lock);
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if(vkCreateFence(device, &fenceInfo, NULL, &streamer->fence) != VK_SUCCESS) {
+        ABORT("Failed to create streaming fence");
+    }
+}
+
+static u8
+_texturestream_read(const StreamedTexture* tex, u32 firstMip, u8* dst) {
+
+    return vfs_read_range(tex->levelPath, tex->dataOffset + tex->layout.offsets[firstMip],
+            _texturestream_bytes(tex, firstMip), dst);
+}
+
+// Finds the level file, prebuilt dds first and mip cache otherwise. Cache is built
+// here when it is missing so only first run pays for decoding
+static void
+_texturestream_open(StreamedTexture* tex, VkPhysicalDevice physicalDevice, ThreadPool* threads) {
+
+    _texture_sibling_path(tex->path, ".dds", tex->levelPath, sizeof tex->levelPath);
+    VfsFile file;
+    if(vfs_open(tex->levelPath, &file)) {
+        DdsImage dds;
+        if(dds_parse(file.data, file.size, &dds) && texture_format_supported(physicalDevice, dds.format)) {
+            tex->format = dds.format;
+            tex->dataOffset = (size_t)(dds.data - file.data);
+            tex->layout.width = dds.width;
+            tex->layout.height = dds.height;
+            tex->layout.mipLevels = dds.mipLevels;
+            tex->layout.size = dds.dataSize;
+            memcpy(tex->layout.offsets, dds.mipOffsets, sizeof dds.mipOffsets);
+            vfs_close(&file);
+            return;
+        }
+        vfs_close(&file);
+    }
+
+    _texture_sibling_path(tex->path, ".mips", tex->levelPath, sizeof tex->levelPath);
+    MipCacheHeader header;
+    if(!mipchain_cache_header(tex->levelPath, tex->path, &header)) {
+        char name[64];
+        u64 start = timer_now_ns();
+        u32 width, height;
+        u8* pixels = _load_texture_data(tex->path, &width, &height);
+        snprintf(name, sizeof name, "decode %.40s", tex->path);
+        startup_task(&g_startup, name, start, timer_now_ns() - start);
+
+        start = timer_now_ns();
+        MipChain chain;
+        mipchain_build(&chain, pixels, width, height, threads);
+        stbi_image_free(pixels);
+        mipchain_cache_save(&chain, tex->levelPath, tex->path);
+        mipchain_dispose(&chain);
+        snprintf(name, sizeof name, "mipmaps %.40s", tex->path);
+        startup_task(&g_startup, name, start, timer_now_ns() - start);
+        if(!mipchain_cache_header(tex->levelPath, tex->path, &header)) {
+            ABORT("Could not write mip cache %s for streaming", tex->levelPath);
+        }
+    }
+    tex->format = VK_FORMAT_R8G8B8A8_SRGB;
+    tex->dataOffset = sizeof header;
+    mipchain_layout(&tex->layout, header.width, header.height, header.mipLevels);
+}
+
+// Image for levels [mip, mipLevels) without data
+static Texture
+_texturestream_image(const StreamedTexture* tex, u32 mip, VkPhysicalDevice physicalDevice, VkDevice device) {
+    u32 width = max_u32(tex->layout.width >> mip, 1);
+    u32 height = max_u32(tex->layout.height >> mip, 1);
+    Texture ret = _texture_create_image(physicalDevice, device, tex->format,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            width, height, tex->layout.mipLevels - mip, TextureSample | TextureMipmap);
+    ret.view = imageview_create(ret.image, ret.mipLevels, tex->format, VK_IMAGE_ASPECT_COLOR_BIT, device);
+    ret.sampler = _texture_create_sampler(device, ret.filter);
+    return ret;
+}
+
+static void
+_texturestream_open_job(void* data) {
+
+    PROFILE_FUNCTION();
+    StreamedTexture* tex = (StreamedTexture*)data;
+    TextureStreamer* streamer = tex->streamer;
+    u64 openStart = timer_now_ns();
+    _texturestream_open(tex, streamer->physicalDevice, streamer->threads);
+
+    u32 mip = 0;
+    while(mip + 1 < tex->layout.mipLevels &&
+            max_u32(tex->layout.width >> mip, tex->layout.height >> mip) > TEXTURESTREAM_START_SIZE) {
+        mip++;
+    }
+    u64 start = timer_now_ns();
+    tex->startData = (u8*)malloc(_texturestream_bytes(tex, mip));
+    if(!_texturestream_read(tex, mip, tex->startData)) {
+        ABORT("Failed to read levels of %s", tex->levelPath);
+    }
+    char name[64];
+    snprintf(name, sizeof name, "read levels %.40s", tex->levelPath);
+    startup_task(&g_startup, name, start, timer_now_ns() - start);
+    tex->startMip = mip;
+    tex->openNs = timer_now_ns() - openStart;
+
+    mutex_lock(&streamer->lock);
+    tex->state = StreamedTextureOpened;
+    mutex_unlock(&streamer->lock);
+}
+
+// Returns handle for requests right away, material of the texture samples placeholder until
+// texturestream_update has uploaded levels up to TEXTURESTREAM_START_SIZE
+static u32
+texturestream_add(TextureStreamer* streamer, const char* path, BindlessTextures* bindless,
+        const Texture* placeholder) {
+
+    // removed slots first, nothing but the main thread touches a free slot
+    u32 handle = 0;
+    while(handle < streamer->numTextures && streamer->textures[handle].state != StreamedTextureFree) handle++;
+    if(handle == streamer->numTextures) {
+        ASSERT_MESSAGE(streamer->numTextures < TEXTURESTREAM_MAX_TEXTURES, "Too many streamed textures");
+        streamer->numTextures++;
+    }
+    StreamedTexture* tex = &streamer->textures[handle];
+    memset(tex, 0, sizeof *tex);
+    snprintf(tex->path, sizeof tex->path, "%s", path);
+    tex->streamer = streamer;
+    tex->state = StreamedTextureOpening;
+    tex->material = bindless_register(bindless, placeholder);
+    if(!streamer->batchStart) streamer->batchStart = timer_now_ns();
+    threadpool_push(streamer->threads, _texturestream_open_job, tex);
+    return handle;
+}
+
+// First levels replace the placeholder, nothing in flight samples the texture itself yet
+static void
+_texturestream_upload_start(TextureStreamer* streamer, StreamedTexture* tex, BindlessTextures* bindless,
+        VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool pool, VkQueue graphicsQue) {
+
+    u64 start = timer_now_ns();
+    u32 mip = tex->startMip;
+    size_t offsets[MIPGEN_MAX_LEVELS];
+    for(u32 i = mip; i < tex->layout.mipLevels; i++) {
+        offsets[i - mip] = tex->layout.offsets[i] - tex->layout.offsets[mip];
+    }
+    tex->texture = _texture_upload_levels(tex->startData, _texturestream_bytes(tex, mip), offsets, tex->format,
+            max_u32(tex->layout.width >> mip, 1), max_u32(tex->layout.height >> mip, 1),
+            tex->layout.mipLevels - mip, physicalDevice, device, pool, graphicsQue,
+            TextureSample | TextureMipmap);
+    free(tex->startData);
+
+    tex->residentMip = mip;
+    tex->wantedMip = mip;
+    mutex_lock(&streamer->lock);
+    tex->state = StreamedTextureReady;
+    mutex_unlock(&streamer->lock);
+    bindless_set(bindless, tex->material, &tex->texture);
+    memset(streamer->setsDirty, 1, streamer->numSets);
+    streamer->used += _texturestream_bytes(tex, mip);
+    streamer->batchSerialNs += tex->openNs;
+    streamer->batchCount++;
+
+    LOG("Streamed texture %s %ux%u from %s, mip %u of %u resident (%.1f KB), opened in %.1f ms, "
+            "uploaded in %.1f ms", tex->path, tex->layout.width, tex->layout.height, tex->levelPath, mip,
+            tex->layout.mipLevels, (double)_texturestream_bytes(tex, mip) / 1024.0, (double)tex->openNs / 1e6,
+            (double)(timer_now_ns() - start) / 1e6);
+}
+
+// Textures still waiting for their first levels
+static u32
+texturestream_loading(TextureStreamer* streamer) {
+    u32 ret = 0;
+    mutex_lock(&streamer->lock);
+    for(u32 i = 0; i < streamer->numTextures; i++) {
+        StreamedTextureState state = streamer->textures[i].state;
+        ret += state == StreamedTextureOpening || state == StreamedTextureOpened;
+    }
+    mutex_unlock(&streamer->lock);
+    return ret;
+}
+
+// Gpu memory of the resident levels, nothing before first levels are uploaded
+static VkDeviceSize
+texturestream_resident_bytes(TextureStreamer* streamer, u32 handle) {
+    const StreamedTexture* tex = &streamer->textures[handle];
+    return _texturestream_ready(streamer, tex) ? _texturestream_bytes(tex, tex->residentMip) : 0;
+}
+
+// Demand from how many pixels the texture covers on screen, one texel per pixel is enough
+static void
+texturestream_request(TextureStreamer* streamer, u32 handle, float screenPixels) {
+
+    StreamedTexture* tex = &streamer->textures[handle];
+    if(!_texturestream_ready(streamer, tex)) return;
+    float size = (float)max_u32(tex->layout.width, tex->layout.height);
+    u32 mip = 0;
+    if(screenPixels < size) {
+        float level = floorf(log2f(size / maxf(screenPixels, 1.f)));
+        mip = (u32)level;
+    }
+    mip = min_u32(mip, tex->layout.mipLevels - 1);
+    if(mip < tex->wantedMip) tex->wantedMip = mip;
+}
+
+static void
+_texturestream_read_job(void* data) {
+
+    PROFILE_FUNCTION();
+    TextureStreamer* streamer = (TextureStreamer*)data;
+    TextureStreamChange* change = &streamer->change;
+    const StreamedTexture* tex = &streamer->textures[change->texture];
+    u8 ok = _texturestream_read(tex, change->targetMip, change->data);
+
+    mutex_lock(&streamer->lock);
+    change->failed = !ok;
+    change->state = TextureStreamRead;
+    mutex_unlock(&streamer->lock);
+}
+
+static void
+_texturestream_read_done(void* user, u8* dst, size_t size, u8 ok) {
+
+    TextureStreamer* streamer = (TextureStreamer*)user;
+    (void)dst; (void)size;
+    mutex_lock(&streamer->lock);
+    streamer->change.failed = !ok;
+    streamer->change.state = TextureStreamRead;
+    mutex_unlock(&streamer->lock);
+}
+
+// Over budget drops finest level nobody wants, otherwise finest missing level of the most
+// starved texture is streamed in if it fits. Both go one level per change
+static u8
+_texturestream_pick(TextureStreamer* streamer, u32* texture, u32* targetMip) {
+
+    if(streamer->used > streamer->budget) {
+        VkDeviceSize bestSaving = 0;
+        for(u32 i = 0; i < streamer->numTextures; i++) {
+            const StreamedTexture* tex = &streamer->textures[i];
+            if(!_texturestream_ready(streamer, tex) || tex->residentMip >= tex->wantedMip) continue;
+            VkDeviceSize saving = _texturestream_bytes(tex, tex->residentMip) -
+                _texturestream_bytes(tex, tex->residentMip + 1);
+            if(saving > bestSaving) {
+                bestSaving = saving;
+                *texture = i;
+                *targetMip = tex->residentMip + 1;
+            }
+        }
+        if(bestSaving) return 1;
+    }
+
+    u32 bestGap = 0;
+    for(u32 i = 0; i < streamer->numTextures; i++) {
+        const StreamedTexture* tex = &streamer->textures[i];
+        if(!_texturestream_ready(streamer, tex) || tex->residentMip <= tex->wantedMip) continue;
+        VkDeviceSize grow = _texturestream_bytes(tex, tex->residentMip - 1) - _texturestream_bytes(tex, tex->residentMip);
+        if(streamer->used + grow > streamer->budget) continue;
+        if(tex->residentMip - tex->wantedMip > bestGap) {
+            bestGap = tex->residentMip - tex->wantedMip;
+            *texture = i;
+            *targetMip = tex->residentMip - 1;
+        }
+    }
+    return bestGap > 0;
+}
+
+static void
+_texturestream_begin(TextureStreamChange* change, VkDevice device, VkCommandPool pool) {
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    allocInfo.commandPool = pool;
+    vkAllocateCommandBuffers(device, &allocInfo, &change->cmd);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(change->cmd, &beginInfo);
+}
+
+static void
+_texturestream_end(TextureStreamer* streamer, VkQueue graphicsQue) {
+
+    TextureStreamChange* change = &streamer->change;
+    vkEndCommandBuffer(change->cmd);
+
+    // frames keep going, fence is polled on later updates
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &change->cmd;
+    if(vkQueueSubmit(graphicsQue, 1, &submitInfo, streamer->fence) != VK_SUCCESS) {
+        ABORT("Failed to submit texture streaming change");
+    }
+    change->state = TextureStreamUploading;
+}
+
+static void
+_texturestream_submit(TextureStreamer* streamer, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue) {
+
+    TextureStreamChange* change = &streamer->change;
+    const StreamedTexture* tex = &streamer->textures[change->texture];
+    VkDeviceSize size = _texturestream_bytes(tex, change->targetMip);
+
+    change->staging = buffer_create(physicalDevice, device, size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // usage
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT); // memrequiremets
+    void* stagingDst;
+    vkMapMemory(device, change->staging.bufferMemory, 0, size, 0, &stagingDst);
+    memcpy(stagingDst, change->data, size);
+    vkUnmapMemory(device, change->staging.bufferMemory);
+    free(change->data);
+
+    change->next = _texturestream_image(tex, change->targetMip, physicalDevice, device);
+    _texturestream_begin(change, device, pool);
+    _texture_record_levels(change->cmd, change->staging.bufferId, tex->layout.offsets[change->targetMip],
+            &tex->layout.offsets[change->targetMip], change->next.image,
+            change->next.width, change->next.height, change->next.mipLevels);
+    _texturestream_end(streamer, graphicsQue);
+}
+
+// Levels that stay are already on gpu, dropping copies them from the resident image
+static void
+_texturestream_submit_drop(TextureStreamer* streamer, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue) {
+
+    TextureStreamChange* change = &streamer->change;
+    const StreamedTexture* tex = &streamer->textures[change->texture];
+    const Texture* old = &tex->texture;
+    u32 skip = change->targetMip - tex->residentMip;
+    memset(&change->staging, 0, sizeof change->staging);
+    change->next = _texturestream_image(tex, change->targetMip, physicalDevice, device);
+
+    VkImageCopy regions[MIPGEN_MAX_LEVELS] = {};
+    u32 width = change->next.width, height = change->next.height;
+    for(u32 i = 0; i < change->next.mipLevels; i++) {
+        regions[i].srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].srcSubresource.mipLevel = i + skip;
+        regions[i].srcSubresource.layerCount = 1;
+        regions[i].dstSubresource = regions[i].srcSubresource;
+        regions[i].dstSubresource.mipLevel = i;
+        regions[i].extent = (VkExtent3D){.width = width, .height = height, 1};
+        if(width > 1) width /= 2;
+        if(height > 1) height /= 2;
+    }
+
+    // old image is still sampled by frames in flight, it goes back to read layout after the copy
+    VkImageMemoryBarrier barriers[2] = {};
+    for(u32 i = 0; i < 2; i++) {
+        barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barriers[i].subresourceRange.levelCount = change->next.mipLevels;
+        barriers[i].subresourceRange.layerCount = 1;
+    }
+    barriers[0].image = old->image;
+    barriers[0].subresourceRange.baseMipLevel = skip;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[1].image = change->next.image;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    _texturestream_begin(change, device, pool);
+    vkCmdPipelineBarrier(change->cmd,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, NULL,
+            0, NULL,
+            2, barriers);
+
+    vkCmdCopyImage(change->cmd, old->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            change->next.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, change->next.mipLevels, regions);
+
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(change->cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, NULL,
+            0, NULL,
+            2, barriers);
+    _texturestream_end(streamer, graphicsQue);
+}
+
+// Texture is disposed once frames that may still sample it are done
+static void
+_texturestream_retire(TextureStreamer* streamer, const Texture* texture, VkDevice device) {
+
+    if(streamer->numRetired == TEXTURESTREAM_MAX_RETIRED) {
+        // only when many textures are removed at once, wait instead of leaking
+        vkDeviceWaitIdle(device);
+        for(u32 i = 0; i < streamer->numRetired; i++) texture_dispose(&streamer->retired[i], device);
+        streamer->numRetired = 0;
+    }
+    streamer->retired[streamer->numRetired] = *texture;
+    streamer->retiredFrame[streamer->numRetired++] = streamer->frame;
+}
+
+static void
+_texturestream_finish(TextureStreamer* streamer, BindlessTextures* bindless, VkDevice device,
+        VkCommandPool pool) {
+
+    TextureStreamChange* change = &streamer->change;
+    StreamedTexture* tex = &streamer->textures[change->texture];
+
+    vkResetFences(device, 1, &streamer->fence);
+    vkFreeCommandBuffers(device, pool, 1, &change->cmd);
+    buffer_dispose(&change->staging, device);
+
+    _texturestream_retire(streamer, &tex->texture, device);
+
+    streamer->used -= _texturestream_bytes(tex, tex->residentMip);
+    streamer->used += _texturestream_bytes(tex, change->targetMip);
+    LOG("Texture %s mip %u -> %u in %.1f ms, %.1f / %.1f MB streamed textures", tex->path,
+            tex->residentMip, change->targetMip, (double)(timer_now_ns() - change->startNs) / 1e6,
+            (double)streamer->used / (1024.0 * 1024.0), (double)streamer->budget / (1024.0 * 1024.0));
+
+    tex->texture = change->next;
+    tex->residentMip = change->targetMip;
+    bindless_set(bindless, tex->material, &tex->texture);
+    memset(streamer->setsDirty, 1, streamer->numSets);
+    change->state = TextureStreamIdle;
+}
+
+// Frees the slot and material of the texture, returns 0 while it is still opening or changing
+// and can not be removed yet. Material samples placeholder until it is given to another texture
+static u8
+texturestream_remove(TextureStreamer* streamer, u32 handle, BindlessTextures* bindless,
+        const Texture* placeholder, VkDevice device) {
+
+    StreamedTexture* tex = &streamer->textures[handle];
+    if(!_texturestream_ready(streamer, tex)) return 0;
+    if(streamer->change.state != TextureStreamIdle && streamer->change.texture == handle) return 0;
+
+    _texturestream_retire(streamer, &tex->texture, device);
+    streamer->used -= _texturestream_bytes(tex, tex->residentMip);
+    bindless_unregister(bindless, tex->material, placeholder);
+    memset(streamer->setsDirty, 1, streamer->numSets);
+    LOG("Removed streamed texture %s, %.1f / %.1f MB streamed textures", tex->path,
+            (double)streamer->used / (1024.0 * 1024.0), (double)streamer->budget / (1024.0 * 1024.0));
+
+    memset(&tex->texture, 0, sizeof tex->texture);
+    mutex_lock(&streamer->lock);
+    tex->state = StreamedTextureFree;
+    mutex_unlock(&streamer->lock);
+    return 1;
+}
+
+// Call every frame once the fence of imageIndex has been waited and before its commands are
+// recorded. Rewrites the set of the image if it still points to replaced textures
+static void
+texturestream_update(TextureStreamer* streamer, BindlessTextures* bindless, const VkDescriptorSet* sets,
+        u32 numSets, u32 imageIndex, VkPhysicalDevice physicalDevice, VkDevice device,
+        VkCommandPool pool, VkQueue graphicsQue) {
+
+    PROFILE_FUNCTION();
+    streamer->frame++;
+    if(numSets != streamer->numSets) {
+        streamer->setsDirty = (u8*)realloc(streamer->setsDirty, numSets);
+        memset(streamer->setsDirty, 1, numSets);
+        streamer->numSets = numSets;
+    }
+    for(u32 i = 0; i < streamer->numTextures; i++) {
+        StreamedTexture* tex = &streamer->textures[i];
+        mutex_lock(&streamer->lock);
+        StreamedTextureState state = tex->state;
+        mutex_unlock(&streamer->lock);
+        if(state == StreamedTextureOpened) {
+            _texturestream_upload_start(streamer, tex, bindless, physicalDevice, device, pool, graphicsQue);
+        }
+    }
+    // workers open in parallel, sum of their times is what opening one by one would take
+    if(streamer->batchStart && !texturestream_loading(streamer)) {
+        LOG("%u textures streamed in %.1f ms, opening serially would take %.1f ms", streamer->batchCount,
+                (double)(timer_now_ns() - streamer->batchStart) / 1e6, (double)streamer->batchSerialNs / 1e6);
+        streamer->batchStart = 0;
+        streamer->batchSerialNs = 0;
+        streamer->batchCount = 0;
+    }
+    if(streamer->setsDirty[imageIndex]) {
+        bindless_write(bindless, &sets[imageIndex], 1, 0, device);
+        streamer->setsDirty[imageIndex] = 0;
+    }
+
+    // frames recorded before the swap have waited their fences by now
+    for(u32 i = 0; i < streamer->numRetired;) {
+        if(streamer->frame - streamer->retiredFrame[i] > MAX_FRAMES_IN_FLIGHT + 1) {
+            texture_dispose(&streamer->retired[i], device);
+            streamer->numRetired--;
+            streamer->retired[i] = streamer->retired[streamer->numRetired];
+            streamer->retiredFrame[i] = streamer->retiredFrame[streamer->numRetired];
+        } else {
+            i++;
+        }
+    }
+
+    TextureStreamChange* change = &streamer->change;
+    mutex_lock(&streamer->lock);
+    TextureStreamState state = change->state;
+    mutex_unlock(&streamer->lock);
+
+    if(state == TextureStreamRead) {
+        if(change->failed) {
+            LOG("Failed to stream levels of %s", streamer->textures[change->texture].levelPath);
+            free(change->data);
+            // keep residency, do not try the same texture every frame
+            streamer->textures[change->texture].wantedMip = streamer->textures[change->texture].residentMip;
+            change->state = TextureStreamIdle;
+        } else {
+            _texturestream_submit(streamer, physicalDevice, device, pool, graphicsQue);
+        }
+    } else if(state == TextureStreamUploading) {
+        if(vkGetFenceStatus(device, streamer->fence) == VK_SUCCESS) {
+            _texturestream_finish(streamer, bindless, device, pool);
+        }
+    } else if(state == TextureStreamIdle) {
+        u32 texture, targetMip;
+        if(_texturestream_pick(streamer, &texture, &targetMip)) {
+            change->texture = texture;
+            change->targetMip = targetMip;
+            change->failed = 0;
+            change->startNs = timer_now_ns();
+            const StreamedTexture* tex = &streamer->textures[texture];
+            if(targetMip > tex->residentMip) {
+                _texturestream_submit_drop(streamer, physicalDevice, device, pool, graphicsQue);
+            } else {
+                size_t size = _texturestream_bytes(tex, targetMip);
+                change->data = (u8*)malloc(size);
+                change->state = TextureStreamReading;
+                char file[256];
+                u64 offset;
+                if(!vfs_locate(tex->levelPath, file, sizeof file, &offset) ||
+                        !asyncio_read(streamer->io, file, offset + tex->dataOffset + tex->layout.offsets[targetMip],
+                            size, change->data, _texturestream_read_done, streamer)) {
+                    threadpool_push(streamer->threads, _texturestream_read_job, streamer);
+                }
+            }
+        }
+    }
+
+    // demand is gathered again for next update
+    for(u32 i = 0; i < streamer->numTextures; i++) {
+        StreamedTexture* tex = &streamer->textures[i];
+        if(_texturestream_ready(streamer, tex)) tex->wantedMip = tex->layout.mipLevels - 1;
+    }
+}
+
+static void
+texturestream_dispose(TextureStreamer* streamer, VkDevice device, VkCommandPool pool) {
+
+    vkDeviceWaitIdle(device);
+    TextureStreamChange* change = &streamer->change;
+    // readers have to be done before their buffers go
+    if(change->state == TextureStreamReading) {
+        asyncio_wait(streamer->io);
+    }
+    if(change->state == TextureStreamReading || texturestream_loading(streamer)) {
+        threadpool_wait(streamer->threads);
+    }
+    if(change->state == TextureStreamRead) {
+        free(change->data);
+    } else if(change->state == TextureStreamUploading) {
+        vkFreeCommandBuffers(device, pool, 1, &change->cmd);
+        buffer_dispose(&change->staging, device);
+        texture_dispose(&change->next, device);
+    }
+
+    for(u32 i = 0; i < streamer->numRetired; i++) {
+        texture_dispose(&streamer->retired[i], device);
+    }
+    for(u32 i = 0; i < streamer->numTextures; i++) {
+        if(streamer->textures[i].state == StreamedTextureFree) continue;
+        if(streamer->textures[i].state == StreamedTextureOpened) {
+            free(streamer->textures[i].startData);
+        }
+        texture_dispose(&streamer->textures[i].texture, device);
+    }
+    vkDestroyFence(device, streamer->fence, NULL);
+    mutex_dispose(&streamer->lock);
+    free(streamer->setsDirty);
+    memset(streamer, 0, sizeof *streamer);
+}
+
+#endif /* TEXTURESTREAM_H */
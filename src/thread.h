@@ -0,0 +1,177 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Thin wrappers over native threads, mutexes and condition variables
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "utils.h"
+
+#if defined(WINDOWS_PLATFORM)
+#include <windows.h>
+#elif defined(LINUX_PLATFORM)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef void (*ThreadFunc)(void* data);
+
+#if defined(WINDOWS_PLATFORM)
+typedef struct Thread {
+    HANDLE              handle;
+    ThreadFunc          func;
+    void*               data;
+} Thread;
+typedef CRITICAL_SECTION    Mutex;
+typedef CONDITION_VARIABLE  ConditionVariable;
+#else
+typedef struct Thread {
+    pthread_t           handle;
+    ThreadFunc          func;
+    void*               data;
+} Thread;
+typedef pthread_mutex_t     Mutex;
+typedef pthread_cond_t      ConditionVariable;
+#endif
+
+#if defined(WINDOWS_PLATFORM)
+static DWORD WINAPI
+_thread_entry(LPVOID param) {
+    Thread* thread = (Thread*)param;
+    thread->func(thread->data);
+    return 0;
+}
+#else
+static void*
+_thread_entry(void* param) {
+    Thread* thread = (Thread*)param;
+    thread->func(thread->data);
+    return NULL;
+}
+#endif
+
+// Thread struct has to stay in place until joined
+static void
+thread_start(Thread* thread, ThreadFunc func, void* data) {
+    thread->func = func;
+    thread->data = data;
+#if defined(WINDOWS_PLATFORM)
+    thread->handle = CreateThread(NULL, 0, _thread_entry, thread, 0, NULL);
+    if(!thread->handle) {
+        ABORT("Failed to create thread");
+    }
+#else
+    if(pthread_create(&thread->handle, NULL, _thread_entry, thread) != 0) {
+        ABORT("Failed to create thread");
+    }
+#endif
+}
+
+static void
+thread_join(Thread* thread) {
+#if defined(WINDOWS_PLATFORM)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
+// Number of logical cores
+static u32
+thread_hardware_count() {
+#if defined(WINDOWS_PLATFORM)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+#endif
+}
+
+static inline void
+mutex_init(Mutex* mutex) {
+#if defined(WINDOWS_PLATFORM)
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static inline void
+mutex_dispose(Mutex* mutex) {
+#if defined(WINDOWS_PLATFORM)
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void
+mutex_lock(Mutex* mutex) {
+#if defined(WINDOWS_PLATFORM)
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void
+mutex_unlock(Mutex* mutex) {
+#if defined(WINDOWS_PLATFORM)
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+static inline void
+condition_init(ConditionVariable* cond) {
+#if defined(WINDOWS_PLATFORM)
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static inline void
+condition_dispose(ConditionVariable* cond) {
+#if defined(WINDOWS_PLATFORM)
+    (void)cond; // nothing to free
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+// Mutex has to be locked, it is locked again when this returns
+static inline void
+condition_wait(ConditionVariable* cond, Mutex* mutex) {
+#if defined(WINDOWS_PLATFORM)
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+static inline void
+condition_signal(ConditionVariable* cond) {
+#if defined(WINDOWS_PLATFORM)
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+static inline void
+condition_broadcast(ConditionVariable* cond) {
+#if defined(WINDOWS_PLATFORM)
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+#endif /* THREAD_H */
@@ -0,0 +1,216 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Fixed number of workers taking jobs from one locked ring buffer.
+// Meant for coarse jobs like decoding a whole texture, not for tiny tasks.
+// Idle workers run the small jobs of jobs.h through the helper, so both share the same threads.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "utils.h"
+#include "thread.h"
+#include "profiler.h"
+
+#define THREADPOOL_MAX_JOBS 256
+#define THREADPOOL_SPIN_COUNT 64        // failed helper rounds before sleeping
+
+typedef struct ThreadJob {
+    ThreadFunc  func;
+    void*       data;
+} ThreadJob;
+
+// Other work idle workers take before sleeping
+typedef struct ThreadPoolHelper {
+    u8      (*run)(void* data, u32 worker);     // returns 0 when there was nothing to run
+    void*   data;
+    i32*    pending;                            // workers do not sleep while this is not zero
+} ThreadPoolHelper;
+
+typedef struct ThreadPool {
+    Thread*             threads;
+    u32                 numThreads;
+
+    Mutex               lock;
+    ConditionVariable   hasJobs;        // workers wait here
+    ConditionVariable   hasSpace;       // pushers wait here when queue is full
+    ConditionVariable   idle;           // threadpool_wait waits here
+
+    ThreadJob           jobs[THREADPOOL_MAX_JOBS];
+    u32                 head;
+    u32                 numQueued;
+    u32                 numRunning;
+    u8                  quit;
+
+    ThreadPoolHelper    helper;         // guarded by lock
+    i32                 numSleeping;    // read by helper pushers without lock
+} ThreadPool;
+
+typedef struct ThreadPoolWorker {
+    ThreadPool* pool;
+    u32         index;
+} ThreadPoolWorker;
+
+// Set for the life of a worker thread, so jobs.h knows the worker in queued jobs too
+static THREAD_LOCAL ThreadPool* t_pool;
+static THREAD_LOCAL u32 t_poolWorker;
+
+static inline u8
+_threadpool_helper_pending(const ThreadPoolHelper* helper) {
+    return helper->pending && __atomic_load_n(helper->pending, __ATOMIC_SEQ_CST);
+}
+
+static void
+_threadpool_worker(void* data) {
+
+    ThreadPoolWorker* start = (ThreadPoolWorker*)data;
+    ThreadPool* pool = start->pool;
+    u32 index = start->index;
+    free(start);
+    t_pool = pool;
+    t_poolWorker = index;
+    PROFILE_THREAD("pool worker");
+
+    ThreadPoolHelper helper = {};
+    u32 misses = 0;
+    for(;;) {
+        // helper jobs are waited within a frame, they go before queued ones
+        if(helper.run && helper.run(helper.data, index)) {
+            misses = 0;
+            continue;
+        }
+
+        mutex_lock(&pool->lock);
+        helper = pool->helper;
+        if(pool->numQueued) {
+            ThreadJob job = pool->jobs[pool->head];
+            pool->head = (pool->head + 1) % THREADPOOL_MAX_JOBS;
+            pool->numQueued--;
+            pool->numRunning++;
+            condition_signal(&pool->hasSpace);
+            mutex_unlock(&pool->lock);
+
+            job.func(job.data);
+
+            mutex_lock(&pool->lock);
+            pool->numRunning--;
+            if(!pool->numQueued && !pool->numRunning) {
+                condition_broadcast(&pool->idle);
+            }
+            mutex_unlock(&pool->lock);
+            misses = 0;
+            continue;
+        }
+        if(helper.run && ++misses < THREADPOOL_SPIN_COUNT) {
+            mutex_unlock(&pool->lock);
+            continue;
+        }
+        if(pool->quit && !_threadpool_helper_pending(&helper)) {
+            mutex_unlock(&pool->lock);
+            break;
+        }
+
+        // pending is checked after numSleeping is raised and helper pushers check numSleeping
+        // after raising pending, so one of them always sees the other
+        __atomic_add_fetch(&pool->numSleeping, 1, __ATOMIC_SEQ_CST);
+        while(!pool->numQueued && !pool->quit && !_threadpool_helper_pending(&pool->helper)) {
+            condition_wait(&pool->hasJobs, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->numSleeping, 1, __ATOMIC_SEQ_CST);
+        helper = pool->helper;
+        mutex_unlock(&pool->lock);
+        misses = 0;
+    }
+}
+
+// numThreads of 0 uses one worker per core except the calling thread
+static void
+threadpool_init(ThreadPool* pool, u32 numThreads) {
+
+    if(!numThreads) {
+        u32 cores = thread_hardware_count();
+        numThreads = cores > 1 ? cores - 1 : 1;
+    }
+    memset(pool, 0, sizeof *pool);
+    mutex_init(&pool->lock);
+    condition_init(&pool->hasJobs);
+    condition_init(&pool->hasSpace);
+    condition_init(&pool->idle);
+
+    pool->numThreads = numThreads;
+    pool->threads = (Thread*)malloc(sizeof *pool->threads * numThreads);
+    for(u32 i = 0; i < numThreads; i++) {
+        ThreadPoolWorker* start = (ThreadPoolWorker*)malloc(sizeof *start);
+        start->pool = pool;
+        start->index = i;
+        thread_start(&pool->threads[i], _threadpool_worker, start);
+    }
+}
+
+// Idle workers run helper before sleeping, its data has to stay until pool is disposed
+static void
+threadpool_set_helper(ThreadPool* pool, const ThreadPoolHelper* helper) {
+
+    mutex_lock(&pool->lock);
+    pool->helper = *helper;
+    condition_broadcast(&pool->hasJobs);
+    mutex_unlock(&pool->lock);
+}
+
+// Helper got work, wakes one sleeping worker
+static void
+threadpool_wake(ThreadPool* pool) {
+
+    if(!__atomic_load_n(&pool->numSleeping, __ATOMIC_SEQ_CST)) return;
+    mutex_lock(&pool->lock);
+    condition_signal(&pool->hasJobs);
+    mutex_unlock(&pool->lock);
+}
+
+static void
+threadpool_push(ThreadPool* pool, ThreadFunc func, void* data) {
+
+    mutex_lock(&pool->lock);
+    while(pool->numQueued == THREADPOOL_MAX_JOBS) {
+        condition_wait(&pool->hasSpace, &pool->lock);
+    }
+    u32 tail = (pool->head + pool->numQueued) % THREADPOOL_MAX_JOBS;
+    pool->jobs[tail] = (ThreadJob){.func = func, .data = data};
+    pool->numQueued++;
+    condition_signal(&pool->hasJobs);
+    mutex_unlock(&pool->lock);
+}
+
+// Block until every pushed job has finished
+static void
+threadpool_wait(ThreadPool* pool) {
+
+    mutex_lock(&pool->lock);
+    while(pool->numQueued || pool->numRunning) {
+        condition_wait(&pool->idle, &pool->lock);
+    }
+    mutex_unlock(&pool->lock);
+}
+
+// Finishes queued jobs and pending helper work before workers exit
+static void
+threadpool_dispose(ThreadPool* pool) {
+
+    mutex_lock(&pool->lock);
+    pool->quit = 1;
+    condition_broadcast(&pool->hasJobs);
+    mutex_unlock(&pool->lock);
+
+    for(u32 i = 0; i < pool->numThreads; i++) {
+        thread_join(&pool->threads[i]);
+    }
+    free(pool->threads);
+    condition_dispose(&pool->idle);
+    condition_dispose(&pool->hasSpace);
+    condition_dispose(&pool->hasJobs);
+    mutex_dispose(&pool->lock);
+    pool->numThreads = 0;
+}
+
+#endif /* THREADPOOL_H */
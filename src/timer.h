@@ -0,0 +1,73 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "utils.h"
+
+#if defined(WINDOWS_PLATFORM)
+#include <windows.h>
+#elif defined(LINUX_PLATFORM)
+#include <time.h>
+#endif
+
+// Monotonic clock in nanoseconds, only differences are meaningful
+static inline u64
+timer_now_ns() {
+#if defined(WINDOWS_PLATFORM)
+    static LARGE_INTEGER frequency = {};
+    if(!frequency.QuadPart) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // split to avoid overflow of counter * 1e9
+    u64 seconds = counter.QuadPart / frequency.QuadPart;
+    u64 rest = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000ull + rest * 1000000000ull / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+#endif
+}
+
+static inline double
+timer_seconds(u64 ns) {
+    return (double)ns / 1e9;
+}
+
+#define TIME_WINDOW_SIZE 128
+
+// Last TIME_WINDOW_SIZE durations for rolling min, average and max
+typedef struct TimeWindow {
+    u64     samples[TIME_WINDOW_SIZE];
+    u32     count;
+    u32     next;
+} TimeWindow;
+
+static void
+timewindow_push(TimeWindow* window, u64 ns) {
+    window->samples[window->next] = ns;
+    window->next = (window->next + 1) % TIME_WINDOW_SIZE;
+    if(window->count < TIME_WINDOW_SIZE) window->count++;
+}
+
+// In milliseconds, zeros when nothing is pushed yet
+static void
+timewindow_stats(const TimeWindow* window, double* minMs, double* avgMs, double* maxMs) {
+    u64 low = window->count ? numeric_max_u64 : 0, high = 0, sum = 0;
+    for(u32 i = 0; i < window->count; i++) {
+        u64 ns = window->samples[i];
+        if(ns < low) low = ns;
+        if(ns > high) high = ns;
+        sum += ns;
+    }
+    *minMs = (double)low / 1e6;
+    *maxMs = (double)high / 1e6;
+    *avgMs = window->count ? (double)sum / window->count / 1e6 : 0.0;
+}
+
+#endif /* TIMER_H */
@@ -0,0 +1,228 @@
+/************************************************************
+ * Check license.txt in project root for license information *
+ *********************************************************** */
+
+// Scene transforms, local translation/rotation/scale stored per field in arrays.
+// Nodes are kept in depth first order so every subtree is one contiguous range of slots
+// and parent is always before its children. Update walks only the subtrees of dirty nodes.
+// Handles stay valid, slots move when nodes are inserted in the middle.
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "utils.h"
+#include "cmath.h"
+
+#define TRANSFORM_NONE 0xFFFFFFFF
+
+typedef struct TransformHierarchy {
+    u32     count;
+    u32     capacity;
+    // by slot
+    vec3*   position;
+    quat*   rotation;
+    vec3*   scale;
+    mat4*   world;
+    u32*    parent;         // slot of parent or TRANSFORM_NONE
+    u32*    subtreeEnd;     // one past the last descendant
+    u32*    handleOf;
+    u8*     dirty;
+    // by handle
+    u32*    slotOf;
+    // handles of nodes changed since last update
+    u32*    dirtyList;
+    u32     numDirty;
+} TransformHierarchy;
+
+static void
+_transform_reserve(TransformHierarchy* h, u32 capacity) {
+
+    if(capacity <= h->capacity) return;
+    h->capacity = capacity;
+#define _TRANSFORM_GROW(ARRAY) \
+    h->ARRAY = (typeof(h->ARRAY))realloc(h->ARRAY, sizeof *h->ARRAY * capacity); \
+    if(!h->ARRAY) ABORT("Failed to grow transforms");
+    _TRANSFORM_GROW(position);
+    _TRANSFORM_GROW(rotation);
+    _TRANSFORM_GROW(scale);
+    _TRANSFORM_GROW(world);
+    _TRANSFORM_GROW(parent);
+    _TRANSFORM_GROW(subtreeEnd);
+    _TRANSFORM_GROW(handleOf);
+    _TRANSFORM_GROW(dirty);
+    _TRANSFORM_GROW(slotOf);
+    _TRANSFORM_GROW(dirtyList);
+#undef _TRANSFORM_GROW
+}
+
+static void
+transform_init(TransformHierarchy* h, u32 capacity) {
+    memset(h, 0, sizeof *h);
+    _transform_reserve(h, capacity ? capacity : 16);
+}
+
+static void
+transform_dispose(TransformHierarchy* h) {
+    free(h->position);
+    free(h->rotation);
+    free(h->scale);
+    free(h->world);
+    free(h->parent);
+    free(h->subtreeEnd);
+    free(h->handleOf);
+    free(h->dirty);
+    free(h->slotOf);
+    free(h->dirtyList);
+    memset(h, 0, sizeof *h);
+}
+
+static inline void
+_transform_mark_dirty(TransformHierarchy* h, u32 slot) {
+    if(h->dirty[slot]) return;
+    h->dirty[slot] = 1;
+    h->dirtyList[h->numDirty++] = h->handleOf[slot];
+}
+
+// Open a gap at slot, everything after moves one forward
+static void
+_transform_shift(TransformHierarchy* h, u32 slot) {
+
+    u32 move = h->count - slot;
+#define _TRANSFORM_SHIFT(ARRAY) memmove(&h->ARRAY[slot + 1], &h->ARRAY[slot], sizeof *h->ARRAY * move)
+    _TRANSFORM_SHIFT(position);
+    _TRANSFORM_SHIFT(rotation);
+    _TRANSFORM_SHIFT(scale);
+    _TRANSFORM_SHIFT(world);
+    _TRANSFORM_SHIFT(parent);
+    _TRANSFORM_SHIFT(subtreeEnd);
+    _TRANSFORM_SHIFT(handleOf);
+    _TRANSFORM_SHIFT(dirty);
+#undef _TRANSFORM_SHIFT
+
+    for(u32 i = 0; i <= h->count; i++) {
+        if(i == slot) continue;
+        if(h->parent[i] != TRANSFORM_NONE && h->parent[i] >= slot) h->parent[i]++;
+        // nodes after the gap and nodes around it
+        if(h->subtreeEnd[i] > slot) h->subtreeEnd[i]++;
+    }
+    for(u32 i = 0; i < h->count; i++) {
+        if(h->slotOf[i] >= slot) h->slotOf[i]++;
+    }
+}
+
+// Add node as last child of parent (handle or TRANSFORM_NONE), returns handle of the node.
+// Adding in depth first order is just an append, otherwise later slots are shifted.
+static u32
+transform_add(TransformHierarchy* h, u32 parent, vec3 position, quat rotation, vec3 scale) {
+
+    if(h->count == h->capacity) _transform_reserve(h, h->capacity * 2);
+
+    u32 parentSlot = parent == TRANSFORM_NONE ? TRANSFORM_NONE : h->slotOf[parent];
+    u32 slot = parentSlot == TRANSFORM_NONE ? h->count : h->subtreeEnd[parentSlot];
+    if(slot < h->count) {
+        _transform_shift(h, slot);
+    }
+
+    // Ancestors that ended right at the new slot grow to cover it
+    for(u32 p = parentSlot; p != TRANSFORM_NONE; p = h->parent[p]) {
+        if(h->subtreeEnd[p] == slot) h->subtreeEnd[p] = slot + 1;
+    }
+
+    u32 handle = h->count++;
+    h->position[slot] = position;
+    h->rotation[slot] = rotation;
+    h->scale[slot] = scale;
+    identify_mat4(&h->world[slot]);
+    h->parent[slot] = parentSlot;
+    h->subtreeEnd[slot] = slot + 1;
+    h->handleOf[slot] = handle;
+    h->dirty[slot] = 0;
+    h->slotOf[handle] = slot;
+    _transform_mark_dirty(h, slot);
+    return handle;
+}
+
+static inline void
+transform_set_local(TransformHierarchy* h, u32 handle, vec3 position, quat rotation, vec3 scale) {
+    u32 slot = h->slotOf[handle];
+    h->position[slot] = position;
+    h->rotation[slot] = rotation;
+    h->scale[slot] = scale;
+    _transform_mark_dirty(h, slot);
+}
+
+static inline void
+transform_set_position(TransformHierarchy* h, u32 handle, vec3 position) {
+    u32 slot = h->slotOf[handle];
+    h->position[slot] = position;
+    _transform_mark_dirty(h, slot);
+}
+
+static inline void
+transform_set_rotation(TransformHierarchy* h, u32 handle, quat rotation) {
+    u32 slot = h->slotOf[handle];
+    h->rotation[slot] = rotation;
+    _transform_mark_dirty(h, slot);
+}
+
+static inline const mat4*
+transform_world(const TransformHierarchy* h, u32 handle) {
+    return &h->world[h->slotOf[handle]];
+}
+
+static int
+_transform_slot_compare(const void* l, const void* r) {
+    u32 ls = *(const u32*)l;
+    u32 rs = *(const u32*)r;
+    return (ls > rs) - (ls < rs);
+}
+
+// Recompute world matrixes of dirty nodes and their descendants, returns number of nodes updated
+static u32
+transform_update(TransformHierarchy* h) {
+
+    if(!h->numDirty) return 0;
+
+    // Ascending slots, an ancestor comes first and its range covers dirty descendants
+    for(u32 i = 0; i < h->numDirty; i++) {
+        h->dirtyList[i] = h->slotOf[h->dirtyList[i]];
+    }
+    qsort(h->dirtyList, h->numDirty, sizeof *h->dirtyList, _transform_slot_compare);
+
+    u32 updated = 0;
+    u32 coveredEnd = 0;
+    for(u32 i = 0; i < h->numDirty; i++) {
+        u32 start = h->dirtyList[i];
+        h->dirty[start] = 0;
+        if(start < coveredEnd) continue;
+
+        u32 end = h->subtreeEnd[start];
+        for(u32 s = start; s < end; s++) {
+            mat4 local;
+            mat4_from_quat(&local, h->rotation[s]);
+            vec3 scale = h->scale[s];
+            for(u32 r = 0; r < 3; r++) {
+                local.mat[0][r] *= scale.x;
+                local.mat[1][r] *= scale.y;
+                local.mat[2][r] *= scale.z;
+            }
+            local.mat[3][0] = h->position[s].x;
+            local.mat[3][1] = h->position[s].y;
+            local.mat[3][2] = h->position[s].z;
+
+            // parent is before the range or inside it, either way already up to date
+            u32 parent = h->parent[s];
+            if(parent == TRANSFORM_NONE) {
+                h->world[s] = local;
+            } else {
+                mat4_mult_mat4(&h->world[s], &h->world[parent], &local);
+            }
+        }
+        updated += end - start;
+        coveredEnd = end;
+    }
+    h->numDirty = 0;
+    return updated;
+}
+
+#endif /* TRANSFORM_H */
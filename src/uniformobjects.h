@@ -10,20 +10,27 @@
 #include "buffer.h"
 #include "swapchain.h"
 #include "texture.h"
+#include "bindless.h"
+#include "descriptorAllocator.h"
+#include "profiler.h"
 
 typedef struct UniformObject {
     VkDescriptorSetLayout   uboLayout;
+    // per frame camera, model matrix is a push constant
     struct {
-        mat4                    model;
         mat4                    view;
         mat4                    projection;
     } data;
+    // camera of the last update, not sent to gpu
+    vec3                    eye;
+    float                   viewportHeight;
 } UniformObject;
 
 const float FOV = 90.f;
 static void
 uniformobject_init(UniformObject *object, VkDevice device) {
 
+    PROFILE_FUNCTION();
     // Where matrixes are bound
     VkDescriptorSetLayoutBinding uboBinding = {};
     {
@@ -34,21 +41,33 @@ uniformobject_init(UniformObject *object, VkDevice device) {
         uboBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     }
 
-    // Where texture sampler is bound
+    // Where texture array is bound, indexed with material id
     VkDescriptorSetLayoutBinding samplerBinding = {};
     {
-        samplerBinding.binding = 1; // 1 position
+        samplerBinding.binding = BINDLESS_BINDING;
         samplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerBinding.descriptorCount = 1;
+        samplerBinding.descriptorCount = BINDLESS_MAX_TEXTURES;
         // only accessed from vertex shader
         samplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     }
 
     VkDescriptorSetLayoutBinding bindings[] =  {uboBinding, samplerBinding};
 
+    // Texture array can be written while sets are bound and may have holes
+    VkDescriptorBindingFlagsEXT bindingFlags[] = {
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    flagsInfo.bindingCount = SIZEOF_ARRAY(bindingFlags);
+    flagsInfo.pBindingFlags = bindingFlags;
+
     // Create object
     VkDescriptorSetLayoutCreateInfo layout = {};
     layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout.pNext = &flagsInfo;
+    layout.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
     layout.bindingCount = SIZEOF_ARRAY(bindings);
     layout.pBindings = bindings;
 
@@ -57,7 +76,6 @@ uniformobject_init(UniformObject *object, VkDevice device) {
                 &object->uboLayout) != VK_SUCCESS) {
         ABORT("Failed to create descriptor layouts!");
     }
-    identify_mat4(&object->data.model);
     identify_mat4(&object->data.view);
     identify_mat4(&object->data.projection);
 
@@ -65,6 +83,8 @@ uniformobject_init(UniformObject *object, VkDevice device) {
     vec3 eye = {2.f,3.f,2.f};
     vec3 target = {0.f,0.f,0.f};
     create_lookat_mat4(&object->data.view, eye, target, world_up);
+    object->eye = eye;
+    object->viewportHeight = (float)SCREENHEIGHT;
     perspective(&object->data.projection, FOV * deg2rad,
             (float)SCREENWIDTH / (float)SCREENHEIGHT, 0.1f, 10.f);
 
@@ -86,6 +106,7 @@ uniformobject_dispose(UniformObject *object, VkDevice device) {
 static Buffer*
 uniformbuffers_create(u32 numImages, VkDevice device, VkPhysicalDevice physicalDevice) {
 
+    PROFILE_FUNCTION();
     // create buffer for each swapchain image
     Buffer* uniformBuffers = malloc(sizeof(Buffer) * numImages);
     u32 size = MEMBER_SIZE(UniformObject, data);
@@ -111,6 +132,7 @@ uniformbuffer_dispose(Buffer** buffers, u32 numImages, VkDevice device) {
 static void
 uniformbuffer_update(Buffer* buffer, UniformObject* object, VkDevice device) {
 
+    PROFILE_FUNCTION();
 
     int w,h;
     glfwGetFramebufferSize(g_window,&w,&h);
@@ -119,8 +141,8 @@ uniformbuffer_update(Buffer* buffer, UniformObject* object, VkDevice device) {
 
     object->data.projection.mat[1][1] *= -1;
 
-    double time = glfwGetTime();
 #if 0
+    double time = glfwGetTime();
     float y =  time * 0.2f;
     if(y > 6.f) {
         y = 0;
@@ -133,18 +155,8 @@ uniformbuffer_update(Buffer* buffer, UniformObject* object, VkDevice device) {
 
     vec3 target = {0.f,0.f,0.f};
     create_lookat_mat4(&object->data.view, eye, target, world_up);
-
-    //rotate the mesh
-
-    //vec3 axis = {0.f, 0.f, 1.f};
-    //normalize_inside_vec3(&axis);
-    //const quat rotation = quat_from_axis(axis, time * 0.1);
-
-    identify_mat4(&object->data.model);
-    rotate_mat4_Y(&object->data.model, time * 0.1f);
-    rotate_mat4_X(&object->data.model, -90.f * deg2rad);
-
-    //mat4_from_quat(&object->data.model, rotation);
+    object->eye = eye;
+    object->viewportHeight = (float)h;
 
     void *data;
     vkMapMemory(device, buffer->bufferMemory, 0, MEMBER_SIZE(UniformObject, data), 0, &data);
@@ -172,100 +184,51 @@ uniformbuffer_update(Buffer* buffer, UniformObject* object, VkDevice device) {
 #endif
 }
 
-static VkDescriptorPool
-descriptorpool_create(u32 numImages, VkDevice device) {
+// Allocator for sets of uboLayout, one pool fits few sets since the texture array is large
+static void
+descriptorallocator_init_ubo(DescriptorAllocator* alloc, VkDevice device) {
 
-    // Size of the pool (two desc per frame)
+    PROFILE_FUNCTION();
+    // descriptors of one set
     VkDescriptorPoolSize sizes[2] = {0};
     sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    sizes[0].descriptorCount = numImages;
+    sizes[0].descriptorCount = 1;
 
     sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    sizes[1].descriptorCount = numImages;
-
-    VkDescriptorPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = SIZEOF_ARRAY(sizes);
-    poolInfo.pPoolSizes = sizes;
-    // Max desc to allocate
-    poolInfo.maxSets = numImages;
-
-    // Create the pool
-    VkDescriptorPool ret;
-    if(vkCreateDescriptorPool(device, &poolInfo, NULL /*allocator*/, &ret) != VK_SUCCESS) {
-        ABORT("Failed to create descriptoy pool");
-    }
-    return ret;
-}
+    sizes[1].descriptorCount = BINDLESS_MAX_TEXTURES;
 
-static void
-descriptorpool_dispose(VkDescriptorPool pool, VkDevice device) {
-    vkDestroyDescriptorPool(device, pool, NULL /*allocator*/);
+    // sets use update after bind layout, all of them are cached so no frame pools
+    descriptorallocator_init(alloc, device, sizes, SIZEOF_ARRAY(sizes), 4 /*sets per pool*/,
+            VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT, 0 /*frames*/);
 }
 
-static VkDescriptorSet*
-descriptorsets_create(VkDescriptorPool pool, VkDevice device,
-        u32 numImages, VkDescriptorSetLayout layout, Buffer* uniformBuffers, const Texture* tex) {
-
-    VkDescriptorSet* ret = malloc(sizeof(VkDescriptorSet) * numImages);
-    VkDescriptorSetLayout* layouts = malloc(sizeof(VkDescriptorSetLayout) * numImages);
-    for(u32 i = 0; i < numImages; i++) {
-        layouts[i] = layout;
-    }
-
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = pool;
-    allocInfo.descriptorSetCount = numImages;
-    // Create one descriptorset per swapchain image
-    allocInfo.pSetLayouts = layouts;
-
-    if(vkAllocateDescriptorSets(device, &allocInfo, ret) != VK_SUCCESS) {
-        ABORT("Failed to allocate description sets");
-    }
+// Set for each swapchain image, same uniform buffers give same sets back from cache
+static void
+descriptorsets_get(DescriptorAllocator* alloc, VkDescriptorSet* sets, u32 numImages,
+        VkDescriptorSetLayout layout, Buffer* uniformBuffers, const BindlessTextures* textures) {
 
+    PROFILE_FUNCTION();
     // populate matrix desc
     VkDescriptorBufferInfo bufferInfo = {};
     bufferInfo.range = MEMBER_SIZE(UniformObject, data);
 
-    // populate matrix desc
-    VkDescriptorImageInfo imageInfo = {};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = tex->view;
-    imageInfo.sampler = tex->sampler;
-
-    // write information for both descriptors
-    VkWriteDescriptorSet writes[2] = {0};
+    // textures are written separately with bindless_write
+    VkWriteDescriptorSet writes[1] = {0};
     writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     writes[0].descriptorCount = 1;
     writes[0].dstBinding = 0;
     writes[0].pBufferInfo = &bufferInfo;
 
-    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writes[1].descriptorCount = 1;
-    writes[1].dstBinding = 1;
-    writes[1].pImageInfo = &imageInfo;
-
     // for each set
     for(u32 i = 0; i < numImages; i++) {
         bufferInfo.buffer = uniformBuffers[i].bufferId;
-        writes[0].dstSet = ret[i];
-        writes[1].dstSet = ret[i];
-
-        vkUpdateDescriptorSets(device, SIZEOF_ARRAY(writes), writes, 0 /*copy count*/, NULL /*copies*/);
+        u8 created = 0;
+        sets[i] = descriptorallocator_cached(alloc, layout, writes, SIZEOF_ARRAY(writes), &created);
+        if(created) {
+            bindless_write(textures, &sets[i], 1, 0, alloc->device);
+        }
     }
-
-    free(layouts);
-    return ret;
-}
-
-static void
-descriptorsets_dispose(VkDescriptorSet* sets) {
-
-    // no need to free sets because the pool is already disposed
-    free(sets);
 }
 
 #endif /* UNIFORMOBJECTS_H */
@@ -8,13 +8,30 @@
 #include "buffer.h"
 #include "cmath.h"
 #include "objload.h"
+#include "meshsimplify.h"
+#include "meshlet.h"
 
 typedef struct VertexData {
     Buffer  vertex;
     Buffer  index;
     u32     numIndexes;
+    vec4    bounds;     // object space bounding sphere, radius in w
+    MeshLod lods[MESH_MAX_LODS];    // index ranges in index buffer, first is the full mesh
+    u32     numLods;
+    Meshlet*    meshlets;   // clusters of the full mesh, cover lods[0]
+    u32         numMeshlets;
+    MeshletBounds   meshletBounds;
 } VertexData;
 
+// Cpu side of a mesh, made by vertexdata_load in any thread and uploaded by vertexdata_upload
+typedef struct MeshLoadData {
+    VertexData  mesh;           // everything but the buffers
+    Vertex*     vertexes;
+    u32         numVertexes;
+    u32*        indexes;        // all lods back to back
+    u32         numIndexes;
+} MeshLoadData;
+
 static const Vertex Rectangle[] = {
     {.pos = {-0.5f, -0.5f, 0}, .color = {1.0f, 0.0f, 0.0f}, .uv = {1.0f, 0.0f}},
     {.pos = {0.5f, -0.5f, 0},  .color = {0.0f, 1.0f, 0.0f}, .uv = {0.0f, 0.0f}},
@@ -81,16 +98,70 @@ static VertexAttributeDescription vertex_get_attribute_descriptions(){
 };
 
 
-static void
-vertexdata_init(VertexData* data, VkDevice device, VkPhysicalDevice physicalDevice,
-        VkCommandPool pool, VkQueue graphicsque) {
+// Sphere around the center of the bounding box, loose but cheap
+static vec4
+_vertexdata_bounds(const Vertex* vertexes, u32 numVertexes) {
+
+    if(!numVertexes) return (vec4){};
+
+    vec3 low = vertexes[0].pos;
+    vec3 high = vertexes[0].pos;
+    for(u32 i = 1; i < numVertexes; i++) {
+        low.x = minf(low.x, vertexes[i].pos.x);
+        low.y = minf(low.y, vertexes[i].pos.y);
+        low.z = minf(low.z, vertexes[i].pos.z);
+        high.x = maxf(high.x, vertexes[i].pos.x);
+        high.y = maxf(high.y, vertexes[i].pos.y);
+        high.z = maxf(high.z, vertexes[i].pos.z);
+    }
+    vec3 center = scale_vec3(add_vec3(low, high), 0.5f);
+
+    float radius = 0.f;
+    for(u32 i = 0; i < numVertexes; i++) {
+        radius = maxf(radius, lenght_vec3(neg_vec3(vertexes[i].pos, center)));
+    }
+    return (vec4){center.x, center.y, center.z, radius};
+}
 
-    //Crate vertex buffer
+// Parse and build meshlets and lods, touches no vulkan so it can run in a worker
+static void
+vertexdata_load(MeshLoadData* load, const char* path) {
 
-    VertexLoadData verts = obj_load("models/chalet.obj");
+    memset(load, 0, sizeof *load);
+    VertexData* data = &load->mesh;
+    VertexLoadData verts = obj_load(path);
     data->numIndexes = verts.numIndexes;
+    data->bounds = _vertexdata_bounds(verts.vertexes, verts.numVertexes);
+    load->vertexes = verts.vertexes;
+    load->numVertexes = verts.numVertexes;
+
+    // Full mesh is ordered by meshlets so that each one is a contiguous index range
+    data->meshlets = meshlet_build((u32*)verts.indexes, verts.numIndexes,
+            &verts.vertexes[0].pos.x, sizeof(Vertex), verts.numVertexes, &data->numMeshlets);
+    LOG("Built %d meshlets, %.1f triangles per meshlet", data->numMeshlets,
+            (float)verts.numIndexes / 3.f / (float)data->numMeshlets);
+    data->meshletBounds = meshlet_bounds_create(data->meshlets, data->numMeshlets);
+
+    // Simplified levels follow the full mesh
+    load->indexes = (u32*)malloc(sizeof *load->indexes * verts.numIndexes * 2);
+    data->numLods = meshsimplify_build_lods(data->lods, MESH_MAX_LODS, load->indexes,
+            (u32*)verts.indexes, verts.numIndexes, &verts.vertexes[0].pos.x, sizeof(Vertex), verts.numVertexes);
+    for(u32 i = 0; i < data->numLods; i++) {
+        LOG("Lod %d: %d triangles, error %f", i, data->lods[i].numIndexes / 3, data->lods[i].error);
+    }
+    const MeshLod* last = &data->lods[data->numLods - 1];
+    load->numIndexes = last->firstIndex + last->numIndexes;
+    free(verts.indexes);
+}
+
+// Create buffers and take the rest of load, which is empty after
+static void
+vertexdata_upload(VertexData* data, MeshLoadData* load, VkDevice device, VkPhysicalDevice physicalDevice,
+        VkCommandPool pool, VkQueue graphicsque) {
+
+    *data = load->mesh;
     void* memData;
-    u32 vertexSize = sizeof *verts.vertexes * verts.numVertexes;
+    u32 vertexSize = sizeof *load->vertexes * load->numVertexes;
     Buffer stagingBuffer = {};
 
     // use staging buffer as source buffer and move its data to actual vertexbuffer as source buffer
@@ -105,7 +176,7 @@ vertexdata_init(VertexData* data, VkDevice device, VkPhysicalDevice physicalDevi
             vertexSize,
             0, // memorymap flags
             &memData);
-    memcpy(memData, verts.vertexes, vertexSize);
+    memcpy(memData, load->vertexes, vertexSize);
     // unmapping starts copying mempry to buffer
     vkUnmapMemory(device, stagingBuffer.bufferMemory);
 
@@ -120,8 +191,7 @@ vertexdata_init(VertexData* data, VkDevice device, VkPhysicalDevice physicalDevi
 
     buffer_dispose(&stagingBuffer, device);
 
-    // Create index buffer
-    u32 indexSize = sizeof *verts.indexes * verts.numIndexes;
+    u32 indexSize = sizeof *load->indexes * load->numIndexes;
     stagingBuffer = buffer_create(physicalDevice, device,
             indexSize,
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT, // usage
@@ -133,7 +203,7 @@ vertexdata_init(VertexData* data, VkDevice device, VkPhysicalDevice physicalDevi
             indexSize,
             0, // memorymap flags
             &memData);
-    memcpy(memData, verts.indexes , indexSize);
+    memcpy(memData, load->indexes, indexSize);
     vkUnmapMemory(device, stagingBuffer.bufferMemory);
 
     data->index = buffer_create(physicalDevice, device,
@@ -145,12 +215,32 @@ vertexdata_init(VertexData* data, VkDevice device, VkPhysicalDevice physicalDevi
     buffer_copy(&stagingBuffer, &data->index, device, pool, graphicsque);
 
     buffer_dispose(&stagingBuffer, device);
+    free(load->vertexes);
+    free(load->indexes);
+    memset(load, 0, sizeof *load);
+}
+
+// Mesh that was never uploaded
+static void
+vertexdata_load_dispose(MeshLoadData* load) {
+    free(load->vertexes);
+    free(load->indexes);
+    free(load->mesh.meshlets);
+    meshlet_bounds_dispose(&load->mesh.meshletBounds);
+}
+
+// Buffers are empty until the mesh has been uploaded
+static inline u8
+vertexdata_ready(const VertexData* data) {
+    return data->vertex.bufferId != VK_NULL_HANDLE;
 }
 
 static void
 vertexdata_dispose(VertexData *data, VkDevice device) {
     buffer_dispose(&data->vertex, device);
     buffer_dispose(&data->index, device);
+    free(data->meshlets);
+    meshlet_bounds_dispose(&data->meshletBounds);
 }
 
 #endif /* VERTEX_H */
@@ -11,6 +11,8 @@
 #include "validationLayers.h"
 #include "physicalDevice.h"
 #include "logicalDevice.h"
+#include "profiler.h"
+#include "startup.h"
 
 // Vulkan context is heart/start of vulkan application
 typedef struct VulkanContext {
@@ -33,7 +35,7 @@ static VkInstance _create_instace() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "Custom";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_1; // features2 query for descriptor indexing
 
     // Info about instance
     VkInstanceCreateInfo createInfo = {};
@@ -87,17 +89,19 @@ static VkInstance _create_instace() {
 
 static void
 vulkancontext_init(VulkanContext* context) {
+    PROFILE_FUNCTION();
     context->instance = _create_instace();
+    LOG("Vulkan instance created, %.1f ms", startup_step(&g_startup, "instance"));
 
     if (enableValidationLayers) {
         init_debug_messenger(context->instance,&context->debugMessenger);
-        LOG("Debug messenger initialized");
+        LOG("Debug messenger initialized, %.1f ms", startup_step(&g_startup, "debug messenger"));
     }
     LOG("Vulkan context initialized");
     window_create_surface(context->instance,&context->surface);
-    LOG("Window surface created");
+    LOG("Window surface created, %.1f ms", startup_step(&g_startup, "surface"));
     physical_device_pick(context->instance,&context->physicalDevice, context->surface);
-    LOG("Physical device picked");
+    LOG("Physical device picked, %.1f ms", startup_step(&g_startup, "physical device"));
 }
 
 static void
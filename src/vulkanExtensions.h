@@ -8,7 +8,9 @@
 
 
 const char* g_extensionNames[] = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+    VK_KHR_MAINTENANCE3_EXTENSION_NAME,         // needed by descriptor indexing
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,  // bindless texture array
 };
 
 static const char** extensions_get_required(u32* numExtensions) {
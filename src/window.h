@@ -6,6 +6,7 @@
 #define WINDOW_H
 
 #include "utils.h"
+#include "profiler.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include <vulkan/vulkan.h>
@@ -32,6 +33,7 @@ static void window_resize_callback(GLFWwindow* window, int width, int height) {
 }
 
 void window_init() {
+    PROFILE_FUNCTION();
     glfwInit();
     // start glfw with out opengl context
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
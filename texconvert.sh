@@ -0,0 +1,21 @@
+#!/bin/bash
+
+BUILD_DIR=./build/release
+
+if [ ! -d $BUILD_DIR ]; then
+    echo "Creating $BUILD_DIR"
+    mkdir -p $BUILD_DIR
+fi
+
+# converts to dds next to each image, loader prefers those over source
+# dds.h takes format enums from vulkan headers
+gcc src/texconvert.c -O2 -Wall -Wextra -Wno-unused-function -Wno-missing-braces \
+    -I "/home/pate/Downloads/vulkan/1.1.126.0/x86_64/include/" \
+    -lm -lpthread -o $BUILD_DIR/texconvert
+
+if [ $? -ne 0 ]; then
+    echo "Build failed"
+    exit 1
+fi
+
+$BUILD_DIR/texconvert "$@"